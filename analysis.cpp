@@ -0,0 +1,291 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include "analysis.hpp"
+#include "threadpool.hpp"
+#include "profiler.hpp"
+#define GRAIN (1 << 16)		// Triangles per parallel chunk
+#define BUCKET_BITS 12		// Edge & vertex tables are sorted in 2^BUCKET_BITS buckets
+#define DEGENERATE 1e-6		// Height relative to the longest edge below which a triangle is degenerate
+#define FLAT 1e-9		// Volume relative to area times size below which there is none
+
+namespace {
+
+const size_t BUCKETS = size_t(1) << BUCKET_BITS;
+
+/** Scramble 64 bits (splitmix64 finalizer).
+*/
+uint64_t mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ull;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+/** Hash a position, so identical positions get identical keys.
+*/
+uint64_t vertexKey(const float *p)
+{
+	float q[3] = { p[0] + 0.f, p[1] + 0.f, p[2] + 0.f }; // Also turns -0 into +0
+	uint32_t b[3];
+	memcpy(b, q, sizeof b);
+	return mix(mix(mix(b[0]) ^ b[1]) ^ b[2]);
+}
+
+/** Get the keys of a triangle's edges, the same in either direction
+ * except for the lowest bit, which tells the direction.
+ * @return Number of keys, none if two corners are at the same position
+*/
+int edgeKeys(const float *t, uint64_t *out)
+{
+	uint64_t v[3] = { vertexKey(t), vertexKey(t + 3), vertexKey(t + 6) };
+	if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) return 0;
+	for (int j = 0; j < 3; ++j) {
+		uint64_t a = v[j], b = v[(j + 1) % 3];
+		uint64_t k = mix(std::min(a, b) ^ mix(std::max(a, b)));
+		out[j] = (k & ~1ull) | (a < b);
+	}
+	return 3;
+}
+
+/** Sort the keys emitted for every triangle, first into buckets by their
+ * top bits and then within each bucket, all on the pool.
+ * @param n Number of triangles
+ * @param emit Called as emit(i, out) to write up to 3 keys, returns how many
+ * @param keys Set to the sorted keys
+ * @param start Set to the first key of each bucket, and the total
+*/
+template<typename F>
+void bucketSort(uint32_t n, const F& emit, std::unique_ptr<uint64_t[]>& keys, std::vector<size_t>& start)
+{
+	ThreadPool& pool = ThreadPool::shared();
+	size_t chunks = pool.chunks(n, GRAIN);
+	std::vector<size_t> at(chunks * BUCKETS, 0);
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t c) {
+		size_t *h = &at[c * BUCKETS];
+		uint64_t k[3];
+		for (size_t i = b; i < e; ++i) {
+			int m = emit(static_cast<uint32_t>(i), k);
+			for (int j = 0; j < m; ++j) ++h[k[j] >> (64 - BUCKET_BITS)];
+		}
+	}, GRAIN);
+
+	// Each chunk writes its share of a bucket after the previous chunk's
+	start.assign(BUCKETS + 1, 0);
+	size_t sum = 0;
+	for (size_t k = 0; k < BUCKETS; ++k) {
+		start[k] = sum;
+		for (size_t c = 0; c < chunks; ++c) {
+			size_t t = at[c * BUCKETS + k];
+			at[c * BUCKETS + k] = sum;
+			sum += t;
+		}
+	}
+	start[BUCKETS] = sum;
+
+	keys.reset(new uint64_t[std::max<size_t>(sum, 1)]);
+	uint64_t *out = keys.get();
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t c) {
+		size_t *h = &at[c * BUCKETS];
+		uint64_t k[3];
+		for (size_t i = b; i < e; ++i) {
+			int m = emit(static_cast<uint32_t>(i), k);
+			for (int j = 0; j < m; ++j) out[h[k[j] >> (64 - BUCKET_BITS)]++] = k[j];
+		}
+	}, GRAIN);
+
+	pool.parallelFor(BUCKETS, [&](size_t b, size_t e, size_t) {
+		for (size_t k = b; k < e; ++k) std::sort(out + start[k], out + start[k + 1]);
+	}, 1);
+}
+
+} // namespace
+
+Analysis::Analysis()
+{}
+
+bool Analysis::run(const Solid& s, Report& r) const
+{
+	r = Report();
+	const float *pos = s.getPositions();
+	uint32_t n = s.size();
+	if (!pos && n) return false;
+	r.triangles = n;
+	if (!n) return true;
+
+	ThreadPool& pool = ThreadPool::shared();
+	Profiler::Scope p("analysis", "load");
+
+	// Sums per chunk, relative to one vertex to keep precision far from
+	// the origin
+	struct Sums {
+		double area, volume, moment[3], surface[3], lower[3], upper[3];
+		uint32_t degenerate, collapsed;
+	};
+	const double ref[3] = { pos[0], pos[1], pos[2] };
+	std::vector<Sums> part(pool.chunks(n, GRAIN));
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t c) {
+		Sums m = {};
+		std::fill(m.lower, m.lower + 3, INFINITY);
+		std::fill(m.upper, m.upper + 3, -INFINITY);
+		for (size_t i = b; i < e; ++i) {
+			const float *t = pos + i * 9;
+			double v[3][3];
+			for (int j = 0; j < 3; ++j) {
+				for (int a = 0; a < 3; ++a) {
+					v[j][a] = t[j * 3 + a] - ref[a];
+					m.lower[a] = std::min(m.lower[a], static_cast<double>(t[j * 3 + a]));
+					m.upper[a] = std::max(m.upper[a], static_cast<double>(t[j * 3 + a]));
+				}
+			}
+
+			// Area from the cross product of two edges
+			double e1[3], e2[3], e3[3];
+			for (int a = 0; a < 3; ++a) {
+				e1[a] = v[1][a] - v[0][a];
+				e2[a] = v[2][a] - v[0][a];
+				e3[a] = v[2][a] - v[1][a];
+			}
+			double x[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			double len = std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+			m.area += len / 2;
+			for (int a = 0; a < 3; ++a) m.surface[a] += len * (v[0][a] + v[1][a] + v[2][a]);
+
+			// Height under a fraction of the longest edge
+			double l2 = 0;
+			for (const double *d : { e1, e2, e3 }) l2 = std::max(l2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (len <= DEGENERATE * l2) ++m.degenerate;
+			for (int j = 0; j < 3; ++j) {
+				const float *a = t + j * 3, *b = t + (j + 1) % 3 * 3;
+				if (a[0] == b[0] && a[1] == b[1] && a[2] == b[2]) {
+					++m.collapsed;
+					break;
+				}
+			}
+
+			// Tetrahedron to the reference vertex, six times its volume
+			double vol = v[0][0] * (v[1][1] * v[2][2] - v[1][2] * v[2][1])
+				+ v[0][1] * (v[1][2] * v[2][0] - v[1][0] * v[2][2])
+				+ v[0][2] * (v[1][0] * v[2][1] - v[1][1] * v[2][0]);
+			m.volume += vol;
+			for (int a = 0; a < 3; ++a) m.moment[a] += vol * (v[0][a] + v[1][a] + v[2][a]);
+		}
+		part[c] = m;
+	}, GRAIN);
+
+	double moment[3] = {}, surface[3] = {};
+	std::fill(r.lower, r.lower + 3, INFINITY);
+	std::fill(r.upper, r.upper + 3, -INFINITY);
+	for (const Sums& m : part) {
+		r.area += m.area;
+		r.volume += m.volume;
+		r.degenerate += m.degenerate;
+		r.collapsed += m.collapsed;
+		for (int a = 0; a < 3; ++a) {
+			moment[a] += m.moment[a];
+			surface[a] += m.surface[a];
+			r.lower[a] = std::min(r.lower[a], m.lower[a]);
+			r.upper[a] = std::max(r.upper[a], m.upper[a]);
+		}
+	}
+	// Flat or open parts may have next to no volume, rounding errors would
+	// then throw the center of mass anywhere. The area-weighted center of
+	// the surface is used instead, or the box's if there's no area either
+	double size = std::sqrt((r.upper[0] - r.lower[0]) * (r.upper[0] - r.lower[0])
+		+ (r.upper[1] - r.lower[1]) * (r.upper[1] - r.lower[1])
+		+ (r.upper[2] - r.lower[2]) * (r.upper[2] - r.lower[2]));
+	r.massCenter = std::fabs(r.volume) > FLAT * 6 * r.area * size;
+	for (int a = 0; a < 3; ++a) {
+		if (r.massCenter) r.center[a] = moment[a] / (4 * r.volume) + ref[a];
+		else if (r.area > 0) r.center[a] = surface[a] / (6 * r.area) + ref[a];
+		else r.center[a] = (r.lower[a] + r.upper[a]) / 2;
+	}
+	r.volume /= 6;
+
+	// Edge table: every edge should appear once in each direction, collapsed
+	// triangles have no area and are left out
+	std::unique_ptr<uint64_t[]> keys;
+	std::vector<size_t> start;
+	bucketSort(n, [pos](uint32_t i, uint64_t *out) { return edgeKeys(pos + static_cast<size_t>(i) * 9, out); }, keys, start);
+
+	std::vector<uint64_t> count(BUCKETS * 4, 0);
+	pool.parallelFor(BUCKETS, [&](size_t b, size_t e, size_t) {
+		for (size_t k = b; k < e; ++k) {
+			const uint64_t *q = keys.get();
+			for (size_t i = start[k], j; i < start[k + 1]; i = j) {
+				size_t fwd = 0;
+				for (j = i; j < start[k + 1] && (q[j] >> 1) == (q[i] >> 1); ++j) fwd += q[j] & 1;
+				size_t uses = j - i;
+				uint64_t *c = &count[k * 4];
+				++c[0];
+				if (uses == 1) ++c[1];
+				else if (uses > 2) ++c[2];
+				else if (fwd != 1) ++c[3];
+			}
+		}
+	}, 16);
+	for (size_t k = 0; k < BUCKETS; ++k) {
+		r.edges += count[k * 4];
+		r.open += count[k * 4 + 1];
+		r.nonManifold += count[k * 4 + 2];
+		r.misoriented += count[k * 4 + 3];
+	}
+
+	// Vertex table
+	keys.reset();
+	bucketSort(n, [pos](uint32_t i, uint64_t *out) {
+		const float *t = pos + static_cast<size_t>(i) * 9;
+		for (int j = 0; j < 3; ++j) out[j] = vertexKey(t + j * 3);
+		return 3;
+	}, keys, start);
+	std::fill(count.begin(), count.end(), 0);
+	pool.parallelFor(BUCKETS, [&](size_t b, size_t e, size_t) {
+		for (size_t k = b; k < e; ++k) {
+			const uint64_t *q = keys.get();
+			for (size_t i = start[k]; i < start[k + 1]; ++i) count[k * 4] += (i == start[k] || q[i] != q[i - 1]);
+		}
+	}, 16);
+	for (size_t k = 0; k < BUCKETS; ++k) r.vertices += count[k * 4];
+	return true;
+}
+
+bool Analysis::watertight(const Report& r)
+{
+	return r.triangles > 0 && r.open == 0 && r.nonManifold == 0 && r.misoriented == 0;
+}
+
+void Analysis::print(const Report& r)
+{
+	std::ostream& os = std::cout;
+	std::ios::fmtflags flags = os.flags();
+	std::streamsize precision = os.precision();
+	os << std::setprecision(6);
+
+	// V - E + F is 2 for each closed surface without holes
+	int64_t euler = static_cast<int64_t>(r.vertices) - static_cast<int64_t>(r.edges) + (r.triangles - r.collapsed);
+	os << "  Triangles:     " << r.triangles << " (" << r.degenerate << " degenerate, " << r.collapsed << " collapsed)\n"
+		<< "  Vertices:      " << r.vertices << "\n"
+		<< "  Edges:         " << r.edges << " (" << r.open << " open, " << r.nonManifold << " non-manifold, "
+		<< r.misoriented << " misoriented)\n"
+		<< "  Euler number:  " << euler << "\n"
+		<< "  Watertight:    " << (watertight(r) ? "yes" : "no") << "\n"
+		<< "  Bounds:        (" << r.lower[0] << ", " << r.lower[1] << ", " << r.lower[2] << ") to ("
+		<< r.upper[0] << ", " << r.upper[1] << ", " << r.upper[2] << ")\n"
+		<< "  Surface area:  " << r.area << "\n"
+		<< "  Volume:        " << r.volume << (watertight(r) ? "" : " (not closed, approximate)") << "\n"
+		<< "  Center of mass: (" << r.center[0] << ", " << r.center[1] << ", " << r.center[2] << ")"
+		<< (r.massCenter ? "" : " (no volume, center of the surface)") << std::endl;
+
+	os.flags(flags);
+	os.precision(precision);
+}
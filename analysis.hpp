@@ -0,0 +1,51 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+#include <cstdint>
+#include "solid.hpp"
+
+class Analysis {
+public:
+	/** What was found in a solid.
+	*/
+	struct Report {
+		uint32_t triangles;
+		uint32_t degenerate;	// Zero area, or thinner than a millionth of the longest edge
+		uint32_t collapsed;	// Degenerate with two corners at the same position, left out of edges
+		uint64_t vertices;	// Distinct positions
+		uint64_t edges;		// Distinct edges of nonzero length
+		uint64_t open;		// Used by one triangle only
+		uint64_t nonManifold;	// Used by more than two triangles
+		uint64_t misoriented;	// Used twice in the same direction
+		double area;
+		double volume;		// Positive when the normals point out
+		double center[3];	// Center of mass at uniform density, see massCenter
+		bool massCenter;	// False if there's no volume, center is then the surface's
+		double lower[3];	// Bounding box
+		double upper[3];
+	};
+
+	Analysis();
+
+	/** Analyse the triangles of a solid on the shared thread pool.
+	 * Vertices are matched by exact position and edges by a 64-bit hash
+	 * of their ends, which are sorted into a table in buckets.
+	 * @param s The solid, read with any loader except the chunked one
+	 * @param r Overwritten with the results
+	 * @return False if the solid has no positions to analyse
+	*/
+	bool run(const Solid&, Report&) const;
+
+	/** Check if a report describes a closed, consistently oriented
+	 * surface, i.e. one that encloses its volume.
+	 * @param r Report
+	 * @return True if every edge joins exactly two triangles properly
+	*/
+	static bool watertight(const Report&);
+
+	/** Print a report in a human readable form.
+	 * @param r Report
+	*/
+	static void print(const Report&);
+};
+
+#endif
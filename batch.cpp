@@ -0,0 +1,178 @@
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <GL/glew.h>
+#include "batch.hpp"
+#include "solid.hpp"
+#include "camera.hpp"
+#include "offscreen.hpp"
+#include "rasterizer.hpp"
+#include "threadpool.hpp"
+#include "importer.hpp"
+#define PI 3.1415926535
+
+namespace fs = std::filesystem;
+
+Batch::Batch()
+: m_out(".")
+, m_format("png")
+, m_views(1)
+, m_width(256)
+, m_height(256)
+, m_eps(0)
+, m_fix(false)
+, m_software(false)
+{}
+
+void Batch::setOutput(std::string d)
+{
+	m_out = d;
+}
+
+void Batch::setViews(int n)
+{
+	m_views = std::max(n, 1);
+}
+
+void Batch::setSize(int w, int h)
+{
+	if (w > 0 && h > 0) {
+		m_width = w;
+		m_height = h;
+	}
+}
+
+void Batch::setFormat(std::string f)
+{
+	if (!f.compare("png") || !f.compare("ppm")) m_format = f;
+}
+
+void Batch::setWeldEpsilon(double e)
+{
+	m_eps = e;
+}
+
+void Batch::setFixNormals(bool b)
+{
+	m_fix = b;
+}
+
+void Batch::setSoftware(bool b)
+{
+	m_software = b;
+}
+
+bool Batch::run(const std::vector<std::string>& in)
+{
+	std::vector<std::string> files = Importer::collect(in);
+	if (files.empty()) {
+		std::cerr << "No models to render" << std::endl;
+		return false;
+	}
+
+	std::error_code ec;
+	fs::create_directories(m_out, ec);
+
+	// The software rasterizer needs no context at all
+	Offscreen ctx;
+	Rasterizer raster(m_width, m_height);
+	if (!m_software) {
+		if (!ctx.init(m_width, m_height)) return false;
+
+		// Same state as the interactive viewer
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_LIGHT0);
+		glClearColor(0.f, 0.f, 0.f, 0.f);
+		glShadeModel(GL_FLAT);
+	}
+
+	ThreadPool& pool = ThreadPool::shared();
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t writing = 0;
+	size_t failed = 0;
+
+	// Parse on the pool, a bounded number of models ahead of the renderer
+	Solid::Options options;
+	options.eps = m_eps;
+	options.fix = m_fix;
+	Importer import;
+	import.setOptions(options);
+	import.setFull(false);
+	import.setAhead(2 * pool.size());
+
+	auto begin = std::chrono::steady_clock::now();
+	import.start(files);
+	Importer::Result j;
+	while (import.next(j)) {
+		const std::string& f = files[j.index];
+		if (!j.ok) {
+			std::cerr << "Skipping " << std::quoted(f) << std::endl;
+			++failed;
+			continue;
+		}
+
+		if (!m_software) {
+			j.solid.upload();
+			j.solid.toggleLight();
+		}
+
+		// Same framing as the interactive viewer
+		Camera cam;
+		cam.setRatio(static_cast<double>(m_width) / m_height);
+		cam.setFov(45.f);
+		cam.frame(j.solid);
+
+		double step = 2 * PI / m_views;
+		std::string stem = (fs::path(m_out) / fs::path(f).stem()).string();
+		for (int v = 0; v < m_views; ++v) {
+			Image img;
+			cam.clip(j.solid);
+			if (m_software) {
+				raster.render(j.solid, cam, true);
+				img = raster.getImage();
+			} else {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				cam.render(j.solid);
+				img = ctx.read();
+			}
+
+			// Encoding is slow enough to be worth handing off
+			std::string name = stem + (m_views > 1 ? "_" + std::to_string(v) : "") + "." + m_format;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				++writing;
+			}
+			pool.submit([&, name, img = std::move(img)] {
+				bool ok = img.write(name);
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!ok) std::cerr << "Couldn't write " << std::quoted(name) << std::endl;
+				--writing;
+				cv.notify_all();
+			});
+
+			// Turn around the vertical axis
+			cam.rotateSolid(Quat::axisAngle(Vector3(0, 1, 0), step));
+		}
+		if (!m_software) glDisable(GL_LIGHTING);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] { return writing == 0; });
+	}
+
+	import.report();
+	std::chrono::duration<double> sec = std::chrono::steady_clock::now() - begin;
+	size_t done = files.size() - failed;
+	std::cout << "Rendered " << done << " models (" << done * static_cast<size_t>(m_views)
+		<< " images) in " << std::round(sec.count() * 100.0) / 100.0 << " s ("
+		<< std::round(static_cast<double>(done) / sec.count() * 10.0) / 10.0
+		<< " models/s)" << std::endl;
+	return failed == 0;
+}
@@ -0,0 +1,67 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+#include <string>
+#include <vector>
+
+class Batch {
+public:
+	Batch();
+
+	/** Set the directory images are written to.
+	 * @param d Output directory, created if missing
+	*/
+	void setOutput(std::string);
+
+	/** Set the number of views rendered per model. Views are evenly
+	 * spaced around the model's vertical axis.
+	 * @param n Number of views
+	*/
+	void setViews(int);
+
+	/** Set the size of the rendered images.
+	 * @param w Width in pixels
+	 * @param h Height in pixels
+	*/
+	void setSize(int, int);
+
+	/** Set the image format.
+	 * @param f Either "png" or "ppm"
+	*/
+	void setFormat(std::string);
+
+	/** Set how close vertices must be to be merged.
+	 * @param e Distance, 0 to merge only identical vertices
+	*/
+	void setWeldEpsilon(double);
+
+	/** Choose whether bad file normals are replaced by computed ones.
+	 * @param b True to replace them
+	*/
+	void setFixNormals(bool);
+
+	/** Choose between OpenGL and the software rasterizer.
+	 * @param b True to render on the CPU without any OpenGL context
+	*/
+	void setSoftware(bool);
+
+	/** Render every model without a window. Models are parsed on the
+	 * shared thread pool by an Importer while the main thread renders,
+	 * and images are encoded back on the pool.
+	 * @param in Model files and/or directories to search for `.stl` files
+	 * @return True if every model was rendered, false otherwise
+	*/
+	bool run(const std::vector<std::string>&);
+
+private:
+	// Instance variables
+	std::string m_out;
+	std::string m_format;
+	int m_views;
+	int m_width;
+	int m_height;
+	double m_eps;
+	bool m_fix;
+	bool m_software;
+};
+
+#endif
@@ -0,0 +1,610 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
+#include <random>
+#include <functional>
+#include <cstring>
+#include <thread>
+#include <system_error>
+#include <unistd.h>
+#include "solid.hpp"
+#include "camera.hpp"
+#include "rasterizer.hpp"
+#include "bvh.hpp"
+#include "normals.hpp"
+#include "isa.hpp"
+#include "bounds.hpp"
+#include "mat4.hpp"
+#include "offscreen.hpp"
+#define PI 3.1415926535
+#define REPEATS 7	// Default number of timed runs per stage
+
+/** Generate a UV sphere as a flat list of records.
+ * @param n Approximate number of facets
+ * @return 12 floats per facet in order: normal, v0, v1, v2
+*/
+std::vector<float> sphere(uint32_t n)
+{
+	uint32_t rings = std::max(2u, static_cast<uint32_t>(std::sqrt(n / 4.0)));
+	uint32_t segs = rings * 2;
+	auto at = [&](uint32_t i, uint32_t j) {
+		double t = PI * i / rings, p = 2 * PI * j / segs;
+		return Vector3(std::sin(t) * std::cos(p), std::sin(t) * std::sin(p), std::cos(t));
+	};
+
+	std::vector<float> out;
+	for (uint32_t i = 0; i < rings; ++i) {
+		for (uint32_t j = 0; j < segs; ++j) {
+			Vector3 q[4] = { at(i, j), at(i + 1, j), at(i + 1, j + 1), at(i, j + 1) };
+			const int tris[2][3] = { {0, 1, 2}, {0, 2, 3} };
+			for (const int *t : tris) {
+				Vector3 a = q[t[0]], b = q[t[1]], c = q[t[2]];
+				Vector3 nrm = (b - a).cross(c - a);
+				if (nrm.mag() == 0) continue; // Skip slivers at the poles
+				nrm = nrm.norm();
+				for (const Vector3& v : { nrm, a, b, c }) {
+					out.push_back(static_cast<float>(v.x));
+					out.push_back(static_cast<float>(v.y));
+					out.push_back(static_cast<float>(v.z));
+				}
+			}
+		}
+	}
+	return out;
+}
+
+/** Write records as a binary `.stl` file.
+ * @return True on success
+*/
+bool writeBinary(const std::string& f, const std::vector<float>& r)
+{
+	std::ofstream os(f, std::ofstream::binary);
+	char header[80] = "bench";
+	uint32_t n = static_cast<uint32_t>(r.size() / 12);
+	uint16_t attr = 0;
+	os.write(header, 80);
+	os.write((const char *) &n, 4);
+	for (uint32_t i = 0; i < n; ++i) {
+		os.write((const char *) &r[i * 12], 48);
+		os.write((const char *) &attr, 2);
+	}
+	return os.good();
+}
+
+/** Write records as a text `.stl` file.
+ * @param upper Write the keywords in uppercase, as some CAD programs do
+ * @return True on success
+*/
+bool writeAscii(const std::string& f, const std::vector<float>& r, bool upper)
+{
+	std::ofstream os(f);
+	char buf[128];
+	os << (upper ? "SOLID BENCH\n" : "solid bench\n");
+	for (size_t i = 0; i < r.size(); i += 12) {
+		snprintf(buf, sizeof buf, upper ? "  FACET NORMAL %E %E %E\n    OUTER LOOP\n"
+			: "  facet normal %e %e %e\n    outer loop\n", r[i], r[i + 1], r[i + 2]);
+		os << buf;
+		for (size_t j = 3; j < 12; j += 3) {
+			snprintf(buf, sizeof buf, upper ? "      VERTEX %E %E %E\n" : "      vertex %e %e %e\n",
+				r[i + j], r[i + j + 1], r[i + j + 2]);
+			os << buf;
+		}
+		os << (upper ? "    ENDLOOP\n  ENDFACET\n" : "    endloop\n  endfacet\n");
+	}
+	os << (upper ? "ENDSOLID BENCH\n" : "endsolid bench\n");
+	return os.good();
+}
+
+/** Generate a terrain from a few octaves of value noise.
+ * @param n Approximate number of facets
+ * @param seed Seed of the noise lattice
+ * @return 12 floats per facet in order: normal, v0, v1, v2
+*/
+std::vector<float> terrain(uint32_t n, uint32_t seed)
+{
+	uint32_t g = std::max(2u, static_cast<uint32_t>(std::sqrt(n / 2.0)) + 1);
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	std::vector<float> lattice(64 * 64);
+	for (float& l : lattice) l = u(gen);
+
+	// Smoothly interpolated lattice values, wrapping around
+	auto noise = [&](double x, double y) {
+		int ix = static_cast<int>(std::floor(x)), iy = static_cast<int>(std::floor(y));
+		double fx = x - ix, fy = y - iy;
+		fx = fx * fx * (3 - 2 * fx);
+		fy = fy * fy * (3 - 2 * fy);
+		auto at = [&](int i, int j) { return lattice[((j & 63) * 64) + (i & 63)]; };
+		double a = at(ix, iy) + (at(ix + 1, iy) - at(ix, iy)) * fx;
+		double b = at(ix, iy + 1) + (at(ix + 1, iy + 1) - at(ix, iy + 1)) * fx;
+		return a + (b - a) * fy;
+	};
+	auto height = [&](uint32_t i, uint32_t j) {
+		double h = 0, amp = 0.5, freq = 4.0 / g;
+		for (int o = 0; o < 5; ++o, amp /= 2, freq *= 2) h += amp * noise(i * freq, j * freq);
+		return Vector3(static_cast<double>(i) / g, static_cast<double>(j) / g, h * 0.3);
+	};
+
+	std::vector<float> out;
+	out.reserve(static_cast<size_t>(g - 1) * (g - 1) * 24);
+	for (uint32_t i = 0; i + 1 < g; ++i) {
+		for (uint32_t j = 0; j + 1 < g; ++j) {
+			Vector3 q[4] = { height(i, j), height(i + 1, j), height(i + 1, j + 1), height(i, j + 1) };
+			const int tris[2][3] = { {0, 1, 2}, {0, 2, 3} };
+			for (const int *t : tris) {
+				Vector3 a = q[t[0]], b = q[t[1]], c = q[t[2]];
+				Vector3 nrm = (b - a).cross(c - a).norm();
+				for (const Vector3& v : { nrm, a, b, c }) {
+					out.push_back(static_cast<float>(v.x));
+					out.push_back(static_cast<float>(v.y));
+					out.push_back(static_cast<float>(v.z));
+				}
+			}
+		}
+	}
+	return out;
+}
+
+/** Generate a sphere spoilt the ways real files are: collapsed and
+ * sliver triangles, duplicates, and missing or flipped normals.
+ * @param n Approximate number of facets
+ * @param seed Seed choosing which facets are spoilt
+ * @return 12 floats per facet in order: normal, v0, v1, v2
+*/
+std::vector<float> degenerate(uint32_t n, uint32_t seed)
+{
+	std::vector<float> out = sphere(n);
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> pick(0, 19);
+	for (size_t i = 12; i < out.size(); i += 12) {
+		float *f = &out[i];
+		switch (pick(gen)) {
+			case 0: // Collapsed to a point
+				memcpy(f + 6, f + 3, 3 * sizeof(float));
+				memcpy(f + 9, f + 3, 3 * sizeof(float));
+				break;
+			case 1: // Sliver, the last vertex on the first edge
+				for (int a = 0; a < 3; ++a) f[9 + a] = (f[3 + a] + f[6 + a]) / 2;
+				break;
+			case 2: // Duplicate of the previous facet
+				memcpy(f, f - 12, 12 * sizeof(float));
+				break;
+			case 3: // Missing normal
+				std::fill(f, f + 3, 0.f);
+				break;
+			case 4: // Flipped normal
+				for (int a = 0; a < 3; ++a) f[a] = -f[a];
+				break;
+		}
+	}
+	return out;
+}
+
+/** Statistics of repeated runs, in seconds.
+*/
+struct Timing {
+	double median;
+	double p95;
+};
+
+/** Time repeated runs of a stage after one untimed warm-up run.
+ * @param reps Number of timed runs
+ * @param f Stage to time
+ * @param setup Called untimed before each run, may be empty
+ * @return Median & 95th percentile
+*/
+Timing measure(int reps, const std::function<void()>& f, const std::function<void()>& setup = nullptr)
+{
+	std::vector<double> t;
+	for (int i = 0; i <= reps; ++i) {
+		if (setup) setup();
+		auto begin = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration<double> sec = std::chrono::steady_clock::now() - begin;
+		if (i > 0) t.push_back(sec.count());
+	}
+	std::sort(t.begin(), t.end());
+	size_t n = t.size();
+	double median = (n % 2 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2);
+	return { median, t[std::min(n - 1, static_cast<size_t>(std::ceil(0.95 * static_cast<double>(n))) - 1)] };
+}
+
+/** Print a line of results, throughput is based on the median.
+ * @param name Stage
+ * @param t Timing of one run
+ * @param bytes Bytes processed per run, 0 if it doesn't apply
+ * @param tris Triangles processed per run
+*/
+void report(const std::string& name, const Timing& t, double bytes, double tris)
+{
+	char mbs[32] = "-";
+	if (bytes > 0) snprintf(mbs, sizeof mbs, "%.1f", bytes / (1024.0 * 1024.0) / t.median);
+	printf("%-20s %10.2f %10.2f %10s %10.2f\n", name.c_str(), t.median * 1e3, t.p95 * 1e3, mbs, tris / t.median / 1e6);
+}
+
+/** Print why a stage was skipped if some run didn't read every facet.
+ * @param name Stage
+ * @param n Fewest facets read by a run
+ * @param want Facets in the file
+ * @return True if every run read them all
+*/
+bool check(const std::string& name, uint32_t n, uint32_t want)
+{
+	if (n == want) return true;
+	fprintf(stderr, "%s failed, read %u of %u facets\n", name.c_str(), n, want);
+	return false;
+}
+
+/** Time parsing a file with one of the loaders.
+ * @param name Stage
+ * @param f Filename
+ * @param l Loader
+ * @param want Facets in the file
+ * @param reps Number of timed runs
+ * @return False if some run didn't read the whole file
+*/
+bool parse(const std::string& name, const std::string& f, Solid::Loader l, uint32_t want, int reps)
+{
+	uint32_t n = want;
+	Timing t = measure(reps, [&] {
+		Solid s;
+		if (!s.parseFile(f, l)) n = 0;
+		n = std::min(n, s.size());
+	});
+	if (!check(name, n, want)) return false;
+	report(name, t, static_cast<double>(std::filesystem::file_size(f)), n);
+	return true;
+}
+
+/** Time what readFile() does on the CPU with an empty cache: parsing,
+ * checking normals, welding and building the levels of detail.
+ * @param f Filename
+ * @param want Facets in the file
+ * @param reps Number of timed runs
+ * @return False if some run didn't read the whole file
+*/
+bool load(const std::string& f, uint32_t want, int reps)
+{
+	uint32_t n = want;
+	Timing t = measure(reps, [&] {
+		Solid s;
+		s.setCache(false);
+		if (!s.load(f, Solid::Loader::PARALLEL)) n = 0;
+		n = std::min(n, s.size());
+	});
+	if (!check("load (no cache)", n, want)) return false;
+	report("load (no cache)", t, static_cast<double>(std::filesystem::file_size(f)), n);
+	return true;
+}
+
+/** Time computing the bounding box, oriented box and sphere with each
+ * instruction set.
+ * @param f Filename
+ * @param reps Number of timed runs
+*/
+void bounds(const std::string& f, int reps)
+{
+	Solid s;
+	if (!s.parseFile(f, Solid::Loader::MMAP)) return;
+	size_t n = static_cast<size_t>(s.size()) * 3;
+	Isa isa[] = { Isa::SCALAR, Isa::SSE, Isa::AVX2 };
+	Bounds first;
+	for (size_t k = 0; k < 3; ++k) {
+		if (isa[k] == Isa::AVX2 && bestIsa() != isa[k]) continue;
+		Bounds b;
+		Timing t = measure(reps, [&] { b.compute(s.getPositions(), n, isa[k]); });
+		report("bounds/" + std::string(isaName(isa[k])), t, static_cast<double>(n * 3 * sizeof(float)), s.size());
+		if (k == 0) first = b;
+		if (b.getRadius() != first.getRadius() || b.getBoxVolume() != first.getBoxVolume()) {
+			printf("bounds/%s disagrees with scalar\n", isaName(isa[k]));
+		}
+	}
+}
+
+/** Time the math kernels against Vector3: face normals from edge cross
+ * products, then moving every vertex one point at a time and in batches.
+ * @param f Filename
+ * @param reps Number of timed runs
+*/
+void math(const std::string& f, int reps)
+{
+	Solid s;
+	if (!s.parseFile(f, Solid::Loader::MMAP)) return;
+	uint32_t n = s.size();
+	size_t pts = static_cast<size_t>(n) * 3;
+	const float *p = s.getPositions();
+	std::vector<float> out(pts * 3), first;
+
+	Timing t = measure(reps, [&] {
+		for (uint32_t i = 0; i < n; ++i) {
+			const float *v = p + static_cast<size_t>(i) * 9;
+			Vector3 a(v[0], v[1], v[2]), b(v[3], v[4], v[5]), c(v[6], v[7], v[8]);
+			Vector3 x = (b - a).cross(c - a);
+			float *o = &out[i * 3];
+			o[0] = static_cast<float>(x.x);
+			o[1] = static_cast<float>(x.y);
+			o[2] = static_cast<float>(x.z);
+		}
+	});
+	report("cross/Vector3", t, 0, n);
+	t = measure(reps, [&] {
+		for (uint32_t i = 0; i < n; ++i) {
+			const float *v = p + static_cast<size_t>(i) * 9;
+			Vec3f a = Vec3f::load(v);
+			(Vec3f::load(v + 3) - a).cross(Vec3f::load(v + 6) - a).store(&out[i * 3]);
+		}
+	});
+	report("cross/Vec3f", t, 0, n);
+
+	Mat4 m = Mat4::rotation(Quat::axisAngle(Vector3(1, 2, 3), 0.5)) * Mat4::translation(1, -2, 3);
+	double bytes = static_cast<double>(pts * 3 * sizeof(float));
+	t = measure(reps, [&] {
+		for (size_t i = 0; i < pts; ++i) {
+			Vector3 q = m.apply(Vector3(p[i * 3], p[i * 3 + 1], p[i * 3 + 2]));
+			out[i * 3] = static_cast<float>(q.x);
+			out[i * 3 + 1] = static_cast<float>(q.y);
+			out[i * 3 + 2] = static_cast<float>(q.z);
+		}
+	});
+	report("transform/Vector3", t, bytes, n);
+
+	Isa isa[] = { Isa::SCALAR, Isa::SSE, Isa::AVX2 };
+	for (size_t k = 0; k < 3; ++k) {
+		if (isa[k] == Isa::AVX2 && bestIsa() != isa[k]) continue;
+		t = measure(reps, [&] { m.transform(p, out.data(), pts, isa[k]); });
+		report("transform/" + std::string(isaName(isa[k])), t, bytes, n);
+		if (k == 0) first = out;
+		else if (out != first) printf("transform/%s disagrees with scalar\n", isaName(isa[k]));
+	}
+}
+
+/** Time building the vertex arrays: welding, clustering and smooth
+ * normals.
+ * @param f Filename
+ * @param reps Number of timed runs
+*/
+void weld(const std::string& f, int reps)
+{
+	Solid parsed;
+	if (!parsed.parseFile(f, Solid::Loader::MMAP)) return;
+	Solid s;
+	Timing t = measure(reps, [&] { s.weld(); }, [&] { s = parsed; });
+	report("weld", t, 0, parsed.size());
+}
+
+/** Time the batch normal check against checking one triangle at a time.
+ * @param f Filename
+ * @param reps Number of timed runs
+*/
+void normals(const std::string& f, int reps)
+{
+	Solid s;
+	if (!s.parseFile(f, Solid::Loader::MMAP)) return;
+	uint32_t n = s.size();
+	std::vector<float> file(s.getNormals(), s.getNormals() + static_cast<size_t>(n) * 3);
+
+	uint32_t bad = 0;
+	Timing t = measure(reps, [&] {
+		bad = 0;
+		for (uint32_t i = 0; i < n; ++i) {
+			const float *q = &file[i * 3];
+			Triangle tri = s.getTriangle(i);
+			Triangle copy(tri.getVertex(0), tri.getVertex(1), tri.getVertex(2), Vector3(q[0], q[1], q[2]));
+			bad += !copy.valid();
+		}
+	});
+	report("normals/single", t, 0, n);
+
+	Normals check;
+	Isa isa[] = { Isa::SCALAR, Isa::SSE, Isa::AVX2 };
+	Normals::Stats first = {};
+	for (size_t k = 0; k < 3; ++k) {
+		if (isa[k] == Isa::AVX2 && bestIsa() != isa[k]) continue;
+		Normals::Stats st = {};
+		std::vector<float> out;
+		t = measure(reps, [&] { st = check.check(s.getPositions(), out.data(), n, true, isa[k]); }, [&] { out = file; });
+		report("normals/" + std::string(isaName(isa[k])), t, 0, n);
+		if (k == 0) first = st;
+		if (st.bad != first.bad || st.missing != first.missing || st.replaced != first.replaced) {
+			printf("normals/%s disagrees with scalar\n", isaName(isa[k]));
+		}
+	}
+}
+
+/** Time frames of a solid turning in front of the camera, either through
+ * OpenGL without a window or with the software rasterizer.
+ * @param f Filename
+ * @param w Width in pixels
+ * @param h Height in pixels
+ * @param gl True to render with OpenGL
+ * @param frames Number of timed frames
+*/
+void frames(const std::string& f, int w, int h, bool gl, int frames)
+{
+	std::string name = std::string(gl ? "gl " : "raster ") + std::to_string(w) + "x" + std::to_string(h);
+	Offscreen ctx;
+	if (gl && !ctx.init(w, h)) {
+		printf("%-20s unavailable\n", name.c_str());
+		return;
+	}
+
+	Solid s;
+	if (!s.parseFile(f, Solid::Loader::MMAP)) return;
+	s.weld();
+	if (gl) {
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_LIGHT0);
+		s.toggleLight();
+		s.upload();
+	}
+
+	Camera cam;
+	cam.setRatio(static_cast<double>(w) / h);
+	cam.setFov(45.f);
+	cam.frame(s);
+
+	Rasterizer r(gl ? 1 : w, gl ? 1 : h);
+	double step = 2 * PI / frames;
+	Timing t = measure(frames, [&] {
+		cam.rotateSolid(Quat::axisAngle(Vector3(0, 1, 0), step));
+		cam.clip(s);
+		if (gl) {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			cam.render(s);
+			glFinish();
+		} else {
+			r.render(s, cam, true);
+		}
+	});
+	report(name, t, 0, s.size());
+}
+
+/** Time closest-hit ray queries through the BVH against a linear scan.
+ * @param f Filename
+ * @param n Number of rays through the BVH
+*/
+void rays(const std::string& f, uint32_t n)
+{
+	Solid s;
+	if (!s.parseFile(f, Solid::Loader::MMAP)) return;
+
+	Bvh bvh;
+	auto begin = std::chrono::steady_clock::now();
+	bvh.build(s);
+	std::chrono::duration<double> build = std::chrono::steady_clock::now() - begin;
+	printf("%-20s %10.2f %10s %10s %10.2f %zu nodes\n", "bvh build", build.count() * 1e3, "-", "-", s.size() / build.count() / 1e6, bvh.nodeCount());
+
+	// Rays from around the solid towards points near its center
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<float> u(-1.f, 1.f);
+	Vector3 c = s.getCenter();
+	float r = static_cast<float>(s.getRadius());
+	std::vector<Bvh::Ray> ray(n);
+	for (Bvh::Ray& q : ray) {
+		for (int i = 0; i < 3; ++i) {
+			float at = static_cast<float>(i == 0 ? c.x : i == 1 ? c.y : c.z);
+			q.origin[i] = at + u(gen) * 3 * r;
+			q.dir[i] = at + u(gen) * r * 0.5f - q.origin[i];
+		}
+	}
+
+	Bvh::Hit h;
+	size_t hits = 0;
+	begin = std::chrono::steady_clock::now();
+	for (const Bvh::Ray& q : ray) hits += bvh.intersect(q, h);
+	std::chrono::duration<double> fast = std::chrono::steady_clock::now() - begin;
+
+	// The linear scan is far slower, so only run a sample
+	uint32_t m = std::max(1u, std::min(n, static_cast<uint32_t>(2e8 / std::max(1u, s.size()))));
+	uint32_t wrong = 0;
+	begin = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < m; ++i) {
+		Bvh::Hit a, b;
+		bool ha = bvh.intersectLinear(ray[i], a);
+		bool hb = bvh.intersect(ray[i], b);
+		if (ha != hb || (ha && a.t != b.t)) ++wrong;
+	}
+	std::chrono::duration<double> slow = std::chrono::steady_clock::now() - begin;
+	double fastRate = n / fast.count(), slowRate = m / (slow.count() - fast.count() * m / n);
+
+	printf("%-20s %10.2f Mray/s %9.1f%% hit\n", "rays/bvh", fastRate / 1e6, 100.0 * static_cast<double>(hits) / n);
+	printf("%-20s %10.4f Mray/s %9.0fx slower\n", "rays/linear", slowRate / 1e6, fastRate / slowRate);
+	if (wrong) printf("%u of %u rays disagree between bvh & linear\n", wrong, m);
+}
+
+/** Temporary files removed when going out of scope, named after the
+ * process so concurrent runs don't overwrite each other's.
+*/
+struct TempFiles {
+	std::string bin, txt, upper;
+
+	TempFiles()
+	{
+		std::filesystem::path dir = std::filesystem::temp_directory_path();
+		std::string id = std::to_string(getpid());
+		bin = (dir / ("bench_binary_" + id + ".stl")).string();
+		txt = (dir / ("bench_ascii_" + id + ".stl")).string();
+		upper = (dir / ("bench_upper_" + id + ".stl")).string();
+	}
+
+	~TempFiles()
+	{
+		std::error_code ec;
+		std::filesystem::remove(bin, ec);
+		std::filesystem::remove(txt, ec);
+		std::filesystem::remove(upper, ec);
+	}
+};
+
+/** Write a mesh to temporary files and time every stage on it.
+ * @param name Generator name
+ * @param r Records
+ * @param reps Number of timed runs per stage
+ * @return False if the files couldn't be written or read back
+*/
+bool suite(const std::string& name, const std::vector<float>& r, int reps)
+{
+	uint32_t n = static_cast<uint32_t>(r.size() / 12);
+	TempFiles tmp;
+	const std::string &bin = tmp.bin, &txt = tmp.txt, &upper = tmp.upper;
+	if (!writeBinary(bin, r) || !writeAscii(txt, r, false) || !writeAscii(upper, r, true)) {
+		fprintf(stderr, "Couldn't write benchmark files like %s\n", bin.c_str());
+		return false;
+	}
+
+	printf("\n%s, %u facets\n", name.c_str(), n);
+	printf("%-20s %10s %10s %10s %10s\n", "stage", "median ms", "p95 ms", "MB/s", "Mtri/s");
+	bool ok = parse("parse/stream", bin, Solid::Loader::STREAM, n, reps);
+	ok = parse("parse/mmap", bin, Solid::Loader::MMAP, n, reps) && ok;
+	ok = parse("parse/parallel", bin, Solid::Loader::PARALLEL, n, reps) && ok;
+	ok = parse("parse/ascii", txt, Solid::Loader::MMAP, n, reps) && ok;
+	ok = parse("parse/ascii upper", upper, Solid::Loader::MMAP, n, reps) && ok;
+	normals(bin, reps);
+	bounds(bin, reps);
+	math(bin, reps);
+	weld(bin, reps);
+	ok = load(bin, n, std::max(1, reps / 3)) && ok;
+	frames(bin, 1024, 576, true, reps * 3);
+	frames(bin, 1024, 576, false, reps * 3);
+	rays(bin, 1000000);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t n = 1000000;
+	uint32_t seed = 1;
+	int reps = REPEATS;
+	std::string gen = "all";
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		bool more = i + 1 < argc;
+		if (!arg.compare("-g") && more) gen = argv[++i];
+		else if (!arg.compare("-r") && more) reps = std::max(1, std::atoi(argv[++i]));
+		else if (!arg.compare("-s") && more) seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+		else if (!arg.compare("-h")) {
+			printf("Usage: %s [facets] [-g sphere|terrain|degenerate|all] [-r repeats] [-s seed]\n", argv[0]);
+			return 0;
+		}
+		else n = static_cast<uint32_t>(std::stoul(arg));
+	}
+
+	// Only the tables are printed, not what each load reports; errors
+	// and warnings still go to stderr
+	std::cout.setstate(std::ios::failbit);
+
+	printf("%u facets, %d runs per stage, seed %u, %s normals, %u threads\n", n, reps, seed,
+		isaName(bestIsa()), std::max(1u, std::thread::hardware_concurrency()));
+	bool ok = true;
+	if (gen == "all" || gen == "sphere") ok = suite("sphere", sphere(n), reps) && ok;
+	if (gen == "all" || gen == "terrain") ok = suite("terrain", terrain(n, seed), reps) && ok;
+	if (gen == "all" || gen == "degenerate") ok = suite("degenerate", degenerate(n, seed), reps) && ok;
+	return ok ? 0 : 1;
+}
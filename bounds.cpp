@@ -0,0 +1,606 @@
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include "bounds.hpp"
+#include "threadpool.hpp"
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+#ifdef HAVE_SSE
+#include <emmintrin.h>
+#endif
+#define GRAIN (1 << 16)		// Points per parallel chunk
+#define SWEEPS 32		// Most Jacobi sweeps when finding the principal axes
+#define SLACK 1e-6		// Relative rounding error allowed for in float passes
+
+namespace {
+
+/** Find the eigenvectors of a symmetric 3x3 matrix by Jacobi rotations.
+ * @param a Matrix, left with the eigenvalues on its diagonal
+ * @param v Set to the eigenvectors, one per column
+*/
+void eigen(double a[3][3], double v[3][3])
+{
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) v[i][j] = (i == j);
+	}
+	for (int sweep = 0; sweep < SWEEPS; ++sweep) {
+		double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+		if (off <= 1e-24 * diag || off == 0) break;
+
+		for (int p = 0; p < 2; ++p) {
+			for (int q = p + 1; q < 3; ++q) {
+				if (a[p][q] == 0) continue;
+
+				// Rotate the pair of axes so a[p][q] becomes 0
+				double theta = (a[q][q] - a[p][p]) / (2 * a[p][q]);
+				double t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+				double c = 1 / std::sqrt(t * t + 1), s = t * c;
+				for (int k = 0; k < 3; ++k) {
+					double kp = a[k][p], kq = a[k][q];
+					a[k][p] = c * kp - s * kq;
+					a[k][q] = s * kp + c * kq;
+				}
+				for (int k = 0; k < 3; ++k) {
+					double pk = a[p][k], qk = a[q][k];
+					a[p][k] = c * pk - s * qk;
+					a[q][k] = s * pk + c * qk;
+				}
+				for (int k = 0; k < 3; ++k) {
+					double kp = v[k][p], kq = v[k][q];
+					v[k][p] = c * kp - s * kq;
+					v[k][q] = s * kp + c * kq;
+				}
+			}
+		}
+	}
+}
+
+/** Grow a sphere just enough to contain another.
+ * @param c Center, updated
+ * @param r Radius, updated
+ * @param oc Other center
+ * @param orad Other radius
+*/
+void enclose(Vector3& c, double& r, const Vector3& oc, double orad)
+{
+	double d = (oc - c).mag();
+	if (d + orad <= r) return;
+	if (d + r <= orad) {
+		c = oc;
+		r = orad;
+		return;
+	}
+	double nr = (d + r + orad) / 2;
+	c = c + (oc - c) * ((nr - r) / d);
+	r = nr;
+}
+
+/** Extents of points along 3 axes, and the points at either end of the
+ * first one.
+*/
+struct Span {
+	float lo[3], hi[3];
+	size_t min, max;
+};
+
+/** Project points onto the axes one at a time. The vector versions below
+ * do exactly the same float operations, in the same order, and pick the
+ * same (first) points at either end.
+ * @param p Coordinates, 3 per point
+ * @param b First point
+ * @param e One past the last point
+ * @param a Axes, 3 floats each
+ * @param o Origin to project from
+ * @param s Grown to contain the points
+*/
+void spanScalar(const float *p, size_t b, size_t e, const float *a, const float *o, Span& s)
+{
+	for (size_t i = b; i < e; ++i) {
+		float x = p[i * 3] - o[0], y = p[i * 3 + 1] - o[1], z = p[i * 3 + 2] - o[2];
+		for (int j = 0; j < 3; ++j) {
+			float d = a[j * 3] * x + a[j * 3 + 1] * y + a[j * 3 + 2] * z;
+			if (d < s.lo[j]) {
+				s.lo[j] = d;
+				if (j == 0) s.min = i;
+			}
+			if (d > s.hi[j]) {
+				s.hi[j] = d;
+				if (j == 0) s.max = i;
+			}
+		}
+	}
+}
+
+/** Fold the lanes of a vector pass into the extents, the first point
+ * winning ties like it does one at a time.
+ * @param lo Lowest along each axis, w lanes per axis
+ * @param hi Highest along each axis, w lanes per axis
+ * @param min Lowest point along the first axis in each lane
+ * @param max Highest point along the first axis in each lane
+ * @param w Number of lanes
+ * @param s Grown to contain the lanes
+*/
+void fold(const float *lo, const float *hi, const size_t *min, const size_t *max, int w, Span& s)
+{
+	for (int l = 0; l < w; ++l) {
+		if (lo[l] < s.lo[0] || (lo[l] == s.lo[0] && min[l] < s.min)) {
+			s.lo[0] = lo[l];
+			s.min = min[l];
+		}
+		if (hi[l] > s.hi[0] || (hi[l] == s.hi[0] && max[l] < s.max)) {
+			s.hi[0] = hi[l];
+			s.max = max[l];
+		}
+		for (int j = 1; j < 3; ++j) {
+			s.lo[j] = std::min(s.lo[j], lo[j * w + l]);
+			s.hi[j] = std::max(s.hi[j], hi[j * w + l]);
+		}
+	}
+}
+
+/** Find the first point that may lie outside a sphere, one at a time.
+ * The vector versions below do exactly the same float operations.
+ * @param p Coordinates, 3 per point
+ * @param b First point
+ * @param e One past the last point
+ * @param c Center
+ * @param r2 Squared radius
+ * @return Index of the point, e if there's none
+*/
+size_t outsideScalar(const float *p, size_t b, size_t e, const float *c, float r2)
+{
+	for (size_t i = b; i < e; ++i) {
+		float x = p[i * 3] - c[0], y = p[i * 3 + 1] - c[1], z = p[i * 3 + 2] - c[2];
+		if (!(x * x + y * y + z * z <= r2)) return i;
+	}
+	return e;
+}
+
+#ifdef HAVE_SSE
+/** Load a coordinate of 4 points.
+*/
+inline __m128 load4(const float *q)
+{
+	return _mm_setr_ps(q[0], q[3], q[6], q[9]);
+}
+
+/** Project 4 points per iteration with SSE2.
+ * @return Index of the first point left for spanScalar()
+*/
+size_t spanSse(const float *p, size_t b, size_t e, const float *a, const float *o, Span& s)
+{
+	__m128 lo[3], hi[3];
+	alignas(16) float l[12], h[12];
+	size_t min[4] = { b, b, b, b }, max[4] = { b, b, b, b };
+	for (int j = 0; j < 3; ++j) {
+		lo[j] = _mm_set1_ps(s.lo[j]);
+		hi[j] = _mm_set1_ps(s.hi[j]);
+	}
+	size_t i = b;
+	for (; i + 4 <= e; i += 4) {
+		const float *q = p + i * 3;
+		__m128 x = _mm_sub_ps(load4(q), _mm_set1_ps(o[0]));
+		__m128 y = _mm_sub_ps(load4(q + 1), _mm_set1_ps(o[1]));
+		__m128 z = _mm_sub_ps(load4(q + 2), _mm_set1_ps(o[2]));
+		for (int j = 0; j < 3; ++j) {
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[j * 3]), x),
+				_mm_mul_ps(_mm_set1_ps(a[j * 3 + 1]), y)), _mm_mul_ps(_mm_set1_ps(a[j * 3 + 2]), z));
+			if (j == 0) {
+				int ml = _mm_movemask_ps(_mm_cmplt_ps(d, lo[0])), mh = _mm_movemask_ps(_mm_cmpgt_ps(d, hi[0]));
+				for (int k = 0; k < 4; ++k) {
+					if (ml >> k & 1) min[k] = i + k;
+					if (mh >> k & 1) max[k] = i + k;
+				}
+			}
+
+			// Operands in this order keep the old value if d is NaN
+			lo[j] = _mm_min_ps(d, lo[j]);
+			hi[j] = _mm_max_ps(d, hi[j]);
+		}
+	}
+	for (int j = 0; j < 3; ++j) {
+		_mm_store_ps(l + j * 4, lo[j]);
+		_mm_store_ps(h + j * 4, hi[j]);
+	}
+	fold(l, h, min, max, 4, s);
+	return i;
+}
+
+/** Find the first point that may lie outside a sphere, 4 at a time with
+ * SSE2.
+ * @return Index of the point, or of the first one left for outsideScalar()
+*/
+size_t outsideSse(const float *p, size_t b, size_t e, const float *c, float r2)
+{
+	size_t i = b;
+	for (; i + 4 <= e; i += 4) {
+		const float *q = p + i * 3;
+		__m128 x = _mm_sub_ps(load4(q), _mm_set1_ps(c[0]));
+		__m128 y = _mm_sub_ps(load4(q + 1), _mm_set1_ps(c[1]));
+		__m128 z = _mm_sub_ps(load4(q + 2), _mm_set1_ps(c[2]));
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		int m = _mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(r2)));
+		if (m == 0xf) continue;
+		for (int k = 0;; ++k) {
+			if (!(m >> k & 1)) return i + k;
+		}
+	}
+	return i;
+}
+#endif
+
+#ifdef HAVE_AVX2
+/** Project 8 points per iteration with AVX2, gathering the coordinates.
+ * @return Index of the first point left for spanScalar()
+*/
+__attribute__((target("avx2")))
+size_t spanAvx(const float *p, size_t b, size_t e, const float *a, const float *o, Span& s)
+{
+	const __m256i s3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	__m256 lo[3], hi[3];
+	alignas(32) float l[24], h[24];
+	size_t min[8], max[8];
+	std::fill(min, min + 8, b);
+	std::fill(max, max + 8, b);
+	for (int j = 0; j < 3; ++j) {
+		lo[j] = _mm256_set1_ps(s.lo[j]);
+		hi[j] = _mm256_set1_ps(s.hi[j]);
+	}
+	size_t i = b;
+	for (; i + 8 <= e; i += 8) {
+		const float *q = p + i * 3;
+		__m256 x = _mm256_sub_ps(_mm256_i32gather_ps(q, s3, 4), _mm256_set1_ps(o[0]));
+		__m256 y = _mm256_sub_ps(_mm256_i32gather_ps(q + 1, s3, 4), _mm256_set1_ps(o[1]));
+		__m256 z = _mm256_sub_ps(_mm256_i32gather_ps(q + 2, s3, 4), _mm256_set1_ps(o[2]));
+		for (int j = 0; j < 3; ++j) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[j * 3]), x),
+				_mm256_mul_ps(_mm256_set1_ps(a[j * 3 + 1]), y)), _mm256_mul_ps(_mm256_set1_ps(a[j * 3 + 2]), z));
+			if (j == 0) {
+				int ml = _mm256_movemask_ps(_mm256_cmp_ps(d, lo[0], _CMP_LT_OQ));
+				int mh = _mm256_movemask_ps(_mm256_cmp_ps(d, hi[0], _CMP_GT_OQ));
+				for (int k = 0; k < 8; ++k) {
+					if (ml >> k & 1) min[k] = i + k;
+					if (mh >> k & 1) max[k] = i + k;
+				}
+			}
+			lo[j] = _mm256_min_ps(d, lo[j]);
+			hi[j] = _mm256_max_ps(d, hi[j]);
+		}
+	}
+	for (int j = 0; j < 3; ++j) {
+		_mm256_store_ps(l + j * 8, lo[j]);
+		_mm256_store_ps(h + j * 8, hi[j]);
+	}
+	fold(l, h, min, max, 8, s);
+	return i;
+}
+
+/** Find the first point that may lie outside a sphere, 8 at a time with
+ * AVX2.
+ * @return Index of the point, or of the first one left for outsideScalar()
+*/
+__attribute__((target("avx2")))
+size_t outsideAvx(const float *p, size_t b, size_t e, const float *c, float r2)
+{
+	const __m256i s3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	size_t i = b;
+	for (; i + 8 <= e; i += 8) {
+		const float *q = p + i * 3;
+		__m256 x = _mm256_sub_ps(_mm256_i32gather_ps(q, s3, 4), _mm256_set1_ps(c[0]));
+		__m256 y = _mm256_sub_ps(_mm256_i32gather_ps(q + 1, s3, 4), _mm256_set1_ps(c[1]));
+		__m256 z = _mm256_sub_ps(_mm256_i32gather_ps(q + 2, s3, 4), _mm256_set1_ps(c[2]));
+		__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+		int m = _mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps(r2), _CMP_LE_OQ));
+		if (m == 0xff) continue;
+		for (int k = 0;; ++k) {
+			if (!(m >> k & 1)) return i + k;
+		}
+	}
+	return i;
+}
+#endif
+
+/** Find the axis-aligned box of a set of points on the shared thread pool.
+ * @param p Coordinates, 3 per point
+ * @param n Number of points, at least 1
+ * @param lower Lowered to the minimum of each coordinate
+ * @param upper Raised to the maximum of each coordinate
+*/
+void box(const float *p, size_t n, Vector3& lower, Vector3& upper)
+{
+	ThreadPool& pool = ThreadPool::shared();
+
+	// 4 points at a time in 12 lanes so it vectorizes
+	struct Box { float lo[3], hi[3]; };
+	std::vector<Box> part(pool.chunks(n, GRAIN));
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t k) {
+		float lo[12], hi[12];
+		for (int j = 0; j < 12; ++j) lo[j] = hi[j] = p[b * 3 + j % 3];
+		size_t i = b;
+		for (; i + 4 <= e; i += 4) {
+			const float *q = p + i * 3;
+			for (int j = 0; j < 12; ++j) {
+				lo[j] = (q[j] < lo[j] ? q[j] : lo[j]);
+				hi[j] = (q[j] > hi[j] ? q[j] : hi[j]);
+			}
+		}
+		for (; i < e; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				lo[j] = std::min(lo[j], p[i * 3 + j]);
+				hi[j] = std::max(hi[j], p[i * 3 + j]);
+			}
+		}
+		for (int j = 3; j < 12; ++j) {
+			lo[j % 3] = std::min(lo[j % 3], lo[j]);
+			hi[j % 3] = std::max(hi[j % 3], hi[j]);
+		}
+		std::copy(lo, lo + 3, part[k].lo);
+		std::copy(hi, hi + 3, part[k].hi);
+	}, GRAIN);
+	for (const Box& k : part) {
+		lower = Vector3(std::min<double>(lower.x, k.lo[0]), std::min<double>(lower.y, k.lo[1]), std::min<double>(lower.z, k.lo[2]));
+		upper = Vector3(std::max<double>(upper.x, k.hi[0]), std::max<double>(upper.y, k.hi[1]), std::max<double>(upper.z, k.hi[2]));
+	}
+}
+
+/** Project points onto the axes with the chosen instruction set.
+*/
+void span(const float *p, size_t b, size_t e, const float *a, const float *o, Span& s, Isa isa)
+{
+#ifdef HAVE_AVX2
+	if (isa == Isa::AVX2) b = spanAvx(p, b, e, a, o, s);
+#endif
+#ifdef HAVE_SSE
+	if (isa == Isa::SSE) b = spanSse(p, b, e, a, o, s);
+#endif
+	spanScalar(p, b, e, a, o, s);
+}
+
+/** Find the first point that may lie outside a sphere with the chosen
+ * instruction set.
+*/
+size_t outside(const float *p, size_t b, size_t e, const float *c, float r2, Isa isa)
+{
+#ifdef HAVE_AVX2
+	if (isa == Isa::AVX2) b = outsideAvx(p, b, e, c, r2);
+#endif
+#ifdef HAVE_SSE
+	if (isa == Isa::SSE) b = outsideSse(p, b, e, c, r2);
+#endif
+	return (b < e ? outsideScalar(p, b, e, c, r2) : e);
+}
+
+} // namespace
+
+Bounds::Bounds()
+: m_lower(std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity())
+, m_upper(-m_lower)
+, m_center()
+, m_radius(-1)
+, m_box()
+, m_axis{ Vector3(1, 0, 0), Vector3(0, 1, 0), Vector3(0, 0, 1) }
+, m_half{ 0, 0, 0 }
+{}
+
+void Bounds::compute(const float *p, size_t n, Isa isa)
+{
+	*this = Bounds();
+	if (!n) return;
+	ThreadPool& pool = ThreadPool::shared();
+	size_t chunks = pool.chunks(n, GRAIN);
+
+	// Axis-aligned box
+	box(p, n, m_lower, m_upper);
+
+	// Covariance about the box's center, which keeps the sums small
+	Vector3 mid = (m_lower + m_upper) / 2.0;
+	const double ref[3] = { mid.x, mid.y, mid.z };
+	struct Moments { double sum[3], sq[6]; };
+	std::vector<Moments> mom(chunks);
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t k) {
+		Moments m = {};
+		for (size_t i = b; i < e; ++i) {
+			double x = p[i * 3] - ref[0], y = p[i * 3 + 1] - ref[1], z = p[i * 3 + 2] - ref[2];
+			m.sum[0] += x;
+			m.sum[1] += y;
+			m.sum[2] += z;
+			m.sq[0] += x * x;
+			m.sq[1] += x * y;
+			m.sq[2] += x * z;
+			m.sq[3] += y * y;
+			m.sq[4] += y * z;
+			m.sq[5] += z * z;
+		}
+		mom[k] = m;
+	}, GRAIN);
+	Moments t = {};
+	for (const Moments& m : mom) {
+		for (int j = 0; j < 3; ++j) t.sum[j] += m.sum[j];
+		for (int j = 0; j < 6; ++j) t.sq[j] += m.sq[j];
+	}
+	double mean[3], cov[3][3], vec[3][3];
+	for (int j = 0; j < 3; ++j) mean[j] = t.sum[j] / static_cast<double>(n);
+	const int at[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) cov[i][j] = t.sq[at[i][j]] / static_cast<double>(n) - mean[i] * mean[j];
+	}
+	eigen(cov, vec);
+
+	// Main axis first, so its extremes seed the sphere
+	int order[3] = { 0, 1, 2 };
+	std::sort(order, order + 3, [&](int a, int b) { return cov[a][a] > cov[b][b]; });
+	for (int k = 0; k < 3; ++k) m_axis[k] = Vector3(vec[0][order[k]], vec[1][order[k]], vec[2][order[k]]).norm();
+	m_axis[2] = m_axis[0].cross(m_axis[1]).norm();
+	m_axis[1] = m_axis[2].cross(m_axis[0]);
+
+	// Extents along the axes, in float like the points
+	const float a[9] = {
+		static_cast<float>(m_axis[0].x), static_cast<float>(m_axis[0].y), static_cast<float>(m_axis[0].z),
+		static_cast<float>(m_axis[1].x), static_cast<float>(m_axis[1].y), static_cast<float>(m_axis[1].z),
+		static_cast<float>(m_axis[2].x), static_cast<float>(m_axis[2].y), static_cast<float>(m_axis[2].z)
+	};
+	const float o[3] = { static_cast<float>(ref[0]), static_cast<float>(ref[1]), static_cast<float>(ref[2]) };
+	if (isa == Isa::BEST) isa = bestIsa();
+	std::vector<Span> spans(chunks);
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t k) {
+		Span s;
+		std::fill(s.lo, s.lo + 3, std::numeric_limits<float>::infinity());
+		std::fill(s.hi, s.hi + 3, -std::numeric_limits<float>::infinity());
+		s.min = s.max = b;
+		span(p, b, e, a, o, s, isa);
+		spans[k] = s;
+	}, GRAIN);
+	Span all = spans[0];
+	for (const Span& s : spans) {
+		for (int j = 0; j < 3; ++j) {
+			if (s.lo[j] < all.lo[j]) {
+				all.lo[j] = s.lo[j];
+				if (j == 0) all.min = s.min;
+			}
+			if (s.hi[j] > all.hi[j]) {
+				all.hi[j] = s.hi[j];
+				if (j == 0) all.max = s.max;
+			}
+		}
+	}
+	Vector3 size = m_upper - m_lower;
+	double slack = size.mag() * SLACK;
+	m_box = mid;
+	for (int j = 0; j < 3; ++j) {
+		m_box += m_axis[j] * ((static_cast<double>(all.lo[j]) + all.hi[j]) / 2);
+		m_half[j] = (static_cast<double>(all.hi[j]) - all.lo[j]) / 2 + slack;
+	}
+	if (getBoxVolume() > size.x * size.y * size.z) alignBox();
+
+	// Ritter's sphere, each chunk grows its own copy which are merged
+	Vector3 from(p[all.min * 3], p[all.min * 3 + 1], p[all.min * 3 + 2]);
+	Vector3 to(p[all.max * 3], p[all.max * 3 + 1], p[all.max * 3 + 2]);
+	struct Sphere { Vector3 c; double r; };
+	std::vector<Sphere> sph(chunks, Sphere { (from + to) / 2.0, (to - from).mag() / 2 });
+	pool.parallelFor(n, [&](size_t b, size_t e, size_t k) {
+		Vector3 c = sph[k].c;
+		double r = sph[k].r, r2 = r * r;
+
+		// Points inside are skipped in float, against the radius less the
+		// center's rounding error, those left are checked exactly
+		float cf[3], in2;
+		auto shrink = [&] {
+			cf[0] = static_cast<float>(c.x);
+			cf[1] = static_cast<float>(c.y);
+			cf[2] = static_cast<float>(c.z);
+			double in = r - (c - Vector3(cf[0], cf[1], cf[2])).mag();
+			in2 = (in > 0 ? static_cast<float>(in * in) : 0);
+		};
+		shrink();
+		for (size_t i = outside(p, b, e, cf, in2, isa); i < e; i = outside(p, i + 1, e, cf, in2, isa)) {
+			Vector3 d = Vector3(p[i * 3], p[i * 3 + 1], p[i * 3 + 2]) - c;
+			double d2 = d.dot(d);
+			if (d2 <= r2) continue;
+			double len = std::sqrt(d2), nr = (r + len) / 2;
+			c += d * ((nr - r) / len);
+			r = nr;
+			r2 = r * r;
+			shrink();
+		}
+		sph[k] = Sphere { c, r };
+	}, GRAIN);
+	m_center = sph[0].c;
+	m_radius = sph[0].r;
+	for (const Sphere& s : sph) enclose(m_center, m_radius, s.c, s.r);
+
+	// Rounding, here or in skipping points, may leave a point a hair outside
+	m_radius *= 1 + 1e-6;
+
+	// Spheres around either box may still be smaller, e.g. for cubes
+	double aabb = size.mag() / 2, obb = Vector3(m_half[0], m_half[1], m_half[2]).mag();
+	if (aabb < m_radius) {
+		m_center = mid;
+		m_radius = aabb;
+	}
+	if (obb < m_radius) {
+		m_center = m_box;
+		m_radius = obb;
+	}
+}
+
+void Bounds::computeBox(const float *p, size_t n)
+{
+	*this = Bounds();
+	if (!n) return;
+	box(p, n, m_lower, m_upper);
+	alignBox();
+	m_center = m_box;
+	m_radius = (m_upper - m_lower).mag() / 2;
+}
+
+void Bounds::merge(const Bounds& o)
+{
+	if (o.empty()) return;
+	if (empty()) {
+		*this = o;
+		return;
+	}
+	m_lower = Vector3(std::min(m_lower.x, o.m_lower.x), std::min(m_lower.y, o.m_lower.y), std::min(m_lower.z, o.m_lower.z));
+	m_upper = Vector3(std::max(m_upper.x, o.m_upper.x), std::max(m_upper.y, o.m_upper.y), std::max(m_upper.z, o.m_upper.z));
+	enclose(m_center, m_radius, o.m_center, o.m_radius);
+	alignBox();
+
+	// The sphere around the merged box may be smaller
+	double aabb = (m_upper - m_lower).mag() / 2;
+	if (aabb < m_radius) {
+		m_center = m_box;
+		m_radius = aabb;
+	}
+}
+
+bool Bounds::empty() const
+{
+	return m_radius < 0;
+}
+
+Vector3 Bounds::getLower() const
+{
+	return (empty() ? Vector3() : m_lower);
+}
+
+Vector3 Bounds::getUpper() const
+{
+	return (empty() ? Vector3() : m_upper);
+}
+
+Vector3 Bounds::getCenter() const
+{
+	return m_center;
+}
+
+double Bounds::getRadius() const
+{
+	return std::max(m_radius, 0.0);
+}
+
+void Bounds::getCorners(Vector3 *c) const
+{
+	for (int i = 0; i < 8; ++i) {
+		c[i] = m_box;
+		for (int j = 0; j < 3; ++j) c[i] += m_axis[j] * (i >> j & 1 ? m_half[j] : -m_half[j]);
+	}
+}
+
+double Bounds::getBoxVolume() const
+{
+	return 8 * m_half[0] * m_half[1] * m_half[2];
+}
+
+void Bounds::alignBox()
+{
+	m_box = (m_lower + m_upper) / 2.0;
+	m_axis[0] = Vector3(1, 0, 0);
+	m_axis[1] = Vector3(0, 1, 0);
+	m_axis[2] = Vector3(0, 0, 1);
+	m_half[0] = (m_upper.x - m_lower.x) / 2;
+	m_half[1] = (m_upper.y - m_lower.y) / 2;
+	m_half[2] = (m_upper.z - m_lower.z) / 2;
+}
@@ -0,0 +1,89 @@
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+#include <cstddef>
+#include "vector3.hpp"
+#include "isa.hpp"
+
+class Bounds {
+public:
+	/** Create empty bounds, which contain nothing.
+	*/
+	Bounds();
+
+	/** Bound a set of points on the shared thread pool: an axis-aligned
+	 * box, a box oriented along the points' principal axes (PCA), and a
+	 * sphere grown from the extremes along the main axis (Ritter), which
+	 * is usually within a few percent of the smallest one.
+	 * @param p Coordinates, 3 per point
+	 * @param n Number of points
+	 * @param isa Instruction set for the passes over the points
+	*/
+	void compute(const float *, size_t, Isa = Isa::BEST);
+
+	/** Bound a set of points with just the axis-aligned box, e.g. a chunk
+	 * of a file being streamed. The sphere and the oriented box are the
+	 * ones around it, until compute() is run on all the points.
+	 * @param p Coordinates, 3 per point
+	 * @param n Number of points
+	*/
+	void computeBox(const float *, size_t);
+
+	/** Grow the bounds to contain others as well, e.g. those of the next
+	 * chunk of a file being streamed. The sphere contains both spheres,
+	 * or the merged box if that's smaller, and the oriented box becomes
+	 * the axis-aligned one.
+	 * @param o Other bounds
+	*/
+	void merge(const Bounds&);
+
+	/** Check if the bounds contain nothing.
+	 * @return True if no points have been bounded
+	*/
+	bool empty() const;
+
+	/** Get the smallest corner of the axis-aligned box.
+	 * @return Minimum of each coordinate
+	*/
+	Vector3 getLower() const;
+
+	/** Get the largest corner of the axis-aligned box.
+	 * @return Maximum of each coordinate
+	*/
+	Vector3 getUpper() const;
+
+	/** Get the center of the bounding sphere.
+	 * @return Center, the origin if empty
+	*/
+	Vector3 getCenter() const;
+
+	/** Get the radius of the bounding sphere.
+	 * @return Radius, 0 if empty
+	*/
+	double getRadius() const;
+
+	/** Get the corners of the oriented box.
+	 * @param c Set to 8 corners, all the same if empty
+	*/
+	void getCorners(Vector3 *) const;
+
+	/** Get the volume of the oriented box.
+	 * @return Volume, never more than the axis-aligned box's
+	*/
+	double getBoxVolume() const;
+
+private:
+	/** Fall back to the axis-aligned box as the oriented one.
+	*/
+	void alignBox();
+
+	// Instance variables
+	Vector3 m_lower;
+	Vector3 m_upper;
+	Vector3 m_center;	// Of the sphere
+	double m_radius;
+	Vector3 m_box;		// Center of the oriented box
+	Vector3 m_axis[3];	// Its unit axes
+	double m_half[3];	// Half its size along each axis
+};
+
+#endif
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include "bvh.hpp"
+#define BINS 12		// SAH candidate splits per axis + 1
+#define LEAF 8		// Largest leaf kept when splitting doesn't pay off
+#define DEPTH 48	// Depth after which nodes are split in half
+#define STACK 128	// Traversal stack size, > DEPTH + log2(triangles)
+
+namespace {
+
+const float kInf = std::numeric_limits<float>::infinity();
+
+/** Surface area of a box, up to a constant factor.
+*/
+inline float area(const float *lo, const float *hi)
+{
+	float x = hi[0] - lo[0], y = hi[1] - lo[1], z = hi[2] - lo[2];
+	return (x < 0 ? 0 : x * y + y * z + z * x);
+}
+
+/** Grow a box to contain another one.
+*/
+inline void grow(float *lo, float *hi, const float *blo, const float *bhi)
+{
+	for (int a = 0; a < 3; ++a) {
+		lo[a] = std::min(lo[a], blo[a]);
+		hi[a] = std::max(hi[a], bhi[a]);
+	}
+}
+
+} // namespace
+
+Bvh::Bvh()
+{}
+
+void Bvh::build(const Solid& s)
+{
+	m_nodes.clear();
+	m_index.clear();
+	m_tri.clear();
+
+	uint32_t n = s.size();
+	const float *pos = s.getPositions();
+	if (n == 0 || !pos) return;
+
+	// Triangle bounds & centroids
+	std::vector<float> box(static_cast<size_t>(n) * 6);
+	std::vector<float> mid(static_cast<size_t>(n) * 3);
+	for (size_t i = 0; i < n; ++i) {
+		const float *p = pos + i * 9;
+		float *b = &box[i * 6];
+		for (int a = 0; a < 3; ++a) {
+			b[a] = std::min({ p[a], p[3 + a], p[6 + a] });
+			b[3 + a] = std::max({ p[a], p[3 + a], p[6 + a] });
+			mid[i * 3 + a] = (b[a] + b[3 + a]) * 0.5f;
+		}
+	}
+
+	m_index.resize(n);
+	std::iota(m_index.begin(), m_index.end(), 0);
+	m_nodes.reserve(static_cast<size_t>(n) / 2 + 1);
+	m_nodes.push_back(Node());
+	split(0, 0, n, box, mid);
+
+	// Store triangles in leaf order so leaves read contiguous memory
+	m_tri.resize(static_cast<size_t>(n) * 9);
+	for (size_t k = 0; k < n; ++k) {
+		const float *p = pos + static_cast<size_t>(m_index[k]) * 9;
+		float *t = &m_tri[k * 9];
+		for (int a = 0; a < 3; ++a) {
+			t[a] = p[a];
+			t[3 + a] = p[3 + a] - p[a];
+			t[6 + a] = p[6 + a] - p[a];
+		}
+	}
+}
+
+void Bvh::split(uint32_t n, uint32_t b, uint32_t e, const std::vector<float>& box, const std::vector<float>& mid)
+{
+	static thread_local int depth = 0;
+
+	// Node & centroid bounds
+	float lo[3] = { kInf, kInf, kInf }, hi[3] = { -kInf, -kInf, -kInf };
+	float clo[3] = { kInf, kInf, kInf }, chi[3] = { -kInf, -kInf, -kInf };
+	for (uint32_t k = b; k < e; ++k) {
+		const float *t = &box[static_cast<size_t>(m_index[k]) * 6];
+		const float *c = &mid[static_cast<size_t>(m_index[k]) * 3];
+		grow(lo, hi, t, t + 3);
+		grow(clo, chi, c, c);
+	}
+
+	Node& node = m_nodes[n];
+	std::copy(lo, lo + 3, node.min);
+	std::copy(hi, hi + 3, node.max);
+	node.offset = b;
+	node.count = e - b;
+	if (e - b <= 2) return;
+
+	// Find the cheapest split among the bin boundaries of every axis
+	float best = kInf;
+	int axis = -1, cut = 0;
+	for (int a = 0; a < 3; ++a) {
+		float ext = chi[a] - clo[a];
+		if (ext <= 0) continue;
+
+		uint32_t cnt[BINS] = {};
+		float blo[BINS][3], bhi[BINS][3];
+		for (int i = 0; i < BINS; ++i) {
+			std::fill(blo[i], blo[i] + 3, kInf);
+			std::fill(bhi[i], bhi[i] + 3, -kInf);
+		}
+		for (uint32_t k = b; k < e; ++k) {
+			size_t t = m_index[k];
+			int i = std::min(BINS - 1, static_cast<int>((mid[t * 3 + a] - clo[a]) / ext * BINS));
+			++cnt[i];
+			grow(blo[i], bhi[i], &box[t * 6], &box[t * 6 + 3]);
+		}
+
+		// Sweep from the right, then evaluate from the left
+		float rarea[BINS];
+		uint32_t rcnt[BINS];
+		float rlo[3] = { kInf, kInf, kInf }, rhi[3] = { -kInf, -kInf, -kInf };
+		for (int i = BINS - 1, c = 0; i > 0; --i) {
+			grow(rlo, rhi, blo[i], bhi[i]);
+			c += static_cast<int>(cnt[i]);
+			rarea[i] = area(rlo, rhi);
+			rcnt[i] = static_cast<uint32_t>(c);
+		}
+
+		float llo[3] = { kInf, kInf, kInf }, lhi[3] = { -kInf, -kInf, -kInf };
+		uint32_t lcnt = 0;
+		for (int i = 1; i < BINS; ++i) {
+			grow(llo, lhi, blo[i - 1], bhi[i - 1]);
+			lcnt += cnt[i - 1];
+			if (lcnt == 0 || rcnt[i] == 0) continue;
+			float cost = area(llo, lhi) * static_cast<float>(lcnt) + rarea[i] * static_cast<float>(rcnt[i]);
+			if (cost < best) {
+				best = cost;
+				axis = a;
+				cut = i;
+			}
+		}
+	}
+
+	// Keep small leaves when splitting wouldn't save any work, counting a
+	// box test as about as expensive as a triangle test
+	uint32_t count = e - b;
+	float sa = area(lo, hi);
+	if (count <= LEAF && (axis < 0 || best + sa >= sa * static_cast<float>(count))) return;
+
+	uint32_t m = b;
+	if (axis >= 0 && depth < DEPTH) {
+		float ext = chi[axis] - clo[axis];
+		m = static_cast<uint32_t>(std::partition(m_index.begin() + b, m_index.begin() + e, [&](uint32_t t) {
+			return std::min(BINS - 1, static_cast<int>((mid[t * 3 + axis] - clo[axis]) / ext * BINS)) < cut;
+		}) - m_index.begin());
+	}
+
+	// Fall back to splitting in half along the widest axis
+	if (m == b || m == e) {
+		int a = 0;
+		for (int i = 1; i < 3; ++i) {
+			if (chi[i] - clo[i] > chi[a] - clo[a]) a = i;
+		}
+		m = b + count / 2;
+		std::nth_element(m_index.begin() + b, m_index.begin() + m, m_index.begin() + e, [&](uint32_t x, uint32_t y) {
+			return mid[x * 3 + a] < mid[y * 3 + a];
+		});
+	}
+
+	++depth;
+	uint32_t left = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back(Node());
+	split(left, b, m, box, mid);
+
+	uint32_t right = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back(Node());
+	split(right, m, e, box, mid);
+	--depth;
+
+	m_nodes[n].offset = right;
+	m_nodes[n].count = 0;
+}
+
+bool Bvh::hit(const Ray& r, uint32_t i, Hit& h) const
+{
+	const float *v0 = &m_tri[static_cast<size_t>(i) * 9];
+	const float *e1 = v0 + 3;
+	const float *e2 = v0 + 6;
+	const float *d = r.dir;
+
+	float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+	float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (det == 0) return false; // Parallel or degenerate, both sides count
+
+	float inv = 1.f / det;
+	float s[3] = { r.origin[0] - v0[0], r.origin[1] - v0[1], r.origin[2] - v0[2] };
+	float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+	if (u < 0 || u > 1) return false;
+
+	float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+	if (v < 0 || u + v > 1) return false;
+
+	float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+	if (t <= 0 || t >= h.t) return false;
+
+	h.triangle = m_index[i];
+	h.t = t;
+	h.u = u;
+	h.v = v;
+	return true;
+}
+
+bool Bvh::intersect(const Ray& r, Hit& h) const
+{
+	h.t = kInf;
+	if (m_nodes.empty()) return false;
+
+	float inv[3];
+	for (int a = 0; a < 3; ++a) inv[a] = 1.f / r.dir[a];
+
+	// Entry distance into a node's box, infinity on a miss
+	auto enter = [&](const Node& n) {
+		float t0 = 0, t1 = h.t;
+		for (int a = 0; a < 3; ++a) {
+			float x = (n.min[a] - r.origin[a]) * inv[a];
+			float y = (n.max[a] - r.origin[a]) * inv[a];
+			t0 = std::max(t0, std::min(x, y));
+			t1 = std::min(t1, std::max(x, y));
+		}
+		return (t0 <= t1 ? t0 : kInf);
+	};
+
+	bool found = false;
+	uint32_t stack[STACK];
+	int sp = 0;
+	uint32_t n = 0;
+	if (enter(m_nodes[0]) == kInf) return false;
+
+	while (true) {
+		const Node& node = m_nodes[n];
+		if (node.count) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+				if (hit(r, i, h)) found = true;
+			}
+			if (sp == 0) break;
+			n = stack[--sp];
+			continue;
+		}
+
+		// Visit the nearer child first, the other one later
+		uint32_t a = n + 1, b = node.offset;
+		float ta = enter(m_nodes[a]), tb = enter(m_nodes[b]);
+		if (ta > tb) {
+			std::swap(a, b);
+			std::swap(ta, tb);
+		}
+		if (ta == kInf) {
+			if (sp == 0) break;
+			n = stack[--sp];
+		} else {
+			n = a;
+			if (tb != kInf) stack[sp++] = b;
+		}
+	}
+	return found;
+}
+
+bool Bvh::intersectLinear(const Ray& r, Hit& h) const
+{
+	h.t = kInf;
+	bool found = false;
+	for (uint32_t i = 0; i < m_index.size(); ++i) {
+		if (hit(r, i, h)) found = true;
+	}
+	return found;
+}
+
+size_t Bvh::nodeCount() const
+{
+	return m_nodes.size();
+}
@@ -0,0 +1,83 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+#include <vector>
+#include <cstdint>
+#include "solid.hpp"
+
+class Bvh {
+public:
+	/** A ray, origin + t * dir for t > 0.
+	*/
+	struct Ray {
+		float origin[3];
+		float dir[3];
+	};
+
+	/** The closest intersection along a ray.
+	*/
+	struct Hit {
+		uint32_t triangle;	// Index into the solid's triangles
+		float t;		// Distance in units of the ray direction
+		float u, v;		// Barycentric coordinates of v1 & v2
+	};
+
+	Bvh();
+
+	/** Build the hierarchy over a solid's triangles using the surface
+	 * area heuristic. The solid isn't referenced afterwards.
+	 * @param s The solid
+	*/
+	void build(const Solid&);
+
+	/** Find the closest triangle a ray hits.
+	 * @param r The ray
+	 * @param h Where to store the hit
+	 * @return True if a triangle was hit
+	*/
+	bool intersect(const Ray&, Hit&) const;
+
+	/** Same as intersect() but tests every triangle, for comparison.
+	*/
+	bool intersectLinear(const Ray&, Hit&) const;
+
+	/** Get the number of nodes.
+	 * @return Node count, 0 if empty
+	*/
+	size_t nodeCount() const;
+
+private:
+	/** A node in depth-first order: the left child directly follows its
+	 * parent, the right child is at offset. Leaves (count > 0) hold the
+	 * triangles [offset, offset + count).
+	*/
+	struct Node {
+		float min[3];
+		uint32_t offset;
+		float max[3];
+		uint32_t count;
+	};
+
+	/** Recursively split triangles [b, e) under a node.
+	 * @param n Node index
+	 * @param b First triangle
+	 * @param e One past the last triangle
+	 * @param box Triangle bounds, 6 floats each
+	 * @param mid Triangle centroids, 3 floats each
+	*/
+	void split(uint32_t, uint32_t, uint32_t, const std::vector<float>&, const std::vector<float>&);
+
+	/** Test a ray against a triangle (Moller-Trumbore).
+	 * @param r The ray
+	 * @param i Triangle slot in m_tri
+	 * @param h Updated if the hit is closer than h.t
+	 * @return True if h was updated
+	*/
+	bool hit(const Ray&, uint32_t, Hit&) const;
+
+	// Instance variables
+	std::vector<Node> m_nodes;
+	std::vector<uint32_t> m_index;	// Triangle index per slot
+	std::vector<float> m_tri;	// v0, v1 - v0, v2 - v0 per slot
+};
+
+#endif
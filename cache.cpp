@@ -0,0 +1,141 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+#include <atomic>
+#include <unistd.h>
+#include "cache.hpp"
+#define CACHE_MAGIC "3DRCACHE"
+#define CACHE_VERSION 5	// Bump whenever the payload layout changes
+
+namespace fs = std::filesystem;
+
+Cache::Cache(std::string src, const std::vector<double>& keys)
+: m_src()
+, m_path()
+, m_keys(keys)
+, m_file()
+, m_offset(0)
+{
+	std::error_code ec;
+	m_src = fs::absolute(src, ec).lexically_normal().string();
+
+	fs::path dir;
+	const char *xdg = std::getenv("XDG_CACHE_HOME");
+	const char *home = std::getenv("HOME");
+	if (xdg && *xdg) dir = fs::path(xdg) / "3drender";
+	else if (home && *home) dir = fs::path(home) / ".cache" / "3drender";
+	else return;
+
+	// FNV-1a of the path names the entry, the header holds the full path
+	uint64_t h = 14695981039346656037ull;
+	for (char c : m_src) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << h << ".bin";
+	m_path = (dir / name.str()).string();
+}
+
+bool Cache::header(Header& h) const
+{
+	std::error_code ec;
+	uintmax_t size = fs::file_size(m_src, ec);
+	if (ec) return false;
+	fs::file_time_type time = fs::last_write_time(m_src, ec);
+	if (ec) return false;
+
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, CACHE_MAGIC, sizeof h.magic);
+	h.version = CACHE_VERSION;
+	h.order = 0x01020304;
+	h.size = size;
+	h.mtime = static_cast<int64_t>(time.time_since_epoch().count());
+	for (size_t i = 0; i < m_keys.size() && i < sizeof h.key / sizeof *h.key; ++i) h.key[i] = m_keys[i];
+	h.length = m_src.size();
+	return true;
+}
+
+bool Cache::open()
+{
+	m_file.close();
+	Header want;
+	if (m_path.empty() || !header(want)) return false;
+
+	std::error_code ec;
+	if (!fs::is_regular_file(m_path, ec) || !m_file.open(m_path)) return false;
+
+	// Everything must match, down to the source path
+	Header got;
+	size_t begin = sizeof got + want.length;
+	if (m_file.size() < begin) return false;
+	memcpy(&got, m_file.data(), sizeof got);
+	if (memcmp(&got, &want, sizeof got) || m_src.compare(0, m_src.size(), m_file.data() + sizeof got, want.length)) {
+		m_file.close();
+		return false;
+	}
+
+	m_offset = (begin + 7) / 8 * 8;
+	if (m_offset > m_file.size()) {
+		m_file.close();
+		return false;
+	}
+	return true;
+}
+
+const char *Cache::data() const
+{
+	return (m_file.data() ? m_file.data() + m_offset : nullptr);
+}
+
+size_t Cache::size() const
+{
+	return (m_file.data() ? m_file.size() - m_offset : 0);
+}
+
+bool Cache::write(const std::vector<Part>& parts) const
+{
+	Header h;
+	if (m_path.empty() || !header(h)) return false;
+
+	std::error_code ec;
+	fs::create_directories(fs::path(m_path).parent_path(), ec);
+
+	// Write next to the entry, then move it in place. The name is unique
+	// to this write, so other processes or threads caching the same file
+	// can't interleave with it.
+	static std::atomic<uint32_t> writes(0);
+	std::string tmp = m_path + "." + std::to_string(getpid()) + "." + std::to_string(writes++) + ".tmp";
+	{
+		std::ofstream os(tmp, std::ofstream::binary | std::ofstream::trunc);
+		os.write(reinterpret_cast<const char *>(&h), sizeof h);
+		os.write(m_src.data(), static_cast<std::streamsize>(m_src.size()));
+
+		// Payload starts 8-byte aligned
+		const char pad[8] = {};
+		os.write(pad, static_cast<std::streamsize>((8 - (sizeof h + m_src.size()) % 8) % 8));
+		for (const Part& p : parts) os.write(static_cast<const char *>(p.first), static_cast<std::streamsize>(p.second));
+
+		if (!os.good()) {
+			std::cerr << "Couldn't write cache " << std::quoted(tmp) << std::endl;
+			os.close();
+			fs::remove(tmp, ec);
+			return false;
+		}
+	}
+
+	fs::rename(tmp, m_path, ec);
+	if (ec) {
+		std::cerr << "Couldn't write cache " << std::quoted(m_path) << std::endl;
+		fs::remove(tmp, ec);
+		return false;
+	}
+	return true;
+}
+
+const std::string& Cache::getPath() const
+{
+	return m_path;
+}
@@ -0,0 +1,77 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "mappedfile.hpp"
+
+class Cache {
+public:
+	/** A piece of the payload to write: start and size in bytes.
+	*/
+	typedef std::pair<const void *, size_t> Part;
+
+	/** Locate the cache entry of a source file. Entries live in
+	 * `$XDG_CACHE_HOME/3drender`, or `~/.cache/3drender`.
+	 * @param src Source file
+	 * @param keys Settings the cached data depends on, e.g. weld
+	 * distance, at most 4 of them
+	*/
+	Cache(std::string, const std::vector<double>&);
+
+	/** Map the entry if it was written by this version for the source
+	 * file as it is now, i.e. same path, size, modification time & key.
+	 * @return True if the payload can be read
+	*/
+	bool open();
+
+	/** Get the payload of an open entry.
+	 * @return Start of the payload, nullptr if not open
+	*/
+	const char *data() const;
+
+	/** Get the size of the payload.
+	 * @return Size in bytes
+	*/
+	size_t size() const;
+
+	/** Write a new entry, replacing the old one atomically.
+	 * @param p Parts of the payload, written in order
+	 * @return True on success, false otherwise
+	*/
+	bool write(const std::vector<Part>&) const;
+
+	/** Get the entry's filename.
+	 * @return Path of the cache file, empty if there's nowhere to put it
+	*/
+	const std::string& getPath() const;
+
+private:
+	/** Fixed-size start of every entry.
+	*/
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t order;		// Detects files from machines of other endianness
+		uint64_t size;		// Source size
+		int64_t mtime;		// Source modification time
+		double key[4];		// Unused ones are 0
+		uint64_t length;	// Source path length, the path follows
+	};
+
+	/** Fill in the header for the source as it is now.
+	 * @param h Header to fill in
+	 * @return False if the source can't be found
+	*/
+	bool header(Header&) const;
+
+	// Instance variables
+	std::string m_src;	// Absolute source path
+	std::string m_path;
+	std::vector<double> m_keys;
+	MappedFile m_file;
+	size_t m_offset;	// Start of the payload
+};
+
+#endif
@@ -1,13 +1,20 @@
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <utility>
+#include <algorithm>
 #include <GL/glew.h>
 #include <GL/glu.h>
 #include <GL/freeglut.h>
 #include "camera.hpp"
+#include "profiler.hpp"
 #define PI 3.1415926535
 #define deg(x) (x * 180.f / PI)
 #define rad(x) (x * PI / 180.f)
+#define DRAG_BUDGET 250000	// Triangles drawn while the view is moving
+#define CLIP_MARGIN 0.01	// Fraction of the depth range added around it
+#define NEAR_RATIO 1e-4		// Closest the near plane gets, relative to the far plane
 
 Camera::Camera()
 : m_pos()
@@ -18,17 +25,23 @@ Camera::Camera()
 , m_far(1)
 , m_near(0)
 , m_persp(true)
-{
-	memset(m_mat, 0.0, sizeof(GLdouble) * 16);
-	m_mat[0] = 1;
-	m_mat[5] = 1;
-	m_mat[10] = 1;
-	m_mat[15] = 1;
-}
+, m_interactive(false)
+, m_stats()
+, m_visible()
+, m_lists()
+, m_transforms()
+, m_passes()
+, m_shown()
+, m_orient()
+, m_rot()
+, m_proj()
+, m_dirty(true)
+{}
 
 void Camera::setPos(Vector3 p)
 {
 	m_pos = p;
+	m_dirty = true;
 }
 
 Vector3 Camera::getPos() const
@@ -53,7 +66,7 @@ Vector3 Camera::getUp() const
 
 void Camera::setYaw(double a)
 {
-	m_dir = m_dir.rotate(0, a, 0);
+	m_dir = Quat::axisAngle(Vector3(0, 1, 0), a).rotate(m_dir);
 }
 
 double Camera::getYaw() const
@@ -63,7 +76,7 @@ double Camera::getYaw() const
 
 void Camera::setPitch(double a)
 {
-	m_dir = m_dir.rotate(a, 0, 0);
+	m_dir = Quat::axisAngle(Vector3(1, 0, 0), a).rotate(m_dir);
 }
 
 double Camera::getPitch() const
@@ -76,6 +89,7 @@ void Camera::setFov(double a)
 {
 	if (0.0 <= a && a <= 180.0) {
 		m_fov = a;
+		m_dirty = true;
 		setupProj();
 	}
 }
@@ -88,6 +102,7 @@ double Camera::getFov() const
 void Camera::setRatio(double r)
 {
 	m_ratio = r;
+	m_dirty = true;
 	setupProj();
 }
 
@@ -99,6 +114,7 @@ double Camera::getRatio() const
 void Camera::toggleProj()
 {
 	m_persp = !m_persp;
+	m_dirty = true;
 	setupProj();
 }
 
@@ -139,6 +155,7 @@ void Camera::setClipping(double f, double n)
 {
 	m_far = (f >= 0 ? f : m_far);
 	m_near = (n >= 0 ? n : m_near);
+	m_dirty = true;
 	setupProj();
 }
 
@@ -152,43 +169,304 @@ double Camera::getNearClip() const
 	return m_near;
 }
 
-void Camera::rotateSolid(Vector3 v, double w)
-{
-	Vector3 v2 = Vector3(v.x * v.x, v.y * v.y, v.z * v.z);
-	double xy = v.x * v.y;
-	double xz = v.x * v.z;
-	double yz = v.y * v.z;
-	double wx = w * v.x;
-	double wy = w * v.y;
-	double wz = w * v.z;
-
-	// Convert quaternion to rotation matrix
-	GLdouble q[16];
-	memset(q, 0.0, 16 * sizeof(GLdouble));
-	q[0] = 1 - 2 * v2.y - 2 * v2.z;
-	q[1] = 2 * xy + 2 * wz;
-	q[2] = 2 * xz - 2 * wy;
-
-	q[4] = 2 * xy - 2 * wz;
-	q[5] = 1 - 2 * v2.x - 2 * v2.z;
-	q[6] = 2 * yz + 2 * wx;
-
-	q[8] = 2 * xz + 2 * wy;
-	q[9] = 2 * yz - 2 * wx;
-	q[10] = 1 - 2 * v2.x - 2 * v2.y;
-
-	// Multiply previous and new matrices
-	GLdouble l[16];
-	memcpy(l, m_mat, 16 * sizeof(GLdouble));
-	m_mat[0] = l[0] * q[0] + l[1] * q[4] + l[2] * q[8];
-	m_mat[1] = l[0] * q[1] + l[1] * q[5] + l[2] * q[9];
-	m_mat[2] = l[0] * q[2] + l[1] * q[6] + l[2] * q[10];
-	m_mat[4] = l[4] * q[0] + l[5] * q[4] + l[6] * q[8];
-	m_mat[5] = l[4] * q[1] + l[5] * q[5] + l[6] * q[9];
-	m_mat[6] = l[4] * q[2] + l[5] * q[6] + l[6] * q[10];
-	m_mat[8] = l[8] * q[0] + l[9] * q[4] + l[10] * q[8];
-	m_mat[9] = l[8] * q[1] + l[9] * q[5] + l[10] * q[9];
-	m_mat[10] = l[8] * q[2] + l[9] * q[6] + l[10] * q[10];
+void Camera::frame(const Solid& s)
+{
+	fit(s.getRadius());
+}
+
+void Camera::frame(const Scene& s)
+{
+	fit(s.getRadius());
+}
+
+void Camera::fit(double r)
+{
+	// Radius of sphere bounding solid
+	if (r == std::numeric_limits<double>::infinity()) r = std::numeric_limits<double>::max();
+
+	// Distance from camera to center of the solid @ given FoV
+	double d = r / std::tan(rad(m_fov) / 2.f);
+
+	// Set position to view entire solid
+	setPos(m_dir * d);
+
+	// Set clipping that covers the entire sphere whichever way it turns
+	setDepth(d - r, d + r);
+}
+
+void Camera::rotateSolid(const Quat& q)
+{
+	// The new rotation is applied after the previous ones
+	m_orient = (q * m_orient).norm();
+	m_rot = Mat4::rotation(m_orient);
+}
+
+const Quat& Camera::getOrientation() const
+{
+	return m_orient;
+}
+
+Vector3 Camera::arcball(double x, double y, double r) const
+{
+	// Ray in world coordinates, the center of rotation is the origin
+	double o[3], d[3];
+	if (!unproject(Mat4(), x, y, o, d)) return Vector3();
+	Vector3 org(o[0], o[1], o[2]), dir = Vector3(d[0], d[1], d[2]).norm();
+
+	// Nearest hit, or the point of the ray closest to the center
+	double b = org.dot(dir), c = org.dot(org) - r * r, disc = b * b - c;
+	double t = (disc >= 0 ? -b - std::sqrt(disc) : -b);
+	Vector3 p = org + dir * t;
+	return (p == Vector3() ? p : p.norm());
+}
+
+namespace {
+
+/** Get the clip planes of a projection & model-view matrix, in the
+ * model's coordinates. A point is inside if all of a * p + d >= 0.
+*/
+void planes(const Mat4& m, double plane[6][4])
+{
+	for (int k = 0; k < 3; ++k) {
+		for (int j = 0; j < 4; ++j) {
+			plane[k * 2][j] = m[j * 4 + 3] + m[j * 4 + k];
+			plane[k * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + k];
+		}
+	}
+}
+
+/** Check if a box is entirely behind one of the clip planes.
+*/
+template<typename T>
+bool outside(const double plane[6][4], const T *min, const T *max)
+{
+	for (int p = 0; p < 6; ++p) {
+		const double *q = plane[p];
+		if (q[0] * (q[0] > 0 ? max[0] : min[0]) + q[1] * (q[1] > 0 ? max[1] : min[1])
+			+ q[2] * (q[2] > 0 ? max[2] : min[2]) + q[3] < 0) return true;
+	}
+	return false;
+}
+
+} // namespace
+
+void Camera::clip(const Solid& s)
+{
+	double n = std::numeric_limits<double>::infinity(), f = -n;
+	depth(s.getBounds(), modelView(s.getCenter()), n, f);
+	if (n <= f) setDepth(n, f);
+}
+
+void Camera::clip(const Scene& sc)
+{
+	Mat4 view = modelView(sc.getCenter());
+	double n = std::numeric_limits<double>::infinity(), f = -n;
+	for (const Scene::Instance& in : sc.getInstances()) {
+		const Solid& s = sc.getMesh(in.mesh);
+		if (!s.size()) continue;
+		depth(s.getBounds(), view * Mat4(in.transform), n, f);
+	}
+	if (n <= f) setDepth(n, f);
+}
+
+void Camera::depth(const Bounds& b, const Mat4& mv, double& n, double& f) const
+{
+	// Distance along the view direction, the camera looks at the origin
+	Vector3 dir = (-m_pos).norm(), c[8];
+	b.getCorners(c);
+	for (const Vector3& p : c) {
+		double d = (mv.apply(p) - m_pos).dot(dir);
+		n = std::min(n, d);
+		f = std::max(f, d);
+	}
+}
+
+void Camera::setDepth(double n, double f)
+{
+	// Keep the near plane off 0, where the depth buffer loses all precision
+	double pad = (f - n) * CLIP_MARGIN + std::abs(f) * 1e-6;
+	f += pad;
+	n = std::max(n - pad, f * NEAR_RATIO);
+	if (!(n < f)) return;
+	setClipping(f, n);
+}
+
+void Camera::getProjection(double *m) const
+{
+	projection().store(m);
+}
+
+Mat4 Camera::projection() const
+{
+	if (!m_dirty) return m_proj;
+
+	// Same matrices as gluPerspective/glOrtho & gluLookAt
+	double p[16] = {};
+	if (m_persp) {
+		double f = 1.0 / std::tan(rad(m_fov) / 2.0);
+		p[0] = f / m_ratio;
+		p[5] = f;
+		p[10] = (m_far + m_near) / (m_near - m_far);
+		p[11] = -1;
+		p[14] = 2 * m_far * m_near / (m_near - m_far);
+	} else {
+		double h = std::tan(rad(m_fov) / 2.f) * -m_pos.z;
+		double w = h * m_ratio;
+		p[0] = 1 / w;
+		p[5] = 1 / h;
+		p[10] = -2 / (m_far - m_near);
+		p[14] = -(m_far + m_near) / (m_far - m_near);
+		p[15] = 1;
+	}
+
+	Vector3 f = (-m_pos).norm(); // Looking at the origin
+	Vector3 r = f.cross(m_up).norm();
+	Vector3 u = r.cross(f);
+	double l[16] = {
+		r.x, u.x, -f.x, 0,
+		r.y, u.y, -f.y, 0,
+		r.z, u.z, -f.z, 0,
+		-r.dot(m_pos), -u.dot(m_pos), f.dot(m_pos), 1
+	};
+	m_proj = Mat4(p) * Mat4(l);
+	m_dirty = false;
+	return m_proj;
+}
+
+void Camera::getModelView(const Solid& s, double *m) const
+{
+	modelView(s.getCenter()).store(m);
+}
+
+void Camera::getModelView(const Scene& s, double *m) const
+{
+	modelView(s.getCenter()).store(m);
+}
+
+Mat4 Camera::modelView(Vector3 c) const
+{
+	return m_rot * Mat4::translation(-c.x, -c.y, -c.z);
+}
+
+bool Camera::unproject(const Solid& s, double x, double y, double *o, double *d) const
+{
+	return unproject(modelView(s.getCenter()), x, y, o, d);
+}
+
+bool Camera::unproject(const Scene& s, double x, double y, double *o, double *d) const
+{
+	return unproject(modelView(s.getCenter()), x, y, o, d);
+}
+
+bool Camera::unproject(const Mat4& mv, double x, double y, double *o, double *d) const
+{
+	Mat4 inv;
+	if (!(projection() * mv).invert(inv)) return false;
+
+	// Points on the near & far planes
+	double pt[2][3];
+	for (int k = 0; k < 2; ++k) {
+		double z = (k ? 1 : -1);
+		double w = inv[3] * x + inv[7] * y + inv[11] * z + inv[15];
+		if (w == 0) return false;
+		for (int i = 0; i < 3; ++i) {
+			pt[k][i] = (inv[i] * x + inv[4 + i] * y + inv[8 + i] * z + inv[12 + i]) / w;
+		}
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		o[i] = pt[0][i];
+		d[i] = pt[1][i] - pt[0][i];
+	}
+	return true;
+}
+
+const double *Camera::getRotation() const
+{
+	return m_rot.data();
+}
+
+void Camera::setInteractive(bool b)
+{
+	m_interactive = b;
+}
+
+void Camera::cull(const Solid& s, std::vector<uint32_t>& out) const
+{
+	m_stats = CullStats();
+	cull(s, modelView(s.getCenter()), out);
+}
+
+void Camera::cull(const Solid& s, const Mat4& mv, std::vector<uint32_t>& out) const
+{
+	// Clip planes in the solid's coordinates
+	double plane[6][4];
+	planes(projection() * mv, plane);
+
+	// Camera position, or direction for orthographic views, in the
+	// solid's coordinates
+	out.clear();
+	Mat4 inv;
+	if (!mv.invert(inv)) return;
+	Vector3 e = (m_persp ? m_pos : -m_pos.norm());
+	double w = (m_persp ? 1 : 0), eye[3], len = 0;
+	for (int i = 0; i < 3; ++i) {
+		eye[i] = inv[i] * e.x + inv[4 + i] * e.y + inv[8 + i] * e.z + inv[12 + i] * w;
+		len += eye[i] * eye[i];
+	}
+	if (!m_persp) {
+		for (double& v : eye) v /= std::sqrt(len);
+	}
+
+	const std::vector<Solid::Cluster>& cl = s.getClusters();
+	uint32_t drawn = 0;
+	for (uint32_t i = 0; i < cl.size(); ++i) {
+		const Solid::Cluster& k = cl[i];
+
+		// Outside if the box is entirely behind one plane
+		if (outside(plane, k.min, k.max)) {
+			++m_stats.outside;
+			continue;
+		}
+
+		// Facing away if every normal in the cone does, from anywhere
+		// in the cluster's bounding sphere
+		if (k.cutoff <= 1) {
+			double v[3], r = 0, len = 0, dot = 0;
+			for (int a = 0; a < 3; ++a) {
+				double mid = (k.min[a] + k.max[a]) / 2.0;
+				v[a] = (m_persp ? mid - eye[a] : eye[a]);
+				r += std::pow(k.max[a] - mid, 2);
+				len += v[a] * v[a];
+				dot += v[a] * k.axis[a];
+			}
+			bool away = (m_persp ? dot >= k.cutoff * std::sqrt(len) + std::sqrt(r) : dot >= k.cutoff);
+			if (away) {
+				++m_stats.facing;
+				continue;
+			}
+		}
+		out.push_back(i);
+		m_stats.triangles += k.count;
+		++drawn;
+	}
+	m_stats.drawn += drawn;
+}
+
+bool Camera::inView(const Solid& s, const Mat4& mv) const
+{
+	double plane[6][4];
+	planes(projection() * mv, plane);
+
+	Vector3 c = s.getCenter();
+	double r = s.getRadius();
+	double min[3] = { c.x - r, c.y - r, c.z - r }, max[3] = { c.x + r, c.y + r, c.z + r };
+	return !outside(plane, min, max);
+}
+
+const Camera::CullStats& Camera::getCullStats() const
+{
+	return m_stats;
 }
 
 void Camera::render(const Solid& s) const
@@ -201,11 +479,106 @@ void Camera::render(const Solid& s) const
 
 	// Model transformations
 	Vector3 c = s.getCenter();
-	glMultMatrixd(m_mat);
+	glMultMatrixd(m_rot.data());
 	glTranslated(-c.x, -c.y, -c.z);
 
-	// Drawing
-	glCallList(s.getList());
+	// Drawing, the levels of detail share the solid's center
+	const Solid& d = (m_interactive ? s.getLod(DRAG_BUDGET) : s);
+	{
+		Profiler::Scope p("cull");
+		cull(d, m_visible);
+	}
+	{
+		Profiler::Scope p("draw");
+		d.draw(m_visible);
+	}
+	Profiler::shared().counter("triangles", m_stats.triangles);
+	Profiler::shared().counter("clusters", m_stats.drawn);
+
+	glPopMatrix();
+}
+
+void Camera::render(const Scene& sc) const
+{
+	glPushMatrix();
+
+	// Position lights
+	GLfloat pos[] = { 0, 0, -1, 0 };
+	glLightfv(GL_LIGHT0, GL_POSITION, pos);
+
+	// Scene transformations, instances add their own
+	Mat4 view = modelView(sc.getCenter());
+	glMultMatrixd(view.data());
+
+	// Cull every instance first, so each stage is timed once per frame
+	m_stats = CullStats();
+	m_passes.clear();
+	m_transforms.clear();
+	{
+		Profiler::Scope p("cull");
+		const std::vector<Scene::Instance>& inst = sc.getInstances();
+		m_shown.clear();
+		for (const Scene::Instance& in : inst) m_shown.push_back(&in);
+		std::stable_sort(m_shown.begin(), m_shown.end(),
+			[](const Scene::Instance *a, const Scene::Instance *b) { return a->mesh < b->mesh; });
+
+		uint32_t lists = 0;
+		uint64_t total = std::max<uint64_t>(sc.size(), 1);
+		for (size_t b = 0, e = 0; b < m_shown.size(); b = e) {
+			const Solid& s = sc.getMesh(m_shown[b]->mesh);
+			for (e = b + 1; e < m_shown.size() && m_shown[e]->mesh == m_shown[b]->mesh; ++e);
+			if (!s.size()) continue;
+
+			// While dragging each mesh gets its share of the budget
+			uint32_t share = static_cast<uint32_t>(DRAG_BUDGET * static_cast<uint64_t>(s.size()) / total);
+			const Solid& d = (m_interactive ? s.getLod(std::max(share, 1u)) : s);
+			uint32_t clusters = static_cast<uint32_t>(d.getClusters().size());
+
+			// Drop whole instances outside the view
+			size_t k = b;
+			for (size_t i = b; i < e; ++i) {
+				if (inView(d, view * Mat4(m_shown[i]->transform))) m_shown[k++] = m_shown[i];
+				else m_stats.outside += clusters;
+			}
+			uint32_t n = static_cast<uint32_t>(k - b);
+
+			// A single instance is cheaper culled cluster by cluster
+			if (n > 1 && sc.canInstance()) {
+				m_passes.push_back({ &d, nullptr, static_cast<uint32_t>(m_transforms.size() / 16), n });
+				for (size_t i = b; i < k; ++i) {
+					const double *t = m_shown[i]->transform;
+					for (int j = 0; j < 16; ++j) m_transforms.push_back(static_cast<float>(t[j]));
+				}
+				m_stats.drawn += clusters * n;
+				m_stats.triangles += d.size() * n;
+				continue;
+			}
+			for (size_t i = b; i < k; ++i) {
+				if (m_lists.size() <= lists) m_lists.emplace_back();
+				cull(d, view * Mat4(m_shown[i]->transform), m_lists[lists]);
+				m_passes.push_back({ &d, m_shown[i]->transform, lists++, 1 });
+			}
+		}
+	}
+
+	{
+		// Scaled instances would scale their normals too
+		Profiler::Scope p("draw");
+		glEnable(GL_RESCALE_NORMAL);
+		for (const Pass& ps : m_passes) {
+			if (!ps.transform) {
+				sc.drawInstanced(*ps.solid, &m_transforms[ps.first * 16], ps.count);
+				continue;
+			}
+			glPushMatrix();
+			glMultMatrixd(ps.transform);
+			ps.solid->draw(m_lists[ps.first]);
+			glPopMatrix();
+		}
+		glDisable(GL_RESCALE_NORMAL);
+	}
+	Profiler::shared().counter("triangles", m_stats.triangles);
+	Profiler::shared().counter("clusters", m_stats.drawn);
 
 	glPopMatrix();
 }
@@ -1,10 +1,24 @@
 #ifndef CAMERA_HPP
 #define CAMERA_HPP
+#include <vector>
+#include <cstdint>
 #include "solid.hpp"
+#include "scene.hpp"
+#include "bounds.hpp"
+#include "mat4.hpp"
 #include "vector3.hpp"
 
 class Camera {
 public:
+	/** What happened to a solid's clusters in the last render().
+	*/
+	struct CullStats {
+		uint32_t drawn;
+		uint32_t outside;	// Outside the view frustum
+		uint32_t facing;	// Facing away from the camera
+		uint32_t triangles;	// In the drawn clusters
+	};
+
 	Camera();
 
 	/** Change the camera's position.
@@ -106,18 +120,192 @@ public:
 	*/
 	double getNearClip() const;
 
-	/** Rotate the solid being viewed using quaternions.
-	 * @param v Vector of rotation
-	 * @param w 4D component
+	/** Move the camera back along its direction so a solid fills the view
+	 * at the current FoV, and set clipping planes that cover it.
+	 * @param s The solid to be framed
+	*/
+	void frame(const Solid&);
+
+	/** Frame every instance in a scene.
+	 * @param s The scene to be framed
+	*/
+	void frame(const Scene&);
+
+	/** Fit the clipping planes to a solid's oriented box as it is seen
+	 * right now, to keep as much depth precision as possible. Call it
+	 * before render() whenever the view changes.
+	 * @param s The solid being rendered
+	*/
+	void clip(const Solid&);
+
+	/** Fit the clipping planes around every instance in a scene.
+	 * @param s The scene being rendered
+	*/
+	void clip(const Scene&);
+
+	/** Rotate the solid being viewed, after its current rotation. The
+	 * orientation is kept as a unit quaternion, renormalized each time so
+	 * rounding errors can't skew it however long the session.
+	 * @param q Unit quaternion
+	*/
+	void rotateSolid(const Quat&);
+
+	/** Get the orientation of the solid.
+	 * @return Unit quaternion
+	*/
+	const Quat& getOrientation() const;
+
+	/** Find where the ray through a point on the screen meets a sphere
+	 * around the center of rotation, in world coordinates. Dragging from
+	 * one such point to another turns the solid like a trackball.
+	 * @param x Horizontal position in [-1, 1], left to right
+	 * @param y Vertical position in [-1, 1], bottom to top
+	 * @param r Radius of the sphere
+	 * @return Unit vector to the nearest hit, or towards the closest point
+	 * of the ray if it misses; zero if the matrices can't be inverted
+	*/
+	Vector3 arcball(double, double, double) const;
+
+	/** Get the projection matrix setupProj() loads, which includes the
+	 * viewing transformation.
+	 * @param m Column-major 4x4 matrix to write to
+	*/
+	void getProjection(double *) const;
+
+	/** Get the model-view matrix render() uses for a solid.
+	 * @param s The solid being rendered
+	 * @param m Column-major 4x4 matrix to write to
+	*/
+	void getModelView(const Solid&, double *) const;
+
+	/** Get the model-view matrix render() uses for a scene, to which
+	 * each instance's transform is appended.
+	 * @param s The scene being rendered
+	 * @param m Column-major 4x4 matrix to write to
+	*/
+	void getModelView(const Scene&, double *) const;
+
+	/** Turn a point on the screen into a ray in the solid's coordinates.
+	 * @param s The solid being rendered
+	 * @param x Horizontal position in [-1, 1], left to right
+	 * @param y Vertical position in [-1, 1], bottom to top
+	 * @param o Where to write the ray's origin, on the near plane
+	 * @param d Where to write the ray's direction, reaching the far plane
+	 * @return False if the matrices can't be inverted
+	*/
+	bool unproject(const Solid&, double, double, double *, double *) const;
+
+	/** Turn a point on the screen into a ray in scene coordinates.
+	 * @param s The scene being rendered
+	 * @param x Horizontal position in [-1, 1], left to right
+	 * @param y Vertical position in [-1, 1], bottom to top
+	 * @param o Where to write the ray's origin, on the near plane
+	 * @param d Where to write the ray's direction, reaching the far plane
+	 * @return False if the matrices can't be inverted
+	*/
+	bool unproject(const Scene&, double, double, double *, double *) const;
+
+	/** Get the accumulated rotation of the solid.
+	 * @return Column-major 4x4 matrix
 	*/
-	void rotateSolid(Vector3, double);
+	const double *getRotation() const;
+
+	/** Set whether the view is being moved. While it is, a coarser
+	 * level of detail is rendered to keep up with input.
+	 * @param b True while the user is dragging
+	*/
+	void setInteractive(bool);
+
+	/** Find the clusters of a solid that may be visible, skipping those
+	 * outside the view and those whose triangles all face away.
+	 * @param s The solid
+	 * @param out Overwritten with visible cluster indices in order
+	*/
+	void cull(const Solid&, std::vector<uint32_t>&) const;
+
+	/** Get the culling counters of the last render().
+	 * @return Cluster counts
+	*/
+	const CullStats& getCullStats() const;
 
 	/** Render the current scene the camera sees.
 	 * @param s The solid to be rendered
 	*/
 	void render(const Solid&) const;
 
+	/** Render every instance of a scene. Meshes placed more than once are
+	 * drawn with one instanced call when the driver allows, otherwise
+	 * each instance's clusters are culled & drawn like a single solid.
+	 * @param s The scene to be rendered
+	*/
+	void render(const Scene&) const;
+
 private:
+	/** A mesh drawn by render(const Scene&).
+	*/
+	struct Pass {
+		const Solid *solid;
+		const double *transform;	// Instance transform, nullptr if instanced
+		uint32_t first;		// Cluster list, or first transform if instanced
+		uint32_t count;		// Number of instances
+	};
+
+	/** Move back far enough to see a sphere and clip around it.
+	 * @param r Radius of the sphere, centered at the origin
+	*/
+	void fit(double);
+
+	/** Extend a range of distances from the camera to cover a box.
+	 * @param b Bounds whose oriented box is used
+	 * @param mv Model-view matrix placing the box
+	 * @param n Nearest distance, updated
+	 * @param f Farthest distance, updated
+	*/
+	void depth(const Bounds&, const Mat4&, double&, double&) const;
+
+	/** Set the clipping planes to a range of distances, with a margin.
+	 * @param n Nearest distance to keep
+	 * @param f Farthest distance to keep
+	*/
+	void setDepth(double, double);
+
+	/** Get the projection matrix, including the viewing transformation,
+	 * only computed again after the camera changes.
+	 * @return Projection matrix
+	*/
+	Mat4 projection() const;
+
+	/** Get the model-view matrix for a given center of rotation.
+	 * @param c Point moved to the origin
+	 * @return Model-view matrix
+	*/
+	Mat4 modelView(Vector3) const;
+
+	/** Turn a point on the screen into a ray through a model-view matrix.
+	 * @param mv Model-view matrix
+	 * @param x Horizontal position in [-1, 1]
+	 * @param y Vertical position in [-1, 1]
+	 * @param o Where to write the ray's origin
+	 * @param d Where to write the ray's direction
+	 * @return False if the matrices can't be inverted
+	*/
+	bool unproject(const Mat4&, double, double, double *, double *) const;
+
+	/** Find the visible clusters of a solid drawn with a given model-view
+	 * matrix, adding to the culling counters.
+	 * @param s The solid
+	 * @param mv Model-view matrix
+	 * @param out Overwritten with visible cluster indices in order
+	*/
+	void cull(const Solid&, const Mat4&, std::vector<uint32_t>&) const;
+
+	/** Check if any of a solid's bounding sphere may be in view.
+	 * @param s The solid
+	 * @param mv Model-view matrix
+	 * @return False if it's entirely outside the view frustum
+	*/
+	bool inView(const Solid&, const Mat4&) const;
+
 	Vector3 m_pos;		// Camera position
 	Vector3 m_dir; 		// Direction the camera is facing
 	Vector3 m_up; 		// Vector pointing "up"
@@ -126,7 +314,17 @@ private:
 	double m_far;		// Far clipping plane
 	double m_near;		// Near clipping plane
 	bool m_persp;		// Projection type toggle
-	GLdouble m_mat[16]; // Rotation matrix
+	bool m_interactive;	// Draw a coarse level of detail
+	mutable CullStats m_stats;
+	mutable std::vector<uint32_t> m_visible;
+	mutable std::vector<std::vector<uint32_t>> m_lists;	// Visible clusters per instance
+	mutable std::vector<float> m_transforms;	// Instanced transforms, 16 each
+	mutable std::vector<Pass> m_passes;
+	mutable std::vector<const Scene::Instance *> m_shown;	// Instances by mesh
+	Quat m_orient;		// Rotation of the solid
+	Mat4 m_rot;		// The same as a matrix
+	mutable Mat4 m_proj;	// Cached projection()
+	mutable bool m_dirty;	// m_proj needs updating
 };
 
 #endif
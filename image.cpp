@@ -0,0 +1,124 @@
+#include <fstream>
+#include <algorithm>
+#include <zlib.h>
+#include "image.hpp"
+
+Image::Image()
+: m_width(0)
+, m_height(0)
+{}
+
+Image::Image(int w, int h)
+: m_width(std::max(w, 0))
+, m_height(std::max(h, 0))
+, m_pixels(static_cast<size_t>(m_width) * static_cast<size_t>(m_height) * 3, 0)
+{}
+
+int Image::getWidth() const
+{
+	return m_width;
+}
+
+int Image::getHeight() const
+{
+	return m_height;
+}
+
+uint8_t *Image::data()
+{
+	return m_pixels.data();
+}
+
+const uint8_t *Image::data() const
+{
+	return m_pixels.data();
+}
+
+void Image::flip()
+{
+	size_t row = static_cast<size_t>(m_width) * 3;
+	for (int y = 0; y < m_height / 2; ++y) {
+		uint8_t *a = &m_pixels[static_cast<size_t>(y) * row];
+		uint8_t *b = &m_pixels[static_cast<size_t>(m_height - 1 - y) * row];
+		std::swap_ranges(a, a + row, b);
+	}
+}
+
+bool Image::writePPM(std::string f) const
+{
+	std::ofstream os(f, std::ofstream::binary);
+	os << "P6\n" << m_width << " " << m_height << "\n255\n";
+	os.write((const char *) m_pixels.data(), static_cast<std::streamsize>(m_pixels.size()));
+	return os.good();
+}
+
+namespace {
+
+/** Append a big-endian 32-bit integer.
+*/
+void put32(std::vector<uint8_t>& v, uint32_t x)
+{
+	v.push_back(static_cast<uint8_t>(x >> 24));
+	v.push_back(static_cast<uint8_t>(x >> 16));
+	v.push_back(static_cast<uint8_t>(x >> 8));
+	v.push_back(static_cast<uint8_t>(x));
+}
+
+/** Write a PNG chunk: length, type, data and CRC of type + data.
+*/
+void chunk(std::ofstream& os, const char *type, const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> head;
+	put32(head, static_cast<uint32_t>(data.size()));
+	head.insert(head.end(), type, type + 4);
+
+	uLong crc = crc32(0L, head.data() + 4, 4);
+	crc = crc32(crc, data.data(), static_cast<uInt>(data.size()));
+
+	std::vector<uint8_t> tail;
+	put32(tail, static_cast<uint32_t>(crc));
+
+	os.write((const char *) head.data(), 8);
+	os.write((const char *) data.data(), static_cast<std::streamsize>(data.size()));
+	os.write((const char *) tail.data(), 4);
+}
+
+} // namespace
+
+bool Image::writePNG(std::string f) const
+{
+	// Every row is prefixed with filter type 0 (none)
+	size_t row = static_cast<size_t>(m_width) * 3;
+	std::vector<uint8_t> raw;
+	raw.reserve((row + 1) * static_cast<size_t>(m_height));
+	for (int y = 0; y < m_height; ++y) {
+		raw.push_back(0);
+		const uint8_t *p = &m_pixels[static_cast<size_t>(y) * row];
+		raw.insert(raw.end(), p, p + row);
+	}
+
+	uLongf len = compressBound(static_cast<uLong>(raw.size()));
+	std::vector<uint8_t> idat(len);
+	if (compress2(idat.data(), &len, raw.data(), static_cast<uLong>(raw.size()), 6) != Z_OK) return false;
+	idat.resize(len);
+
+	// Header: size, 8-bit depth, color type 2 (RGB), no interlacing
+	std::vector<uint8_t> ihdr;
+	put32(ihdr, static_cast<uint32_t>(m_width));
+	put32(ihdr, static_cast<uint32_t>(m_height));
+	ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 });
+
+	std::ofstream os(f, std::ofstream::binary);
+	os.write("\x89PNG\r\n\x1a\n", 8);
+	chunk(os, "IHDR", ihdr);
+	chunk(os, "IDAT", idat);
+	chunk(os, "IEND", {});
+	return os.good();
+}
+
+bool Image::write(std::string f) const
+{
+	std::string ext = f.substr(f.find_last_of('.') + 1);
+	if (!ext.compare("ppm") || !ext.compare("PPM")) return writePPM(f);
+	return writePNG(f);
+}
@@ -0,0 +1,57 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class Image {
+public:
+	Image();
+	Image(int, int);
+
+	/** Get the image width.
+	 * @return Width in pixels
+	*/
+	int getWidth() const;
+
+	/** Get the image height.
+	 * @return Height in pixels
+	*/
+	int getHeight() const;
+
+	/** Get the pixel data, 8-bit RGB rows from top to bottom.
+	 * @return Pointer to the first pixel
+	*/
+	uint8_t *data();
+	const uint8_t *data() const;
+
+	/** Flip the rows, e.g. after reading from OpenGL which is bottom-up.
+	*/
+	void flip();
+
+	/** Write the image as a binary PPM (P6) file.
+	 * @param f Filename
+	 * @return True on success, false otherwise
+	*/
+	bool writePPM(std::string) const;
+
+	/** Write the image as a PNG file.
+	 * @param f Filename
+	 * @return True on success, false otherwise
+	*/
+	bool writePNG(std::string) const;
+
+	/** Write the image, choosing the format from the file extension.
+	 * @param f Filename ending in `.png` or `.ppm`
+	 * @return True on success, false otherwise
+	*/
+	bool write(std::string) const;
+
+private:
+	// Instance variables
+	int m_width;
+	int m_height;
+	std::vector<uint8_t> m_pixels;
+};
+
+#endif
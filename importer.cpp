@@ -0,0 +1,233 @@
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "importer.hpp"
+#include "threadpool.hpp"
+#include "profiler.hpp"
+#define LARGE_FILE (8 << 20)	// Bytes from which a file is read on its own
+#define BATCH_FILES 32		// Most small files read by one task
+
+namespace fs = std::filesystem;
+
+Importer::Importer()
+: m_files()
+, m_batches()
+, m_next(0)
+, m_ahead(0)
+, m_flight(0)
+, m_running(0)
+, m_handed(0)
+, m_failed(0)
+, m_size(0)
+, m_options()
+, m_full(true)
+, m_stop(false)
+, m_ready()
+, m_begin()
+, m_end()
+, m_mutex()
+, m_cv()
+{}
+
+Importer::~Importer()
+{
+	stop();
+}
+
+std::vector<std::string> Importer::collect(const std::vector<std::string>& in)
+{
+	auto isStl = [](const fs::path& p) {
+		std::string ext = p.extension().string();
+		return !ext.compare(".stl") || !ext.compare(".STL");
+	};
+
+	std::vector<std::string> files;
+	for (const std::string& s : in) {
+		std::error_code ec;
+		if (fs::is_directory(s, ec)) {
+			for (const fs::directory_entry& e : fs::recursive_directory_iterator(s, ec)) {
+				if (e.is_regular_file(ec) && isStl(e.path())) files.push_back(e.path().string());
+			}
+		} else {
+			files.push_back(s);
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+void Importer::setOptions(const Solid::Options& o)
+{
+	m_options = o;
+}
+
+void Importer::setFull(bool b)
+{
+	m_full = b;
+}
+
+void Importer::setAhead(size_t n)
+{
+	m_ahead = n;
+}
+
+void Importer::start(const std::vector<std::string>& f)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stop = true;
+	m_cv.wait(lock, [this] { return m_running == 0; });
+
+	m_files = f;
+	m_stop = false;
+	m_batches.clear();
+	m_ready.clear();
+	m_next = m_flight = m_handed = m_failed = 0;
+	m_size = 0;
+	m_begin = m_end = std::chrono::steady_clock::now();
+
+	// Largest first, so no big file is left for the end
+	std::vector<uintmax_t> size(f.size());
+	for (size_t i = 0; i < f.size(); ++i) {
+		std::error_code ec;
+		size[i] = fs::file_size(f[i], ec);
+		if (ec) size[i] = 0;
+	}
+	std::vector<size_t> order(f.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return size[a] > size[b]; });
+
+	// Small files are batched until they add up to a large one
+	uintmax_t bytes = 0;
+	for (size_t i : order) {
+		bool large = size[i] >= LARGE_FILE;
+		if (large || m_batches.empty() || bytes >= LARGE_FILE || m_batches.back().size() >= BATCH_FILES) {
+			m_batches.emplace_back();
+			bytes = 0;
+		}
+		m_batches.back().push_back(i);
+		bytes += size[i];
+		if (large) bytes = LARGE_FILE;
+	}
+	fill();
+}
+
+void Importer::fill()
+{
+	ThreadPool& pool = ThreadPool::shared();
+	while (!m_stop && m_next < m_batches.size() && m_running < pool.size()
+		&& (m_ahead == 0 || m_flight < m_ahead)) {
+		size_t b = m_next++;
+		m_flight += m_batches[b].size();
+		++m_running;
+		pool.submit([this, b] { read(b); });
+	}
+}
+
+void Importer::read(size_t b)
+{
+	std::vector<size_t> files;
+	Solid::Options options;
+	bool full;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		files = m_batches[b];
+		options = m_options;
+		full = m_full;
+	}
+
+	// Files of their own split their records across the pool, which
+	// idle workers steal; batched files are too small to be worth it
+	Solid::Loader l = (files.size() == 1 ? Solid::Loader::PARALLEL : Solid::Loader::MMAP);
+	for (size_t i : files) {
+		{
+			// The rest of the batch is dropped once stopped
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stop) break;
+		}
+
+		Result r { i, Solid(), Bvh(), false };
+		r.solid.setOptions(options);
+		{
+			Profiler::Scope p("import", "load");
+			if (full) r.ok = r.solid.load(m_files[i], l);
+			else if ((r.ok = r.solid.parseFile(m_files[i], l))) r.solid.weld();
+		}
+		if (full && r.ok) {
+			Profiler::Scope p("bvh", "load");
+			r.bvh.build(r.solid);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!r.ok) ++m_failed;
+		m_size += r.solid.size();
+		m_end = std::chrono::steady_clock::now();
+		m_ready.push_back(std::move(r));
+		m_cv.notify_all();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	--m_running;
+	fill();
+	m_cv.notify_all();
+}
+
+void Importer::stop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stop = true;
+	m_cv.wait(lock, [this] { return m_running == 0; });
+}
+
+bool Importer::next(Result& r, bool wait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_handed == m_files.size()) return false;
+	if (wait) m_cv.wait(lock, [this] { return !m_ready.empty() || (m_stop && m_running == 0); });
+	if (m_ready.empty()) return false;
+
+	r = std::move(m_ready.front());
+	m_ready.pop_front();
+	--m_flight;
+	++m_handed;
+	fill();
+	lock.unlock();
+
+	if (!r.ok) r.solid = Solid();
+	return true;
+}
+
+bool Importer::done() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_handed == m_files.size();
+}
+
+size_t Importer::failed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_failed;
+}
+
+uint64_t Importer::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_size;
+}
+
+double Importer::seconds() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return std::chrono::duration<double>(m_end - m_begin).count();
+}
+
+void Importer::report() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	double sec = std::max(std::chrono::duration<double>(m_end - m_begin).count(), 1e-6);
+	std::cout << "Read " << m_handed - m_failed << " of " << m_files.size() << " files (" << m_size
+		<< " polygons) in " << std::round(sec * 1000.0) << " ms ("
+		<< std::round(static_cast<double>(m_size) / sec / 1e5) / 10.0 << " M polygons/s on "
+		<< ThreadPool::shared().size() << " threads)" << std::endl;
+}
@@ -0,0 +1,134 @@
+#ifndef IMPORTER_HPP
+#define IMPORTER_HPP
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "solid.hpp"
+#include "bvh.hpp"
+
+class Importer {
+public:
+	/** A file that has been read.
+	*/
+	struct Result {
+		size_t index;	// In the list given to start()
+		Solid solid;
+		Bvh bvh;	// Picking hierarchy, built by full loads
+		bool ok;
+	};
+
+	Importer();
+
+	/** Wait for files being read, the rest are dropped.
+	*/
+	~Importer();
+
+	Importer(const Importer&) = delete;
+	Importer& operator=(const Importer&) = delete;
+
+	/** Expand directories into the `.stl` files they contain.
+	 * @param in Files and/or directories
+	 * @return Sorted list of files
+	*/
+	static std::vector<std::string> collect(const std::vector<std::string>&);
+
+	/** Set the options files are read with, e.g. weld distance.
+	 * @param o Options
+	*/
+	void setOptions(const Solid::Options&);
+
+	/** Choose how much is done with each file. Full loads use the cache
+	 * and build levels of detail like readFile(), as well as the picking
+	 * hierarchy, otherwise files are only parsed & welded.
+	 * @param b True for full loads, the default
+	*/
+	void setFull(bool);
+
+	/** Limit how many files are read ahead of next(), to bound memory.
+	 * @param n Number of files, 0 for no limit (the default)
+	*/
+	void setAhead(size_t);
+
+	/** Start reading files on the shared thread pool, largest first.
+	 * Large files are read one at a time with their records split across
+	 * the pool, small ones in batches of a few per task.
+	 * @param f Filenames
+	*/
+	void start(const std::vector<std::string>&);
+
+	/** Stop reading more files, e.g. when quitting, and wait for those
+	 * being read to finish. Must be called before the shared thread pool
+	 * is destroyed.
+	*/
+	void stop();
+
+	/** Hand over a file that has been read, in the order they finish.
+	 * Nothing touches OpenGL, so the caller uploads it on the thread
+	 * owning the context.
+	 * @param r Set to the file, its solid is empty if it couldn't be read
+	 * @param wait Block until a file is ready
+	 * @return True if a file was handed over, false if none is ready or all were
+	*/
+	bool next(Result&, bool = true);
+
+	/** Check if every file has been handed over.
+	 * @return True when reading is over
+	*/
+	bool done() const;
+
+	/** Get the number of files that couldn't be read so far.
+	 * @return File count
+	*/
+	size_t failed() const;
+
+	/** Get the number of triangles read so far.
+	 * @return Triangle count
+	*/
+	uint64_t size() const;
+
+	/** Get the time from start() to the last file being read.
+	 * @return Seconds
+	*/
+	double seconds() const;
+
+	/** Print how many files & triangles were read, and how fast.
+	*/
+	void report() const;
+
+private:
+	/** Submit batches while fewer than the limit are being read, and
+	 * at most one per worker at a time so stop() takes effect soon.
+	 * Must be called with m_mutex held.
+	*/
+	void fill();
+
+	/** Read a batch of files, on the pool.
+	 * @param b Batch index
+	*/
+	void read(size_t);
+
+	// Instance variables
+	std::vector<std::string> m_files;
+	std::vector<std::vector<size_t>> m_batches;	// File indices, largest first
+	size_t m_next;		// Next batch to submit
+	size_t m_ahead;
+	size_t m_flight;	// Files submitted but not handed over
+	size_t m_running;	// Batches being read
+	size_t m_handed;
+	size_t m_failed;
+	uint64_t m_size;
+	Solid::Options m_options;
+	bool m_full;
+	bool m_stop;
+	std::deque<Result> m_ready;
+	std::chrono::steady_clock::time_point m_begin;
+	std::chrono::steady_clock::time_point m_end;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "isa.hpp"
+
+Isa bestIsa()
+{
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) return Isa::AVX2;
+#endif
+#ifdef HAVE_SSE
+	return Isa::SSE;
+#else
+	return Isa::SCALAR;
+#endif
+}
+
+const char *isaName(Isa isa)
+{
+	switch (isa) {
+		case Isa::SSE: return "SSE";
+		case Isa::AVX2: return "AVX2";
+		case Isa::BEST: return isaName(bestIsa());
+		default: return "scalar";
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef ISA_HPP
+#define ISA_HPP
+
+// Instruction sets the compiler can target, kernels include their
+// intrinsics under the same macros
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_AVX2
+#endif
+#ifdef __SSE2__
+#define HAVE_SSE
+#endif
+
+/** Instruction set used by the vectorized kernels, e.g. the normal check
+ * and batch point transforms. All of them give the same results.
+*/
+enum class Isa {
+	SCALAR,
+	SSE,	// 128-bit vectors
+	AVX2,	// 256-bit vectors
+	BEST	// Fastest one the CPU supports
+};
+
+/** Get the fastest instruction set the CPU supports.
+ * @return SCALAR, SSE or AVX2
+*/
+Isa bestIsa();
+
+/** Get the name of an instruction set.
+ * @param isa Instruction set
+ * @return Name for printing
+*/
+const char *isaName(Isa);
+
+#endif
@@ -1,71 +1,282 @@
 #include <iostream>
 #include <string>
-#include <limits>
 #include <cmath>
 #include <cctype>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <chrono>
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 #include "solid.hpp"
 #include "camera.hpp"
+#include "batch.hpp"
+#include "bvh.hpp"
+#include "scene.hpp"
+#include "progressive.hpp"
+#include "importer.hpp"
+#include "profiler.hpp"
+#include "analysis.hpp"
+#include "pacer.hpp"
 #define SCREEN_WIDTH 1024.0
 #define SCREEN_HEIGHT 576.0
-#define PI 3.1415926535
-#define rad(x) (x * PI / 180.f)
+#define POLL_MS 15	// How often loaded chunks are picked up
 
-// Create global camera & solid
+// Create global camera & scene
 Camera gCamera;
-Solid gSolid;
+Scene gScene;
+Solid::Options gOptions;	// Every mesh is read with these
+Solid::Loader gLoader = Solid::Loader::STREAM;
+Progressive gLoad;	// Reads one mesh at a time, previewing it
+Importer gImport;	// Reads all meshes at once on the thread pool
+bool gParallel = false;	// gImport is in use
+uint32_t gMesh = 0;	// Mesh being loaded
+uint32_t gFailed = 0;	// Meshes that couldn't be read
+bool gFollow = true;	// Keep framing the scene as it grows
+bool gOverlay = false;	// Show timings on top of the solid
+int gStatus = 0;	// Exit status once the main loop returns
+Pacer gPacer;		// Draws only when something changed, at most at the refresh rate
 
 // Values used in dragging
-Vector3 gCoords;
-GLdouble projection_matrix[16];
-const GLdouble modelview_matrix[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+Vector3 gCoords;	// Arcball point the last rotation ended at
+int gDragX = 0;		// Latest pointer position, applied once per frame
+int gDragY = 0;
+bool gDragged = false;	// Pointer moved since the last frame
 int viewport_matrix[4] = {0, 0, (int) SCREEN_WIDTH, (int) SCREEN_HEIGHT};
 
-/** Return the coordinates where a ray cast from the camera that passes through
- * a given pair screen coordinates intersects the sphere surrounding the solid.
+/** Return the point under a pair of screen coordinates on the sphere
+ * surrounding the scene, computed from the camera's own matrices.
  * @param x
  * @param y
- * @return The coordinates, origin if ray doesn't intersect sphere
+ * @return Unit vector from the center of rotation
 */
 Vector3 sphereCoords(int x, int y)
 {
-	// Get updated matrices
-	glGetDoublev(GL_PROJECTION_MATRIX, projection_matrix);
+	double w = viewport_matrix[2], h = viewport_matrix[3];
+	return gCamera.arcball(2 * (x + 0.5) / w - 1, 1 - 2 * (y + 0.5) / h, gScene.getRadius());
+}
+
+/** Turn the scene by however far the pointer moved since the last frame,
+ * so a burst of motion events costs a single rotation.
+*/
+void drag()
+{
+	if (!gDragged) return;
+	gDragged = false;
+
+	Profiler::Scope p("unproject");
+	Vector3 v = sphereCoords(gDragX, gDragY);
+	if (v != gCoords && v != Vector3()) {
+		gCamera.rotateSolid(Quat::between(gCoords, v));
+		gCoords = v;
+	}
+}
+
+/** Draw the frame the pacer scheduled, unless one was drawn meanwhile.
+ * @param value Unused
+*/
+void present(int)
+{
+	if (gPacer.waiting()) glutPostRedisplay();
+}
+
+/** Ask for a frame once the current refresh interval is over. Every
+ * change made until then is drawn by that one frame.
+*/
+void redraw()
+{
+	int ms = gPacer.request();
+	if (ms >= 0) glutTimerFunc(static_cast<unsigned int>(ms), present, 0);
+}
+
+/** Print the triangle under a pair of screen coordinates.
+ * @param x
+ * @param y
+*/
+void pick(int x, int y)
+{
+	double w = viewport_matrix[2], h = viewport_matrix[3];
+	double o[3], d[3];
+	if (!gCamera.unproject(gScene, 2 * (x + 0.5) / w - 1, 1 - 2 * (y + 0.5) / h, o, d)) return;
+
+	Bvh::Ray r;
+	for (int i = 0; i < 3; ++i) {
+		r.origin[i] = static_cast<float>(o[i]);
+		r.dir[i] = static_cast<float>(d[i]);
+	}
+
+	Bvh::Hit hit;
+	uint32_t inst = 0;
+	if (!gScene.intersect(r, hit, inst)) {
+		std::cout << "Nothing picked" << std::endl;
+		return;
+	}
+
+	double len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	std::cout << "Picked triangle " << hit.triangle << " of " << gScene.getFile(gScene.getInstances()[inst].mesh)
+		<< " (instance " << inst << ") at distance " << hit.t * len
+		<< " (u = " << hit.u << ", v = " << hit.v << ")" << std::endl;
+}
 
-	// Get mouse position in world
-	Vector3 p;
-	Vector3 e = gCamera.getPos();
-	gluUnProject(
-		x, y, e.z,
-		modelview_matrix, projection_matrix, viewport_matrix,
-		&p.x, &p.y, &p.z
-	);
+/** Build the picking hierarchy of a mesh that was just read.
+ * @param i Mesh index
+*/
+void built(uint32_t i)
+{
+	Profiler::Scope p("bvh", "load");
+	auto begin = std::chrono::steady_clock::now();
+	size_t nodes = gScene.buildBvh(i);
+	std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - begin;
+	std::cout << "BVH built (" << nodes << " nodes, " << std::round(ms.count()) << " ms)" << std::endl;
+}
 
-	// Find where mouse intersects solid's sphere
-	double r = std::pow(gSolid.getRadius(), 2);
-	Vector3 m = p - e;
+/** Report the whole scene once every mesh is in, or quit if none could
+ * be read. Quitting goes through the main loop, so the trace is written
+ * and the scene released as when the window is closed.
+*/
+void finish()
+{
+	if (gFailed == gScene.meshCount()) {
+		gStatus = 1;
+		glutLeaveMainLoop();
+		return;
+	}
+	if (gParallel) gImport.report();
+	if (gScene.getInstances().size() > 1) {
+		std::cout << "Scene loaded (" << gScene.meshCount() - gFailed << " meshes, " << gScene.getInstances().size()
+			<< " instances, " << gScene.size() << " polygons)" << std::endl;
+	}
+}
 
-	double a = m.dot(m);
-	double b = e.dot(m) * 2.f;
-	double c = e.dot(e) - std::pow(r, 2);
-	double root = std::pow(b, 2) - (4.f * a * c);
-	if (root <= 0) return Vector3(); // Ray doesn't intersect w/ sphere
-	double t = (-b - std::sqrt(root)) / (2.f * a);
+/** Upload whatever meshes the thread pool has read since the last call,
+ * and keep polling until all of them are in.
+ * @param value Unused
+*/
+void gather(int)
+{
+	Importer::Result r;
+	bool changed = false;
+	while (gImport.next(r, false)) {
+		if (!r.ok) {
+			++gFailed;
+			continue;
+		}
 
-	return (p + (m * t)).norm();
+		// Keep the display settings of the mesh being replaced
+		Solid& s = gScene.getMesh(static_cast<uint32_t>(r.index));
+		{
+			Profiler::Scope p("upload", "load");
+			if (s.getLight() != r.solid.getLight()) r.solid.toggleLight();
+			if (s.getSmooth() != r.solid.getSmooth()) r.solid.toggleSmooth();
+			s = std::move(r.solid);
+			s.upload();
+		}
+
+		// Built along with the mesh on the thread pool
+		std::cout << "BVH built (" << r.bvh.nodeCount() << " nodes)" << std::endl;
+		gScene.setBvh(static_cast<uint32_t>(r.index), std::move(r.bvh));
+		changed = true;
+	}
+
+	if (changed) {
+		if (gFollow) gCamera.frame(gScene);
+		redraw();
+	}
+	if (gImport.done()) finish();
+	else glutTimerFunc(POLL_MS, gather, 0);
+}
+
+/** Pick up whatever the loading thread has read, and keep polling until
+ * every mesh of the scene is in, one after another.
+ * @param value Unused
+*/
+void arrive(int)
+{
+	Solid& s = gScene.getMesh(gMesh);
+	if (gLoad.poll(s)) {
+		if (gFollow) gCamera.frame(gScene);
+		redraw();
+	}
+	if (!gLoad.done()) {
+		glutTimerFunc(POLL_MS, arrive, 0);
+		return;
+	}
+
+	if (gLoad.failed()) {
+		// Drop whatever preview made it, the rest of the scene goes on
+		s = Solid();
+		++gFailed;
+		redraw();
+	} else {
+		built(gMesh);
+	}
+
+	if (++gMesh < gScene.meshCount()) {
+		gLoad.start(gScene.getFile(gMesh), gLoader, gOptions);
+		glutTimerFunc(0, arrive, 0);
+		return;
+	}
+	finish();
+}
+
+/** Print the profiler's stats in the top left corner.
+*/
+void overlay()
+{
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	gluOrtho2D(0, viewport_matrix[2], viewport_matrix[3], 0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glColor3f(1.f, 1.f, 0.f);
+	int y = 0;
+	for (const Profiler::Stat& s : Profiler::shared().getStats()) {
+		char line[64];
+		if (s.counter) snprintf(line, sizeof line, "%-12s %10.0f", s.name.c_str(), s.value);
+		else snprintf(line, sizeof line, "%-12s %7.2f ms%s", s.name.c_str(), s.value, (s.cat == "frame" ? "" : " total"));
+		glRasterPos2i(8, y += 15);
+		glutBitmapString(GLUT_BITMAP_8_BY_13, reinterpret_cast<const unsigned char *>(line));
+	}
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
 }
 
 void display()
 {
+	Profiler& prof = Profiler::shared();
+	prof.frame();
+	prof.counter("requests", gPacer.frame());
+
 	// Clear buffers
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	{
+		Profiler::Scope p("clear");
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
 
 	// Render solid
-	gCamera.render(gSolid);
-	glFlush();
+	drag();
+	{
+		Profiler::Scope p("render");
+		gCamera.clip(gScene);
+		prof.beginGpu();
+		gCamera.render(gScene);
+		prof.endGpu();
+	}
+	if (gOverlay) overlay();
 
-	// Update screen buffer
+	// Update screen buffer, which flushes as well
+	Profiler::Scope p("swap");
 	glutSwapBuffers();
 }
 
@@ -89,19 +300,47 @@ void keyboard(unsigned char key, int x, int y)
 			gCamera.toggleProj();
 			break;
 		case 'l': // Toggle lighting
-			gSolid.toggleLight();
+			gScene.toggleLight();
+			break;
+		case 's': // Toggle smooth shading
+			gScene.toggleSmooth();
 			break;
+		case 'i': // Toggle the timings overlay
+			gOverlay = !gOverlay;
+			break;
+		case 'c': { // Print culling counters
+			const Camera::CullStats& c = gCamera.getCullStats();
+			std::cout << "Clusters: " << c.drawn << " drawn, " << c.outside << " outside the view, "
+				<< c.facing << " facing away" << std::endl;
+			break;
+		}
+		case 'f': { // Print frame pacing counters
+			const Pacer::Stats& f = gPacer.getStats();
+			std::cout << "Frames: " << f.frames << " drawn (" << f.late << " late), " << f.requests << " requests ("
+				<< f.coalesced << " coalesced), idle " << std::round(f.idle * 10) / 10 << " s" << std::endl;
+			break;
+		}
 	}
-	glutPostRedisplay();
+	redraw();
 }
 
 void mouse(int btn, int state, int x, int y)
 {
+	// Draw the full solid again once dragging stops
+	if (btn == GLUT_LEFT_BUTTON) gCamera.setInteractive(state == GLUT_DOWN);
+
+	// Leave the view alone once the user has moved it
+	if (btn == GLUT_LEFT_BUTTON || btn == 3 || btn == 4) gFollow = false;
+
 	if (state == GLUT_DOWN) {
 		switch(btn)
 		{
 			case GLUT_LEFT_BUTTON: // Start dragging
-				gCoords = sphereCoords(viewport_matrix[2] - x, y);
+				gCoords = sphereCoords(x, y);
+				gDragged = false;
+				break;
+			case GLUT_RIGHT_BUTTON: // Pick a triangle
+				pick(x, y);
 				break;
 			case 3: // Zoom in/out
 			case 4:
@@ -109,25 +348,24 @@ void mouse(int btn, int state, int x, int y)
 				break;
 		}
 	}
-	glutPostRedisplay();
+	redraw();
 }
 
 void move(int x, int y)
 {
-	// Get new position
-	Vector3 v = sphereCoords(viewport_matrix[2] - x, y);
-
-	// Apply rotation only if sphere intersects & and coordinates have changed
-	if (v != gCoords && v != Vector3()) {
-		double a = gCoords.angle(v);
-		double w = std::cos(a / 2.f);
-		Vector3 n = gCoords.cross(v).norm() * std::sin(a / 2.f);
-		gCamera.rotateSolid(n, w);
+	// Only the latest position matters, display() applies it
+	gDragX = x;
+	gDragY = y;
+	gDragged = true;
+	redraw();
+}
 
-		// Update position
-		gCoords = v;
-		glutPostRedisplay();
-	}
+/** Delete the scene's OpenGL objects while the window's context is still
+ * current, which it isn't any more once glutMainLoop() returns.
+*/
+void release()
+{
+	gScene.release();
 }
 
 void init()
@@ -141,24 +379,145 @@ void init()
 	glShadeModel(GL_FLAT); // Use flat shading since solid(s) have no color
 }
 
+/** Print a report on every model without opening a window.
+ * @param files Models, scenes are expanded into the models they place
+ * @param o Options every model is read with
+ * @return 0 if every model was read and is watertight, 1 otherwise
+*/
+int analyze(const std::vector<std::string>& files, const Solid::Options& o)
+{
+	Scene models;
+	for (const std::string& f : files) {
+		if (!Scene::isScene(f)) models.add(f);
+		else if (!models.readFile(f)) return 1;
+	}
+
+	Analysis analysis;
+	int status = 0;
+	for (uint32_t i = 0; i < models.meshCount(); ++i) {
+		const std::string& f = models.getFile(i);
+		Solid s;
+		s.setOptions(o);
+		Analysis::Report r;
+		auto begin = std::chrono::steady_clock::now();
+		if (!s.parseFile(f, Solid::Loader::PARALLEL) || !analysis.run(s, r)) {
+			std::cerr << "Error analysing file: " << f << std::endl;
+			status = 1;
+			continue;
+		}
+		std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - begin;
+		std::cout << f << " (" << std::round(ms.count()) << " ms):" << std::endl;
+		Analysis::print(r);
+		if (!Analysis::watertight(r)) status = 1;
+	}
+	return status;
+}
+
 int main(int argc, char **argv)
 {
-	// Check args & print help
-	if ((argc > 1 && !std::string(argv[1]).compare("-h")) || argc < 2) {
-		std::cout 	<< "Usage: " << argv[0] << " <filename>\n"
-					<< "File must be in `.stl` format.\n\n"
+	// Parse args
+	std::vector<std::string> files;
+	bool help = false;
+	double eps = 0;
+	bool fix = false;
+	std::string trace;
+	Batch batch;
+	bool headless = false;
+	bool report = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg(argv[i]);
+		bool more = i + 1 < argc;
+		if (!arg.compare("-h")) help = true;
+		else if (!arg.compare("-m")) gLoader = Solid::Loader::MMAP;
+		else if (!arg.compare("-j")) gLoader = Solid::Loader::PARALLEL;
+		else if (!arg.compare("-w") && more) eps = std::strtod(argv[++i], nullptr);
+		else if (!arg.compare("-r")) gOptions.cache = false;
+		else if (!arg.compare("-x")) fix = true;
+		else if (!arg.compare("-t") && more) trace = argv[++i];
+		else if (!arg.compare("-a") && more) gOptions.crease = std::strtod(argv[++i], nullptr);
+		else if (!arg.compare("-b") && more) {
+			gLoader = Solid::Loader::CHUNKED;
+			gOptions.budget = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+		}
+		else if (!arg.compare("-q")) report = true;
+		else if (!arg.compare("-l") && more) gPacer.setRate(std::strtod(argv[++i], nullptr));
+		else if (!arg.compare("-o") && more) batch.setOutput(argv[++i]), headless = true;
+		else if (!arg.compare("-n") && more) batch.setViews(std::atoi(argv[++i]));
+		else if (!arg.compare("-f") && more) batch.setFormat(argv[++i]);
+		else if (!arg.compare("-c")) batch.setSoftware(true);
+		else if (!arg.compare("-s") && more) {
+			int w = 0, h = 0;
+			if (sscanf(argv[++i], "%dx%d", &w, &h) == 2) batch.setSize(w, h);
+		}
+		else files.push_back(arg);
+	}
+
+	// Print help
+	if (help || files.empty()) {
+		std::cout 	<< "Usage: " << argv[0] << " [options] <files or directories...>\n"
+					<< "       " << argv[0] << " -o <dir> [options] <files or directories...>\n"
+					<< "       " << argv[0] << " -q [options] <files or directories...>\n"
+					<< "Files must be in `.stl` format (binary or text), or `.scene` files listing\n"
+					<< "one model per line as `<file> [x y z [rx ry rz [scale]]]`.\n\n"
+					<< "Options:\n"
+					<< "-m Read the file through a memory mapping\n"
+					<< "-j Read the file through a memory mapping on all cores\n"
+					<< "-w <dist> Merge vertices closer than dist (default 0)\n"
+					<< "-r Re-read the file instead of using the cache\n"
+					<< "-x Replace normals that don't match their polygon\n"
+					<< "-a <deg> Crease angle of smooth shading (default 30)\n"
+					<< "-t <file> Write timings on exit, as a Chrome trace if file ends in .json or CSV otherwise\n"
+					<< "-b <MB> Stream the file to the GPU using at most MB of memory\n"
+					<< "-l <fps> Draw at most fps frames per second (default 60, 0 for no limit)\n"
+					<< "-h Show this help\n\n"
+					<< "Headless options:\n"
+					<< "-o <dir> Render images to dir without opening a window\n"
+					<< "-n <views> Views around the vertical axis per model (default 1)\n"
+					<< "-s <w>x<h> Image size (default 256x256)\n"
+					<< "-f png|ppm Image format (default png)\n"
+					<< "-c Render on the CPU, without OpenGL\n"
+					<< "-q Print each model's area, volume & defects instead, e.g. holes\n\n"
 					<< "Controls:\n"
 					<< "Left click & drag to rotate object\n"
+					<< "Right click to print the triangle under the cursor\n"
 					<< "Scroll to zoom in/out\n"
 					<< "P to toggle perspective/orthographic\n"
 					<< "L to toggle lighting\n"
-					<< "ESC to quit\n\n"
-					<< "Use `-h` flag to see this help\n";
+					<< "S to toggle smooth shading\n"
+					<< "I to show timings\n"
+					<< "C to print how many clusters were culled\n"
+					<< "F to print how many frames were drawn & requests coalesced\n"
+					<< "ESC to quit\n";
 		return 0;
 	}
 
+	// Check models without a window
+	if (report) {
+		gOptions.fix = fix;
+		return analyze(Importer::collect(files), gOptions);
+	}
+
+	// Render without a window
+	if (headless) {
+		batch.setWeldEpsilon(eps);
+		batch.setFixNormals(fix);
+		return batch.run(files) ? 0 : 1;
+	}
+	gOptions.eps = eps;
+	gOptions.fix = fix;
+	for (const std::string& f : Importer::collect(files)) {
+		if (!Scene::isScene(f)) gScene.add(f);
+		else if (!gScene.readFile(f)) return 1;
+	}
+	if (!gScene.meshCount()) {
+		std::cerr << "No models to render" << std::endl;
+		return 1;
+	}
+	Profiler::shared().setRecording(!trace.empty());
+
 	// Initialize GLUT
 	glutInit(&argc, argv);
+	glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 	glutInitWindowSize(SCREEN_WIDTH, SCREEN_HEIGHT);
 	glutCreateWindow(argv[0]);
@@ -169,6 +528,7 @@ int main(int argc, char **argv)
 	glutKeyboardFunc(keyboard);
 	glutMouseFunc(mouse);
 	glutMotionFunc(move);
+	glutCloseFunc(release);
 
 	// Initialize GLEW
 	GLenum err = glewInit();
@@ -180,8 +540,19 @@ int main(int argc, char **argv)
 	// Initialize OpenGL
 	init();
 
-	// Read STL file
-	if (!gSolid.readFile(argv[1])) return 1;
+	// Read the meshes in the background, showing them as they arrive.
+	// Several meshes are read at once, unless memory is limited.
+	gParallel = gScene.meshCount() > 1 && gLoader != Solid::Loader::CHUNKED;
+	if (gParallel) {
+		std::vector<std::string> meshes;
+		for (uint32_t i = 0; i < gScene.meshCount(); ++i) meshes.push_back(gScene.getFile(i));
+		gImport.setOptions(gOptions);
+		gImport.start(meshes);
+		glutTimerFunc(0, gather, 0);
+	} else {
+		gLoad.start(gScene.getFile(0), gLoader, gOptions);
+		glutTimerFunc(0, arrive, 0);
+	}
 
 	// Initialize camera
 	gCamera.setRatio(SCREEN_WIDTH / SCREEN_HEIGHT);
@@ -189,21 +560,11 @@ int main(int argc, char **argv)
 	// Set FoV
 	gCamera.setFov(45.f);
 
-	// Radius of sphere bounding solid
-	double r = gSolid.getRadius();
-	if (r == std::numeric_limits<double>::infinity()) r = std::numeric_limits<double>::max();
-
-	// Distance from camera to center of the solid @ given FoV
-	double d = r / std::tan(rad(gCamera.getFov()) / 2.f);
-
-	// Set position to view entire solid
-	gCamera.setPos(gCamera.getDir() * d);
-
-	// Set clipping that covers the entire solid
-	double dia = 2 * r;
-	gCamera.setClipping(d + dia, d - dia);
-
-	// Enter GLUT main loop
+	// Enter GLUT main loop, then wait for the loaders, which use the
+	// shared thread pool that's destroyed before them
 	glutMainLoop();
-	return 0;
+	gLoad.stop();
+	gImport.stop();
+	if (!trace.empty() && !Profiler::shared().write(trace)) return 1;
+	return gStatus;
 }
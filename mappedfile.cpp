@@ -0,0 +1,78 @@
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mappedfile.hpp"
+
+// Default constructor
+MappedFile::MappedFile()
+: m_data(nullptr)
+, m_size(0)
+{}
+
+// Destructor
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// Move constructor
+MappedFile::MappedFile(MappedFile&& o) noexcept
+: m_data(std::exchange(o.m_data, nullptr))
+, m_size(std::exchange(o.m_size, 0))
+{}
+
+// Move assignment
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept
+{
+	if (this != &o) {
+		close();
+		m_data = std::exchange(o.m_data, nullptr);
+		m_size = std::exchange(o.m_size, 0);
+	}
+	return *this;
+}
+
+bool MappedFile::open(std::string f)
+{
+	close();
+
+	int fd = ::open(f.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(st.st_size);
+	void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping keeps its own reference to the file
+	if (p == MAP_FAILED) return false;
+
+	// Records are read front to back
+	madvise(p, size, MADV_SEQUENTIAL);
+
+	m_data = static_cast<const char *>(p);
+	m_size = size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data) munmap(const_cast<char *>(m_data), m_size);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+const char *MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+#include <string>
+#include <cstddef>
+
+class MappedFile {
+public:
+	MappedFile();					// Default constructor
+	~MappedFile();					// Destructor
+	MappedFile(const MappedFile&) = delete;		// Non-copyable
+	MappedFile(MappedFile&&) noexcept;		// Move constructor
+
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&&) noexcept;	// Move assignment
+
+	/** Map a file read-only into memory, unmapping any previous file.
+	 * @param f Filename
+	 * @return True on success, false otherwise
+	*/
+	bool open(std::string);
+
+	/** Unmap the current file, if any.
+	*/
+	void close();
+
+	/** Get a pointer to the start of the mapping.
+	 * @return Mapped bytes, nullptr if nothing is mapped
+	*/
+	const char *data() const;
+
+	/** Get the size of the mapping.
+	 * @return Size in bytes
+	*/
+	size_t size() const;
+
+private:
+	// Instance variables
+	const char *m_data;
+	size_t m_size;
+};
+
+#endif
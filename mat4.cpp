@@ -0,0 +1,157 @@
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include "mat4.hpp"
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+#ifdef HAVE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+/** Transform points one at a time with a float matrix. The vector
+ * versions below do exactly the same float operations, in the same order.
+ * @param w Write w as well as x, y & z
+*/
+void scalar(const float *m, const float *in, float *out, size_t n, bool w)
+{
+	int k = (w ? 4 : 3);
+	for (size_t i = 0; i < n; ++i, in += 3, out += k) {
+		float x = in[0], y = in[1], z = in[2];
+		for (int r = 0; r < k; ++r) out[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r];
+	}
+}
+
+#ifdef HAVE_SSE
+/** Transform a point per iteration with SSE2, a column per register.
+*/
+void sse(const float *m, const float *in, float *out, size_t n, bool w)
+{
+	__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+	for (size_t i = 0; i < n; ++i, in += 3) {
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(c0, _mm_set1_ps(in[0])), _mm_mul_ps(c1, _mm_set1_ps(in[1]))),
+			_mm_mul_ps(c2, _mm_set1_ps(in[2]))), c3);
+		if (w) {
+			_mm_storeu_ps(out, r);
+			out += 4;
+		} else {
+			// Never write past the point, out may be in
+			_mm_storel_pi(reinterpret_cast<__m64 *>(out), r);
+			_mm_store_ss(out + 2, _mm_movehl_ps(r, r));
+			out += 3;
+		}
+	}
+}
+#endif
+
+#ifdef HAVE_AVX2
+/** Transform two points per iteration with AVX2, the columns repeated
+ * in both halves of a register.
+*/
+__attribute__((target("avx2")))
+void avx(const float *m, const float *in, float *out, size_t n, bool w)
+{
+	__m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(m));
+	__m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(m + 4));
+	__m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(m + 8));
+	__m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(m + 12));
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2, in += 6) {
+		__m256 x = _mm256_setr_m128(_mm_set1_ps(in[0]), _mm_set1_ps(in[3]));
+		__m256 y = _mm256_setr_m128(_mm_set1_ps(in[1]), _mm_set1_ps(in[4]));
+		__m256 z = _mm256_setr_m128(_mm_set1_ps(in[2]), _mm_set1_ps(in[5]));
+		__m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(c0, x), _mm256_mul_ps(c1, y)), _mm256_mul_ps(c2, z)), c3);
+		if (w) {
+			_mm256_storeu_ps(out, r);
+			out += 8;
+		} else {
+			__m128 a = _mm256_castps256_ps128(r), b = _mm256_extractf128_ps(r, 1);
+			_mm_storel_pi(reinterpret_cast<__m64 *>(out), a);
+			_mm_store_ss(out + 2, _mm_movehl_ps(a, a));
+			_mm_storel_pi(reinterpret_cast<__m64 *>(out + 3), b);
+			_mm_store_ss(out + 5, _mm_movehl_ps(b, b));
+			out += 6;
+		}
+	}
+	if (i < n) scalar(m, in, out, n - i, w);
+}
+#endif
+
+/** Transform points with the chosen instruction set.
+*/
+void run(const double *e, const float *in, float *out, size_t n, bool w, Isa isa)
+{
+	float m[16];
+	for (int i = 0; i < 16; ++i) m[i] = static_cast<float>(e[i]);
+	if (isa == Isa::BEST) isa = bestIsa();
+#ifdef HAVE_AVX2
+	if (isa == Isa::AVX2) return avx(m, in, out, n, w);
+#endif
+#ifdef HAVE_SSE
+	if (isa == Isa::SSE) return sse(m, in, out, n, w);
+#endif
+	scalar(m, in, out, n, w);
+}
+
+} // namespace
+
+void Mat4::store(double *m) const
+{
+	memcpy(m, m_e, sizeof m_e);
+}
+
+Vector3 Mat4::apply(const Vector3& p) const
+{
+	return Vector3(
+		m_e[0] * p.x + m_e[4] * p.y + m_e[8] * p.z + m_e[12],
+		m_e[1] * p.x + m_e[5] * p.y + m_e[9] * p.z + m_e[13],
+		m_e[2] * p.x + m_e[6] * p.y + m_e[10] * p.z + m_e[14]
+	);
+}
+
+bool Mat4::invert(Mat4& out) const
+{
+	double m[4][8];
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			m[i][j] = m_e[j * 4 + i];
+			m[i][j + 4] = (i == j);
+		}
+	}
+
+	for (int c = 0; c < 4; ++c) {
+		int p = c;
+		for (int i = c + 1; i < 4; ++i) {
+			if (std::fabs(m[i][c]) > std::fabs(m[p][c])) p = i;
+		}
+		if (m[p][c] == 0) return false;
+		if (p != c) std::swap(m[p], m[c]);
+
+		double d = 1 / m[c][c];
+		for (int j = 0; j < 8; ++j) m[c][j] *= d;
+		for (int i = 0; i < 4; ++i) {
+			if (i == c) continue;
+			double f = m[i][c];
+			for (int j = 0; j < 8; ++j) m[i][j] -= f * m[c][j];
+		}
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) out.m_e[j * 4 + i] = m[i][j + 4];
+	}
+	return true;
+}
+
+void Mat4::transform(const float *in, float *out, size_t n, Isa isa) const
+{
+	run(m_e, in, out, n, false, isa);
+}
+
+void Mat4::project(const float *in, float *out, size_t n, Isa isa) const
+{
+	run(m_e, in, out, n, true, isa);
+}
@@ -0,0 +1,136 @@
+#ifndef MAT4_HPP
+#define MAT4_HPP
+#include <cstddef>
+#include "vector3.hpp"
+#include "vec3f.hpp"
+#include "quat.hpp"
+#include "isa.hpp"
+
+class Mat4 {
+public:
+	/** Create an identity matrix.
+	*/
+	constexpr Mat4() : m_e{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } {}
+
+	/** Copy a matrix, e.g. one OpenGL returned.
+	 * @param m Column-major 4x4 matrix
+	*/
+	explicit constexpr Mat4(const double *m) : m_e{}
+	{
+		for (int i = 0; i < 16; ++i) m_e[i] = m[i];
+	}
+
+	/** Create a translation.
+	 * @param x Offset along the x-axis
+	 * @param y Offset along the y-axis
+	 * @param z Offset along the z-axis
+	 * @return Matrix adding the offset to points
+	*/
+	static constexpr Mat4 translation(double x, double y, double z)
+	{
+		Mat4 t;
+		t.m_e[12] = x;
+		t.m_e[13] = y;
+		t.m_e[14] = z;
+		return t;
+	}
+
+	/** Create a rotation.
+	 * @param q Unit quaternion
+	 * @return Matrix rotating like q
+	*/
+	static constexpr Mat4 rotation(const Quat& q)
+	{
+		Mat4 r;
+		r.m_e[0] = 1 - 2 * q.y * q.y - 2 * q.z * q.z;
+		r.m_e[1] = 2 * q.x * q.y + 2 * q.w * q.z;
+		r.m_e[2] = 2 * q.x * q.z - 2 * q.w * q.y;
+		r.m_e[4] = 2 * q.x * q.y - 2 * q.w * q.z;
+		r.m_e[5] = 1 - 2 * q.x * q.x - 2 * q.z * q.z;
+		r.m_e[6] = 2 * q.y * q.z + 2 * q.w * q.x;
+		r.m_e[8] = 2 * q.x * q.z + 2 * q.w * q.y;
+		r.m_e[9] = 2 * q.y * q.z - 2 * q.w * q.x;
+		r.m_e[10] = 1 - 2 * q.x * q.x - 2 * q.y * q.y;
+		return r;
+	}
+
+	/** Multiply two matrices.
+	 * @param o Matrix applied first
+	 * @return This * o
+	*/
+	constexpr Mat4 operator*(const Mat4& o) const
+	{
+		Mat4 r;
+		for (int c = 0; c < 4; ++c) {
+			for (int i = 0; i < 4; ++i) {
+				r.m_e[c * 4 + i] = m_e[i] * o.m_e[c * 4] + m_e[4 + i] * o.m_e[c * 4 + 1]
+					+ m_e[8 + i] * o.m_e[c * 4 + 2] + m_e[12 + i] * o.m_e[c * 4 + 3];
+			}
+		}
+		return r;
+	}
+
+	constexpr double operator[](int i) const { return m_e[i]; }
+	constexpr double& operator[](int i) { return m_e[i]; }
+
+	/** Get the elements, e.g. for glMultMatrixd().
+	 * @return Column-major 4x4 matrix
+	*/
+	constexpr const double *data() const { return m_e; }
+
+	/** Copy the elements out.
+	 * @param m Column-major 4x4 matrix to write to
+	*/
+	void store(double *) const;
+
+	/** Transform a point, ignoring the bottom row.
+	 * @param p Point
+	 * @return Transformed point
+	*/
+	Vector3 apply(const Vector3&) const;
+
+	/** Transform a single precision point, ignoring the bottom row.
+	 * @param p Point
+	 * @return Transformed point
+	*/
+	constexpr Vec3f apply(const Vec3f& p) const
+	{
+		return Vec3f(
+			static_cast<float>(m_e[0] * p.x + m_e[4] * p.y + m_e[8] * p.z + m_e[12]),
+			static_cast<float>(m_e[1] * p.x + m_e[5] * p.y + m_e[9] * p.z + m_e[13]),
+			static_cast<float>(m_e[2] * p.x + m_e[6] * p.y + m_e[10] * p.z + m_e[14])
+		);
+	}
+
+	/** Invert the matrix by Gauss-Jordan elimination.
+	 * @param out Set to the inverse
+	 * @return False if the matrix is singular, out is left unchanged
+	*/
+	bool invert(Mat4&) const;
+
+	/** Transform many points at once, ignoring the bottom row. The
+	 * matrix is rounded to float, all instruction sets give the same
+	 * results.
+	 * @param in Coordinates, 3 per point
+	 * @param out Where to write 3 coordinates per point, may be in
+	 * @param n Number of points
+	 * @param isa Instruction set
+	*/
+	void transform(const float *, float *, size_t, Isa = Isa::BEST) const;
+
+	/** Transform many points to homogeneous coordinates, e.g. to clip
+	 * space with a projection & model-view matrix. Same rounding as
+	 * transform().
+	 * @param in Coordinates, 3 per point
+	 * @param out Where to write x, y, z & w per point
+	 * @param n Number of points
+	 * @param isa Instruction set
+	*/
+	void project(const float *, float *, size_t, Isa = Isa::BEST) const;
+
+private:
+	// Instance variables
+	double m_e[16];	// Column-major
+};
+
+#endif
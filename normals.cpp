@@ -0,0 +1,178 @@
+#include <cmath>
+#include <algorithm>
+#include "normals.hpp"
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+#ifdef HAVE_SSE
+#include <emmintrin.h>
+#endif
+#define WIDTH 8	// Triangles classified per batch
+#define PI 3.1415926535
+
+namespace {
+
+/** Per-triangle results of a batch, bit i is triangle i.
+*/
+struct Masks {
+	uint32_t bad;
+	uint32_t missing;
+	uint32_t degenerate;
+};
+
+/** Classify up to WIDTH triangles one at a time. The vector versions
+ * below do exactly the same float operations, in the same order.
+*/
+Masks scalar(const float *p, const float *f, uint32_t k, float cos2)
+{
+	Masks m = { 0, 0, 0 };
+	for (uint32_t i = 0; i < k; ++i, p += 9, f += 3) {
+		float e1[3] = { p[3] - p[0], p[4] - p[1], p[5] - p[2] };
+		float e2[3] = { p[6] - p[0], p[7] - p[1], p[8] - p[2] };
+		float c[3] = {
+			e1[1] * e2[2] - e1[2] * e2[1],
+			e1[2] * e2[0] - e1[0] * e2[2],
+			e1[0] * e2[1] - e1[1] * e2[0]
+		};
+		float len2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+		float fl2 = f[0] * f[0] + f[1] * f[1] + f[2] * f[2];
+		float d = f[0] * c[0] + f[1] * c[1] + f[2] * c[2];
+
+		// Written so that NaNs count as degenerate or missing
+		uint32_t b = 1u << i;
+		if (!(len2 > 0)) m.degenerate |= b;
+		else if (!(fl2 >= 0.25f)) m.missing |= b;
+		else if (!(d > 0 && d * d >= cos2 * len2 * fl2)) m.bad |= b;
+	}
+	return m;
+}
+
+#ifdef HAVE_SSE
+/** Classify 4 triangles with SSE2.
+*/
+Masks sse4(const float *p, const float *f, float cos2)
+{
+	auto load = [](const float *b, int s) { return _mm_setr_ps(b[0], b[s], b[2 * s], b[3 * s]); };
+	__m128 ax = load(p, 9), ay = load(p + 1, 9), az = load(p + 2, 9);
+	__m128 e1x = _mm_sub_ps(load(p + 3, 9), ax), e1y = _mm_sub_ps(load(p + 4, 9), ay), e1z = _mm_sub_ps(load(p + 5, 9), az);
+	__m128 e2x = _mm_sub_ps(load(p + 6, 9), ax), e2y = _mm_sub_ps(load(p + 7, 9), ay), e2z = _mm_sub_ps(load(p + 8, 9), az);
+	__m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+	__m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+	__m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+	__m128 fx = load(f, 3), fy = load(f + 1, 3), fz = load(f + 2, 3);
+
+	__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+	__m128 fl2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)), _mm_mul_ps(fz, fz));
+	__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, cx), _mm_mul_ps(fy, cy)), _mm_mul_ps(fz, cz));
+	__m128 ok = _mm_and_ps(_mm_cmpgt_ps(d, _mm_setzero_ps()),
+		_mm_cmpge_ps(_mm_mul_ps(d, d), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(cos2), len2), fl2)));
+
+	Masks m;
+	m.degenerate = ~static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(len2, _mm_setzero_ps()))) & 0xf;
+	m.missing = ~static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(fl2, _mm_set1_ps(0.25f)))) & ~m.degenerate & 0xf;
+	m.bad = ~static_cast<uint32_t>(_mm_movemask_ps(ok)) & ~(m.degenerate | m.missing) & 0xf;
+	return m;
+}
+#endif
+
+#ifdef HAVE_AVX2
+/** Classify 8 triangles with AVX2, gathering the strided records.
+*/
+__attribute__((target("avx2")))
+Masks avx8(const float *p, const float *f, float cos2)
+{
+	const __m256i s9 = _mm256_setr_epi32(0, 9, 18, 27, 36, 45, 54, 63);
+	const __m256i s3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+	__m256 ax = _mm256_i32gather_ps(p, s9, 4), ay = _mm256_i32gather_ps(p + 1, s9, 4), az = _mm256_i32gather_ps(p + 2, s9, 4);
+	__m256 e1x = _mm256_sub_ps(_mm256_i32gather_ps(p + 3, s9, 4), ax);
+	__m256 e1y = _mm256_sub_ps(_mm256_i32gather_ps(p + 4, s9, 4), ay);
+	__m256 e1z = _mm256_sub_ps(_mm256_i32gather_ps(p + 5, s9, 4), az);
+	__m256 e2x = _mm256_sub_ps(_mm256_i32gather_ps(p + 6, s9, 4), ax);
+	__m256 e2y = _mm256_sub_ps(_mm256_i32gather_ps(p + 7, s9, 4), ay);
+	__m256 e2z = _mm256_sub_ps(_mm256_i32gather_ps(p + 8, s9, 4), az);
+	__m256 cx = _mm256_sub_ps(_mm256_mul_ps(e1y, e2z), _mm256_mul_ps(e1z, e2y));
+	__m256 cy = _mm256_sub_ps(_mm256_mul_ps(e1z, e2x), _mm256_mul_ps(e1x, e2z));
+	__m256 cz = _mm256_sub_ps(_mm256_mul_ps(e1x, e2y), _mm256_mul_ps(e1y, e2x));
+	__m256 fx = _mm256_i32gather_ps(f, s3, 4), fy = _mm256_i32gather_ps(f + 1, s3, 4), fz = _mm256_i32gather_ps(f + 2, s3, 4);
+
+	__m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz));
+	__m256 fl2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, fx), _mm256_mul_ps(fy, fy)), _mm256_mul_ps(fz, fz));
+	__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, cx), _mm256_mul_ps(fy, cy)), _mm256_mul_ps(fz, cz));
+	__m256 zero = _mm256_setzero_ps();
+	__m256 ok = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ),
+		_mm256_cmp_ps(_mm256_mul_ps(d, d), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(cos2), len2), fl2), _CMP_GE_OQ));
+
+	Masks m;
+	m.degenerate = ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(len2, zero, _CMP_GT_OQ))) & 0xff;
+	m.missing = ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(fl2, _mm256_set1_ps(0.25f), _CMP_GE_OQ))) & ~m.degenerate & 0xff;
+	m.bad = ~static_cast<uint32_t>(_mm256_movemask_ps(ok)) & ~(m.degenerate | m.missing) & 0xff;
+	return m;
+}
+#endif
+
+/** Count the set bits of a mask.
+*/
+inline uint32_t count(uint32_t m)
+{
+	uint32_t n = 0;
+	for (; m; m &= m - 1) ++n;
+	return n;
+}
+
+} // namespace
+
+Normals::Normals(double tol)
+: m_cos2(static_cast<float>(std::pow(std::cos(std::clamp(tol, 0.0, 90.0) * PI / 180.0), 2)))
+{}
+
+Normals::Stats Normals::check(const float *pos, float *norm, uint32_t n, bool fix, Isa isa) const
+{
+	if (isa == Isa::BEST) isa = bestIsa();
+
+	Stats s = { 0, 0, 0, 0 };
+	for (uint32_t i = 0; i < n; i += WIDTH) {
+		const float *p = pos + static_cast<size_t>(i) * 9;
+		float *f = norm + static_cast<size_t>(i) * 3;
+		uint32_t k = std::min<uint32_t>(WIDTH, n - i);
+
+		// The tail and unsupported instruction sets go one by one
+		Masks m;
+#ifdef HAVE_AVX2
+		if (k == WIDTH && isa == Isa::AVX2) m = avx8(p, f, m_cos2);
+		else
+#endif
+#ifdef HAVE_SSE
+		if (k == WIDTH && isa == Isa::SSE) {
+			Masks hi = sse4(p + 36, f + 12, m_cos2);
+			m = sse4(p, f, m_cos2);
+			m.bad |= hi.bad << 4;
+			m.missing |= hi.missing << 4;
+			m.degenerate |= hi.degenerate << 4;
+		} else
+#endif
+		m = scalar(p, f, k, m_cos2);
+		if (!(m.bad | m.missing | m.degenerate)) continue;
+
+		s.bad += count(m.bad);
+		s.missing += count(m.missing);
+		s.degenerate += count(m.degenerate);
+
+		// Rare enough to do in double precision
+		for (uint32_t r = m.missing | (fix ? m.bad : 0), j = 0; r; r >>= 1, ++j) {
+			if (!(r & 1)) continue;
+			const float *q = p + j * 9;
+			double e1[3] = { q[3] - q[0], q[4] - q[1], q[5] - q[2] };
+			double e2[3] = { q[6] - q[0], q[7] - q[1], q[8] - q[2] };
+			double c[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			double len = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+			if (!(len > 0)) continue; // Too small for doubles too
+			for (int a = 0; a < 3; ++a) f[j * 3 + a] = static_cast<float>(c[a] / len);
+			++s.replaced;
+		}
+	}
+	return s;
+}
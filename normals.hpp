@@ -0,0 +1,41 @@
+#ifndef NORMALS_HPP
+#define NORMALS_HPP
+#include <cstdint>
+#include "isa.hpp"
+
+class Normals {
+public:
+	/** What a check found. Degenerate triangles have no normal to check
+	 * against, missing normals are zero length and bad ones point too far
+	 * from the computed normal.
+	*/
+	struct Stats {
+		uint32_t bad;
+		uint32_t missing;
+		uint32_t degenerate;
+		uint32_t replaced;
+	};
+
+	/** @param tol Largest angle in degrees between a file normal and the
+	 * computed one that still counts as a match
+	*/
+	explicit Normals(double = 1.0);
+
+	/** Check file normals against the ones computed from the vertices.
+	 * Missing normals are always replaced, bad ones only when asked to.
+	 * @param pos Vertex positions, 9 per triangle
+	 * @param norm File normals, 3 per triangle
+	 * @param n Number of triangles
+	 * @param fix Replace bad normals too
+	 * @param isa Instruction set, SSE checks 4 triangles at a time and
+	 * AVX2 8, all of them give the same results
+	 * @return Counts of what was found
+	*/
+	Stats check(const float *, float *, uint32_t, bool, Isa = Isa::BEST) const;
+
+private:
+	// Instance variables
+	float m_cos2;	// Squared cosine of the tolerance
+};
+
+#endif
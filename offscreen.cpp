@@ -0,0 +1,95 @@
+#include <iostream>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "offscreen.hpp"
+
+Offscreen::Offscreen()
+: m_display(EGL_NO_DISPLAY)
+, m_context(EGL_NO_CONTEXT)
+, m_fbo(0)
+, m_rb()
+, m_width(0)
+, m_height(0)
+{}
+
+Offscreen::~Offscreen()
+{
+	if (m_context != EGL_NO_CONTEXT) {
+		if (m_fbo) {
+			glDeleteFramebuffers(1, &m_fbo);
+			glDeleteRenderbuffers(2, m_rb);
+		}
+		eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(m_display, m_context);
+	}
+	if (m_display != EGL_NO_DISPLAY) eglTerminate(m_display);
+}
+
+bool Offscreen::init(int w, int h)
+{
+	// Surfaceless platform needs neither X nor a GPU
+	auto getDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getDisplay) m_display = getDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (m_display == EGL_NO_DISPLAY) m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+		std::cerr << "Couldn't initialize EGL" << std::endl;
+		return false;
+	}
+
+	// Desktop OpenGL, compatibility profile for the fixed function pipeline
+	const EGLint attr[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config = nullptr;
+	EGLint n = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(m_display, attr, &config, 1, &n)) n = 0;
+
+	m_context = eglCreateContext(m_display, (n > 0 ? config : nullptr), EGL_NO_CONTEXT, nullptr);
+	if (m_context == EGL_NO_CONTEXT
+	|| !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+		std::cerr << "Couldn't create an OpenGL context" << std::endl;
+		return false;
+	}
+
+	// GLEW only knows how to look for a GLX display, which we don't need
+	GLenum err = glewInit();
+	if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY) {
+		std::cerr << "Error initializing OpenGL: " << glewGetErrorString(err) << std::endl;
+		return false;
+	}
+
+	// Render to a framebuffer object instead of a window
+	m_width = w;
+	m_height = h;
+	glGenFramebuffers(1, &m_fbo);
+	glGenRenderbuffers(2, m_rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_rb[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_rb[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_rb[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_rb[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Couldn't create a " << w << "x" << h << " framebuffer" << std::endl;
+		return false;
+	}
+
+	glViewport(0, 0, w, h);
+	return true;
+}
+
+Image Offscreen::read() const
+{
+	Image img(m_width, m_height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, img.data());
+	img.flip();
+	return img;
+}
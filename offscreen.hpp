@@ -0,0 +1,38 @@
+#ifndef OFFSCREEN_HPP
+#define OFFSCREEN_HPP
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include "image.hpp"
+
+class Offscreen {
+public:
+	Offscreen();
+	~Offscreen();
+
+	Offscreen(const Offscreen&) = delete;
+	Offscreen& operator=(const Offscreen&) = delete;
+
+	/** Create an OpenGL context without a window or display server
+	 * (EGL surfaceless) and make a framebuffer of a given size current.
+	 * @param w Width in pixels
+	 * @param h Height in pixels
+	 * @return True on success, false otherwise
+	*/
+	bool init(int, int);
+
+	/** Read back the framebuffer.
+	 * @return Image with the rows in top to bottom order
+	*/
+	Image read() const;
+
+private:
+	// Instance variables
+	EGLDisplay m_display;
+	EGLContext m_context;
+	GLuint m_fbo;
+	GLuint m_rb[2];		// Color and depth renderbuffers
+	int m_width;
+	int m_height;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <algorithm>
+#include "pacer.hpp"
+
+namespace {
+
+int64_t ticks()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+Pacer::Pacer(double fps)
+: m_interval(0)
+, m_last(-1)
+, m_due(0)
+, m_merged(0)
+, m_waiting(false)
+, m_stats()
+{
+	setRate(fps);
+}
+
+void Pacer::setRate(double fps)
+{
+	m_interval = (fps > 0 ? static_cast<int64_t>(1e9 / fps) : 0);
+}
+
+double Pacer::getRate() const
+{
+	return (m_interval > 0 ? 1e9 / static_cast<double>(m_interval) : 0);
+}
+
+int Pacer::request()
+{
+	++m_stats.requests;
+	++m_merged;
+	if (m_waiting) {
+		++m_stats.coalesced;
+		return -1;
+	}
+
+	// Wait out the rest of the interval since the last frame, and count
+	// anything past it as idle
+	int64_t t = ticks();
+	int64_t next = (m_last >= 0 ? m_last + m_interval : t);
+	if (m_last >= 0 && t > next) m_stats.idle += static_cast<double>(t - next) / 1e9;
+	m_due = std::max(t, next);
+	m_waiting = true;
+	return static_cast<int>((m_due - t + 999999) / 1000000);
+}
+
+bool Pacer::waiting() const
+{
+	return m_waiting;
+}
+
+uint32_t Pacer::frame()
+{
+	// Frames the window system asks for (e.g. after being uncovered)
+	// answer whatever was waiting as well
+	int64_t t = ticks();
+	if (m_waiting && t - m_due > std::max<int64_t>(m_interval, 1000000)) ++m_stats.late;
+	++m_stats.frames;
+	m_last = t;
+	m_waiting = false;
+	uint32_t n = m_merged;
+	m_merged = 0;
+	return n;
+}
+
+const Pacer::Stats& Pacer::getStats() const
+{
+	return m_stats;
+}
@@ -0,0 +1,65 @@
+#ifndef PACER_HPP
+#define PACER_HPP
+#include <cstdint>
+
+class Pacer {
+public:
+	/** What the pacer has seen since it was created.
+	*/
+	struct Stats {
+		uint64_t frames;	// Drawn
+		uint64_t requests;	// Redraws asked for, by input or loading
+		uint64_t coalesced;	// Requests merged into a frame already waiting
+		uint64_t late;		// Frames drawn over an interval after they were due
+		double idle;		// Seconds with nothing to draw
+	};
+
+	/** @param fps Most frames per second, 0 for no limit
+	*/
+	explicit Pacer(double = 60);
+
+	/** Set the most frames drawn per second, e.g. the display's refresh
+	 * rate so no frame is drawn that would never be shown.
+	 * @param fps Frames per second, 0 for no limit
+	*/
+	void setRate(double);
+
+	/** Get the most frames drawn per second.
+	 * @return Frames per second, 0 if there's no limit
+	*/
+	double getRate() const;
+
+	/** Ask for a frame because something changed. Requests made while a
+	 * frame is waiting are merged into it, so a burst of input costs a
+	 * single frame, and nothing is drawn while nothing changes.
+	 * @return Milliseconds until the frame should be drawn, or -1 if one
+	 * is already waiting
+	*/
+	int request();
+
+	/** Check if a requested frame hasn't been drawn yet.
+	 * @return True if a frame is waiting
+	*/
+	bool waiting() const;
+
+	/** Mark the start of a frame.
+	 * @return Number of requests the frame answers
+	*/
+	uint32_t frame();
+
+	/** Get the counters.
+	 * @return Stats since creation
+	*/
+	const Stats& getStats() const;
+
+private:
+	// Instance variables
+	int64_t m_interval;	// Shortest time between frames, nanoseconds
+	int64_t m_last;		// Start of the last frame, -1 before the first
+	int64_t m_due;		// When the waiting frame should start
+	uint32_t m_merged;	// Requests since the last frame
+	bool m_waiting;
+	Stats m_stats;
+};
+
+#endif
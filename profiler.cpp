@@ -0,0 +1,210 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include "profiler.hpp"
+#define MAX_EVENTS (1u << 20)	// Events kept for write()
+#define SMOOTHING 0.05		// Weight of a new frame in the averages
+
+namespace {
+
+int64_t ticks()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** Quote a string for JSON or CSV, names are plain identifiers anyway.
+*/
+std::string quote(const char *s)
+{
+	std::string out = "\"";
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\') out += '\\';
+		out += *s;
+	}
+	return out + '"';
+}
+
+} // namespace
+
+Profiler::Scope::Scope(const char *name, const char *cat)
+: m_name(name)
+, m_cat(cat)
+, m_start(Profiler::shared().now())
+{}
+
+Profiler::Scope::~Scope()
+{
+	Profiler& p = Profiler::shared();
+	p.record(m_name, m_cat, m_start, p.now() - m_start);
+}
+
+Profiler::Profiler()
+: m_origin(ticks())
+, m_last(-1)
+, m_mutex()
+, m_events()
+, m_stats()
+, m_index()
+, m_threads()
+, m_record(false)
+, m_dropped(false)
+, m_gpu(0)
+, m_query()
+, m_gpuStart()
+, m_pending()
+, m_slot(-1)
+, m_next(0)
+{}
+
+void Profiler::record(const char *name, const char *cat, int64_t start, int64_t dur)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto t = m_threads.emplace(std::this_thread::get_id(), static_cast<uint32_t>(m_threads.size() + 1));
+	add({ name, cat, 'X', t.first->second, start, dur, 0 });
+}
+
+void Profiler::counter(const char *name, double v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto t = m_threads.emplace(std::this_thread::get_id(), static_cast<uint32_t>(m_threads.size() + 1));
+	add({ name, "frame", 'C', t.first->second, now(), 0, v });
+}
+
+void Profiler::add(const Event& e)
+{
+	if (m_record) {
+		if (m_events.size() < MAX_EVENTS) m_events.push_back(e);
+		else m_dropped = true;
+	}
+
+	auto it = m_index.find(e.name);
+	if (it == m_index.end()) {
+		it = m_index.emplace(e.name, m_stats.size()).first;
+		double v = (e.type == 'C' ? e.value : static_cast<double>(e.dur) / 1e3);
+		m_stats.push_back({ e.name, e.cat, v, e.type == 'C' });
+		return;
+	}
+
+	// Frames are averaged, everything else adds up
+	Stat& s = m_stats[it->second];
+	if (e.type == 'C') s.value = e.value;
+	else if (s.cat == "frame") s.value += (static_cast<double>(e.dur) / 1e3 - s.value) * SMOOTHING;
+	else s.value += static_cast<double>(e.dur) / 1e3;
+}
+
+void Profiler::frame()
+{
+	int64_t t = now();
+	if (m_last >= 0) {
+		record("frame", "frame", m_last, t - m_last);
+		counter("fps", 1e6 / static_cast<double>(std::max<int64_t>(t - m_last, 1)));
+	}
+	m_last = t;
+}
+
+void Profiler::beginGpu()
+{
+	if (m_gpu == 0) {
+		m_gpu = (GLEW_ARB_timer_query || GLEW_VERSION_3_3 ? 1 : -1);
+		if (m_gpu > 0) glGenQueries(4, m_query);
+	}
+	if (m_gpu < 0) return;
+
+	collect();
+	m_slot = (m_pending[m_next] ? -1 : m_next);
+	if (m_slot < 0) return;
+	m_gpuStart[m_slot] = now();
+	glBeginQuery(GL_TIME_ELAPSED, m_query[m_slot]);
+}
+
+void Profiler::endGpu()
+{
+	if (m_gpu < 0 || m_slot < 0) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	m_pending[m_slot] = true;
+	m_next = (m_slot + 1) % 4;
+	m_slot = -1;
+}
+
+void Profiler::collect()
+{
+	// Queries finish in order, so stop at the first one that hasn't
+	for (int i = 0; i < 4; ++i) {
+		int q = (m_next + i) % 4;
+		if (!m_pending[q]) continue;
+
+		GLint ready = 0;
+		glGetQueryObjectiv(m_query[q], GL_QUERY_RESULT_AVAILABLE, &ready);
+		if (!ready) break;
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(m_query[q], GL_QUERY_RESULT, &ns);
+		m_pending[q] = false;
+
+		// Some drivers count the work since the context was created in
+		// the very first query
+		if (m_gpu == 1) {
+			m_gpu = 2;
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		add({ "gpu draw", "frame", 'X', 0, m_gpuStart[q], static_cast<int64_t>(ns / 1000), 0 });
+	}
+}
+
+void Profiler::setRecording(bool b)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_record = b;
+}
+
+bool Profiler::write(std::string f) const
+{
+	std::ofstream os(f);
+	if (!os) {
+		std::cerr << "Couldn't write " << f << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool json = f.size() >= 5 && !f.compare(f.size() - 5, 5, ".json");
+	if (json) {
+		os << "{\"traceEvents\":[\n";
+		os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+		for (const Event& e : m_events) {
+			os << ",\n{\"name\":" << quote(e.name) << ",\"cat\":" << quote(e.cat) << ",\"ph\":\"" << e.type
+				<< "\",\"pid\":1,\"tid\":" << e.thread << ",\"ts\":" << e.start;
+			if (e.type == 'X') os << ",\"dur\":" << e.dur << "}";
+			else os << ",\"args\":{\"value\":" << e.value << "}}";
+		}
+		os << "\n]}\n";
+	} else {
+		os << "name,category,thread,start_us,duration_us,value\n";
+		for (const Event& e : m_events) {
+			os << quote(e.name) << "," << quote(e.cat) << "," << e.thread << "," << e.start << ","
+				<< e.dur << "," << e.value << "\n";
+		}
+	}
+
+	if (m_dropped) std::cerr << "Warning: Only the first " << MAX_EVENTS << " events were kept" << std::endl;
+	return os.good();
+}
+
+std::vector<Profiler::Stat> Profiler::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+int64_t Profiler::now() const
+{
+	return (ticks() - m_origin) / 1000;
+}
+
+Profiler& Profiler::shared()
+{
+	static Profiler profiler;
+	return profiler;
+}
@@ -0,0 +1,141 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <GL/glew.h>
+
+class Profiler {
+public:
+	/** Times the enclosing scope on the CPU.
+	*/
+	class Scope {
+	public:
+		/** @param name Stage name, must outlive the profiler
+		 * @param cat Category, "frame" stages are averaged while the
+		 * others are summed, e.g. "load"
+		*/
+		Scope(const char *, const char * = "frame");
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char *m_name;
+		const char *m_cat;
+		int64_t m_start;
+	};
+
+	/** One line of the overlay.
+	*/
+	struct Stat {
+		std::string name;
+		std::string cat;
+		double value;	// Milliseconds, or the count for counters
+		bool counter;
+	};
+
+	Profiler();
+
+	/** Record a finished stage.
+	 * @param name Stage name, must outlive the profiler
+	 * @param cat Category
+	 * @param start Start time from now()
+	 * @param dur Duration in microseconds
+	*/
+	void record(const char *, const char *, int64_t, int64_t);
+
+	/** Record the value of a counter, e.g. triangles drawn.
+	 * @param name Counter name, must outlive the profiler
+	 * @param v Value
+	*/
+	void counter(const char *, double);
+
+	/** Mark the start of a frame, recording the time since the last one.
+	*/
+	void frame();
+
+	/** Start timing GPU work with a timer query. Results are read a few
+	 * frames later so the CPU never waits for the GPU, and frames are
+	 * skipped while every query is still in flight. Only call this on
+	 * the thread owning the OpenGL context.
+	*/
+	void beginGpu();
+
+	/** Stop timing GPU work.
+	*/
+	void endGpu();
+
+	/** Choose whether every event is kept for write(). Only averages
+	 * and totals are kept otherwise.
+	 * @param b True to keep events
+	*/
+	void setRecording(bool);
+
+	/** Write the recorded events.
+	 * @param f Filename, a Chrome trace (about:tracing) if it ends in
+	 * `.json` and CSV otherwise
+	 * @return True on success, false otherwise
+	*/
+	bool write(std::string) const;
+
+	/** Get averaged frame stages, summed load stages and counters.
+	 * @return Stats in the order they were first seen
+	*/
+	std::vector<Stat> getStats() const;
+
+	/** Get the time since the profiler was created.
+	 * @return Microseconds
+	*/
+	int64_t now() const;
+
+	/** Get the profiler shared by the whole program.
+	 * @return Shared profiler
+	*/
+	static Profiler& shared();
+
+private:
+	/** A stage (X) or counter (C) event, as in Chrome traces.
+	*/
+	struct Event {
+		const char *name;
+		const char *cat;
+		char type;
+		uint32_t thread;	// 0 is the GPU
+		int64_t start;
+		int64_t dur;
+		double value;
+	};
+
+	/** Add an event and update its stat. Must hold m_mutex.
+	 * @param e Event
+	*/
+	void add(const Event&);
+
+	/** Record the GPU timings that are ready.
+	*/
+	void collect();
+
+	// Instance variables
+	int64_t m_origin;	// Creation time, steady clock nanoseconds
+	int64_t m_last;		// Start of the current frame
+	mutable std::mutex m_mutex;
+	std::vector<Event> m_events;
+	std::vector<Stat> m_stats;
+	std::map<std::string, size_t> m_index;	// Stat of each name
+	std::map<std::thread::id, uint32_t> m_threads;
+	bool m_record;
+	bool m_dropped;		// Events were lost to the size limit
+	int m_gpu;		// -1 without timer queries, 1 once created, 2 after the first result
+	GLuint m_query[4];
+	int64_t m_gpuStart[4];
+	bool m_pending[4];
+	int m_slot;		// Query used by the current frame, -1 if none
+	int m_next;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "progressive.hpp"
+#include "profiler.hpp"
+#define FIRST_CHUNK 16384	// Records in the first preview chunk, later ones double
+#define LAST_CHUNK 1048576	// Records in the largest preview chunk
+#define QUEUE 4			// Chunks converted ahead of the display
+
+Progressive::Progressive()
+: m_thread()
+, m_mutex()
+, m_cv()
+, m_queue()
+, m_full()
+, m_options()
+, m_loader(Solid::Loader::STREAM)
+, m_ready(false)
+, m_finished(true)
+, m_ok(false)
+, m_stop(false)
+, m_built(false)
+, m_done(true)
+, m_warn(false)
+{}
+
+Progressive::~Progressive()
+{
+	stop();
+}
+
+void Progressive::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable()) m_thread.join();
+}
+
+void Progressive::start(std::string f, Solid::Loader l, const Solid::Options& o)
+{
+	if (m_thread.joinable()) m_thread.join();
+	m_queue.clear();
+	m_full = Solid();
+	m_full.setOptions(o);
+	m_options = o;
+	m_loader = l;
+	m_ready = m_ok = m_stop = m_built = m_warn = false;
+	m_finished = m_done = false;
+	m_thread = std::thread(&Progressive::run, this, f, l);
+}
+
+void Progressive::run(std::string f, Solid::Loader l)
+{
+	bool ok;
+	if (l == Solid::Loader::CHUNKED) {
+		// Text files can't be streamed, read them whole instead
+		ok = preview(f);
+		std::unique_lock<std::mutex> lock(m_mutex);
+		bool stop = m_stop;
+		lock.unlock();
+		if (!ok && !stop) {
+			m_loader = Solid::Loader::MMAP;
+			ok = m_full.load(f, m_loader);
+		}
+	} else if (m_full.isCached(f)) {
+		// A cached solid is ready sooner than any preview
+		ok = m_full.load(f, l);
+	} else {
+		// Stream the preview while the full solid is built, it stops once
+		// that's done
+		std::thread stream([this, f] { preview(f); });
+		ok = m_full.load(f, l);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_built = true;
+		}
+		m_cv.notify_all();
+		stream.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_ready = ok && m_loader != Solid::Loader::CHUNKED;
+	m_finished = true;
+	m_ok = ok;
+}
+
+bool Progressive::preview(std::string f)
+{
+	Solid conv;
+	conv.setOptions(m_options);
+	std::ifstream is(f, std::ifstream::binary);
+	uint32_t n = 0;
+	if (!is || !conv.readHeader(is, n)) return false;
+
+	// Queued chunks count against the chunked loader's budget
+	size_t per = FIRST_CHUNK, last = LAST_CHUNK;
+	if (m_loader == Solid::Loader::CHUNKED) {
+		last = std::max<size_t>(m_options.budget / QUEUE / (50 + 48 + 8 + 48), 1024);
+		per = std::min(per, last);
+	}
+	for (uint32_t done = 0; done < n;) {
+		uint32_t k = static_cast<uint32_t>(std::min<size_t>(per, n - done));
+		std::vector<char> raw(static_cast<size_t>(k) * 50);
+		is.read(raw.data(), static_cast<std::streamsize>(raw.size()));
+		if (is.gcount() != static_cast<std::streamsize>(raw.size())) return false;
+
+		// Convert here, so the display thread only uploads
+		Solid::Prepared c;
+		{
+			Profiler::Scope p("prepare", "load");
+			conv.prepare(raw.data(), k, c);
+		}
+
+		// Wait for the display to catch up
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this] { return m_queue.size() < QUEUE || m_stop || m_built; });
+		if (m_stop || m_built) return false;
+		m_queue.push_back(std::move(c));
+		lock.unlock();
+
+		done += k;
+		per = std::min(per * 2, last);
+	}
+	return true;
+}
+
+bool Progressive::poll(Solid& s)
+{
+	if (m_done) return false;
+
+	// Take one chunk, unless the full solid replaces them anyway
+	Solid::Prepared c;
+	bool chunk = false, ready, finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ready = m_ready;
+		if (ready) {
+			m_queue.clear();
+		} else if (!m_queue.empty()) {
+			c = std::move(m_queue.front());
+			m_queue.pop_front();
+			chunk = true;
+		}
+		finished = m_finished && m_queue.empty();
+	}
+	m_cv.notify_all();
+
+	bool changed = false;
+	if (chunk) {
+		Profiler::Scope p("append", "load");
+		if (!s.append(c)) m_warn = true;
+		changed = true;
+	}
+
+	if (ready) {
+		// Swap the preview for the full solid, keeping the display settings
+		Profiler::Scope p("upload", "load");
+		if (s.getLight() != m_full.getLight()) m_full.toggleLight();
+		if (s.getSmooth() != m_full.getSmooth()) m_full.toggleSmooth();
+		s = std::move(m_full);
+		s.upload();
+		m_full = Solid();
+		changed = true;
+	} else if (finished && m_loader == Solid::Loader::CHUNKED && m_ok) {
+		std::cout << "File streamed OK (" << s.size() << " polygons)" << std::endl;
+		if (m_warn) std::cerr << "Warning: File may be corrupt (bad normals)" << std::endl;
+	}
+
+	if (finished) {
+		m_thread.join();
+		m_done = true;
+	}
+	return changed;
+}
+
+bool Progressive::done() const
+{
+	return m_done;
+}
+
+bool Progressive::failed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_finished && !m_ok;
+}
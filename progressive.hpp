@@ -0,0 +1,88 @@
+#ifndef PROGRESSIVE_HPP
+#define PROGRESSIVE_HPP
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "solid.hpp"
+
+class Progressive {
+public:
+	Progressive();
+
+	/** Wait for the loading thread to finish.
+	*/
+	~Progressive();
+
+	Progressive(const Progressive&) = delete;
+	Progressive& operator=(const Progressive&) = delete;
+
+	/** Start reading a file on a background thread. Binary files that
+	 * aren't cached are streamed as preview chunks on another thread, at
+	 * the same time as the full solid is built.
+	 * @param f Filename
+	 * @param l Loader; with the chunked loader the preview is all there is
+	 * @param o Options the file is read with, e.g. weld distance
+	*/
+	void start(std::string, Solid::Loader, const Solid::Options&);
+
+	/** Stop streaming and wait for the loading thread, e.g. when quitting.
+	 * The full solid being built still finishes. Must be called before the
+	 * shared thread pool is destroyed.
+	*/
+	void stop();
+
+	/** Hand over what arrived since the last call: the oldest preview
+	 * chunk is uploaded, at most one per call so the window stays
+	 * responsive, and the full solid replaces them once it's ready. Must
+	 * be called on the thread owning the OpenGL context.
+	 * @param s Solid being displayed
+	 * @return True if the solid changed
+	*/
+	bool poll(Solid&);
+
+	/** Check if everything has been handed over.
+	 * @return True when loading is over
+	*/
+	bool done() const;
+
+	/** Check if the file couldn't be read.
+	 * @return True if loading failed
+	*/
+	bool failed() const;
+
+private:
+	/** Loading thread main.
+	 * @param f Filename
+	 * @param l Loader
+	*/
+	void run(std::string, Solid::Loader);
+
+	/** Stream the records of a binary file to the queue, converted for
+	 * upload, until the full solid is built.
+	 * @param f Filename
+	 * @return False if the file isn't binary, can't be read, or the
+	 * preview was cut short
+	*/
+	bool preview(std::string);
+
+	// Instance variables
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<Solid::Prepared> m_queue;	// Chunks waiting for upload
+	Solid m_full;
+	Solid::Options m_options;	// What m_full is read with
+	Solid::Loader m_loader;
+	bool m_ready;	// m_full can be handed over
+	bool m_finished;	// Loading thread is done
+	bool m_ok;
+	bool m_stop;
+	bool m_built;	// m_full is loaded, the preview can stop
+	bool m_done;
+	bool m_warn;	// Some preview normal was wrong
+};
+
+#endif
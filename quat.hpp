@@ -0,0 +1,113 @@
+#ifndef QUAT_HPP
+#define QUAT_HPP
+#include <cmath>
+#include "vector3.hpp"
+#include "vec3f.hpp"
+
+class Quat {
+public:
+	// Constructors, the default is no rotation
+	constexpr Quat() : w(1), x(0), y(0), z(0) {}
+	constexpr Quat(double w, double x, double y, double z) : w(w), x(x), y(y), z(z) {}
+
+	/** Create a rotation around an axis.
+	 * @param v Axis, doesn't have to be normalized
+	 * @param a Angle (rad), counter-clockwise looking down the axis
+	 * @return Unit quaternion
+	*/
+	static Quat axisAngle(const Vector3& v, double a)
+	{
+		double s = std::sin(a / 2) / v.mag();
+		return Quat(std::cos(a / 2), v.x * s, v.y * s, v.z * s);
+	}
+
+	/** Create the shortest rotation taking one direction to another.
+	 * @param a Unit vector to start from
+	 * @param b Unit vector to end at
+	 * @return Unit quaternion, no rotation if a & b are opposite
+	*/
+	static Quat between(const Vector3& a, const Vector3& b)
+	{
+		// Half way between no rotation and twice the angle
+		Vector3 c = a.cross(b);
+		double w = 1 + a.dot(b);
+		if (w <= 1e-12) return Quat();
+		return Quat(w, c.x, c.y, c.z).norm();
+	}
+
+	/** Combine two rotations.
+	 * @param o Rotation applied first
+	 * @return Rotation by o, then by this
+	*/
+	constexpr Quat operator*(const Quat& o) const
+	{
+		return Quat(
+			w * o.w - x * o.x - y * o.y - z * o.z,
+			w * o.x + x * o.w + y * o.z - z * o.y,
+			w * o.y - x * o.z + y * o.w + z * o.x,
+			w * o.z + x * o.y - y * o.x + z * o.w
+		);
+	}
+
+	/** Get the opposite rotation of a unit quaternion.
+	 * @return Conjugate
+	*/
+	constexpr Quat conjugate() const
+	{
+		return Quat(w, -x, -y, -z);
+	}
+
+	/** Calculate the dot product, the cosine of half the angle between
+	 * two unit quaternions.
+	 * @param o Other quaternion
+	 * @return Dot product
+	*/
+	constexpr double dot(const Quat& o) const
+	{
+		return w * o.w + x * o.x + y * o.y + z * o.z;
+	}
+
+	/** Scale to unit length, e.g. after many products have added up
+	 * rounding errors.
+	 * @return Unit quaternion
+	*/
+	Quat norm() const
+	{
+		double l = std::sqrt(dot(*this));
+		return Quat(w / l, x / l, y / l, z / l);
+	}
+
+	/** Rotate a vector by a unit quaternion.
+	 * @param v Vector
+	 * @return Rotated vector
+	*/
+	Vector3 rotate(const Vector3& v) const
+	{
+		// v + 2w (u x v) + 2 u x (u x v), with u the vector part
+		double tx = 2 * (y * v.z - z * v.y), ty = 2 * (z * v.x - x * v.z), tz = 2 * (x * v.y - y * v.x);
+		return Vector3(
+			v.x + w * tx + y * tz - z * ty,
+			v.y + w * ty + z * tx - x * tz,
+			v.z + w * tz + x * ty - y * tx
+		);
+	}
+
+	/** Rotate a single precision vector by a unit quaternion.
+	 * @param v Vector
+	 * @return Rotated vector
+	*/
+	constexpr Vec3f rotate(const Vec3f& v) const
+	{
+		double tx = 2 * (y * v.z - z * v.y), ty = 2 * (z * v.x - x * v.z), tz = 2 * (x * v.y - y * v.x);
+		return Vec3f(
+			static_cast<float>(v.x + w * tx + y * tz - z * ty),
+			static_cast<float>(v.y + w * ty + z * tx - x * tz),
+			static_cast<float>(v.z + w * tz + x * ty - y * tx)
+		);
+	}
+
+	// Instance variables
+	double w, x, y, z;
+};
+
+#endif
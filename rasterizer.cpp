@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "rasterizer.hpp"
+#include "threadpool.hpp"
+#include "mat4.hpp"
+#define TILE 64 // Tile size in pixels, a multiple of 4
+
+namespace {
+
+/** Coefficients of the edge function E(x, y) = a * x + b * y + c for the
+ * edge from (x0, y0) to (x1, y1), positive on the inside.
+*/
+struct Edge {
+	Edge(float x0, float y0, float x1, float y1)
+	: a(y0 - y1)
+	, b(x1 - x0)
+	, c(x0 * y1 - x1 * y0)
+	, tl(a > 0 || (a == 0 && b > 0)) // Top-left fill rule
+	{}
+
+	float a, b, c;
+	bool tl;
+};
+
+} // namespace
+
+Rasterizer::Rasterizer(int w, int h)
+: m_width(std::max(w, 1))
+, m_height(std::max(h, 1))
+, m_stride((m_width + 3) & ~3)
+, m_tilesX((m_width + TILE - 1) / TILE)
+, m_tilesY((m_height + TILE - 1) / TILE)
+, m_color(m_width, m_height)
+, m_depth(static_cast<size_t>(m_stride) * static_cast<size_t>(m_height), 1.f)
+, m_bins(static_cast<size_t>(m_tilesX * m_tilesY))
+{}
+
+const Image& Rasterizer::getImage() const
+{
+	return m_color;
+}
+
+void Rasterizer::render(const Solid& s, const Camera& c, bool lit)
+{
+	ThreadPool& pool = ThreadPool::shared();
+
+	// Clear to the same values OpenGL uses
+	memset(m_color.data(), 0, static_cast<size_t>(m_width) * static_cast<size_t>(m_height) * 3);
+	std::fill(m_depth.begin(), m_depth.end(), 1.f);
+	m_tris.clear();
+	for (std::vector<uint32_t>& b : m_bins) b.clear();
+
+	const float *vert = s.getVertices();
+	const float *norm = s.getVertexNormals();
+	const uint32_t *elem = s.getIndices();
+	if (!vert || !elem) return;
+
+	// Vertices to clip space
+	double p[16], mv[16];
+	c.getProjection(p);
+	c.getModelView(s, mv);
+	Mat4 mvp = Mat4(p) * Mat4(mv);
+
+	std::vector<float> clip(static_cast<size_t>(s.vertexCount()) * 4);
+	pool.parallelFor(s.vertexCount(), [&](size_t b, size_t e, size_t) {
+		mvp.project(vert + b * 3, &clip[b * 4], e - b);
+	});
+
+	// Shade & set up triangles, keeping submission order per chunk
+	const double *rot = c.getRotation();
+	std::vector<std::vector<Setup>> parts(pool.chunks(s.size()));
+	pool.parallelFor(s.size(), [&](size_t b, size_t e, size_t k) {
+		for (size_t i = b; i < e; ++i) {
+			const uint32_t *t = elem + i * 3;
+			uint8_t shade = 255;
+			if (lit) {
+				// Ambient 0.2 * 0.2 + diffuse 0.8 from light 0 at (0, 0, -1)
+				const float *n = norm + static_cast<size_t>(t[2]) * 3;
+				double z = rot[2] * n[0] + rot[6] * n[1] + rot[10] * n[2];
+				double l = 0.04 + 0.8 * std::max(0.0, -z);
+				shade = static_cast<uint8_t>(std::lround(std::min(l, 1.0) * 255));
+			}
+			const float *v[3] = { &clip[t[0] * 4], &clip[t[1] * 4], &clip[t[2] * 4] };
+			setup(v, shade, parts[k]);
+		}
+	});
+	for (const std::vector<Setup>& part : parts) m_tris.insert(m_tris.end(), part.begin(), part.end());
+
+	// Bin triangles to every tile their bounding box touches
+	for (uint32_t i = 0; i < m_tris.size(); ++i) {
+		const Setup& t = m_tris[i];
+		for (int ty = t.miny / TILE; ty <= t.maxy / TILE; ++ty) {
+			for (int tx = t.minx / TILE; tx <= t.maxx / TILE; ++tx) {
+				m_bins[static_cast<size_t>(ty * m_tilesX + tx)].push_back(i);
+			}
+		}
+	}
+
+	// Tiles don't overlap, so they need no locking
+	pool.parallelFor(m_bins.size(), [&](size_t b, size_t e, size_t) {
+		for (size_t t = b; t < e; ++t) raster(t);
+	}, 1);
+}
+
+void Rasterizer::setup(const float *const *v, uint8_t shade, std::vector<Setup>& out) const
+{
+	// Reject triangles entirely outside one of the clip planes
+	for (int a = 0; a < 3; ++a) {
+		if (v[0][a] > v[0][3] && v[1][a] > v[1][3] && v[2][a] > v[2][3]) return;
+		if (v[0][a] < -v[0][3] && v[1][a] < -v[1][3] && v[2][a] < -v[2][3]) return;
+	}
+
+	// Clip against the near plane (z >= -w), giving up to 4 vertices
+	float poly[4][4];
+	int n = 0;
+	for (int i = 0; i < 3; ++i) {
+		const float *a = v[i];
+		const float *b = v[(i + 1) % 3];
+		float da = a[2] + a[3];
+		float db = b[2] + b[3];
+		if (da >= 0) memcpy(poly[n++], a, 4 * sizeof(float));
+		if ((da >= 0) != (db >= 0)) {
+			float t = da / (da - db);
+			for (int j = 0; j < 4; ++j) poly[n][j] = a[j] + t * (b[j] - a[j]);
+			++n;
+		}
+	}
+
+	// Project to screen space
+	float sx[4], sy[4], sz[4];
+	for (int i = 0; i < n; ++i) {
+		float w = poly[i][3];
+		if (w <= 0) return;
+		sx[i] = (poly[i][0] / w + 1.f) * 0.5f * static_cast<float>(m_width);
+		sy[i] = (1.f - poly[i][1] / w) * 0.5f * static_cast<float>(m_height);
+		sz[i] = (poly[i][2] / w + 1.f) * 0.5f;
+	}
+
+	// Fan out into triangles
+	for (int i = 1; i + 1 < n; ++i) {
+		Setup t;
+		int idx[3] = { 0, i, i + 1 };
+		for (int j = 0; j < 3; ++j) {
+			t.x[j] = sx[idx[j]];
+			t.y[j] = sy[idx[j]];
+			t.z[j] = sz[idx[j]];
+		}
+
+		// No culling, so make every triangle wind the same way
+		float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+		if (area == 0 || std::isnan(area)) continue;
+		if (area < 0) {
+			std::swap(t.x[1], t.x[2]);
+			std::swap(t.y[1], t.y[2]);
+			std::swap(t.z[1], t.z[2]);
+		}
+
+		float x0 = std::min({ t.x[0], t.x[1], t.x[2] });
+		float x1 = std::max({ t.x[0], t.x[1], t.x[2] });
+		float y0 = std::min({ t.y[0], t.y[1], t.y[2] });
+		float y1 = std::max({ t.y[0], t.y[1], t.y[2] });
+		t.minx = std::max(0, static_cast<int>(std::floor(x0 - 0.5f)));
+		t.miny = std::max(0, static_cast<int>(std::floor(y0 - 0.5f)));
+		t.maxx = std::min(m_width - 1, static_cast<int>(std::ceil(x1)));
+		t.maxy = std::min(m_height - 1, static_cast<int>(std::ceil(y1)));
+		if (t.minx > t.maxx || t.miny > t.maxy) continue;
+
+		t.shade = shade;
+		out.push_back(t);
+	}
+}
+
+void Rasterizer::raster(size_t tile)
+{
+	int x0 = static_cast<int>(tile % static_cast<size_t>(m_tilesX)) * TILE;
+	int y0 = static_cast<int>(tile / static_cast<size_t>(m_tilesX)) * TILE;
+	int x1 = std::min(x0 + TILE, m_width);
+	int y1 = std::min(y0 + TILE, m_height);
+	uint8_t *color = m_color.data();
+
+	for (uint32_t id : m_bins[tile]) {
+		const Setup& t = m_tris[id];
+		Edge e0(t.x[1], t.y[1], t.x[2], t.y[2]);
+		Edge e1(t.x[2], t.y[2], t.x[0], t.y[0]);
+		Edge e2(t.x[0], t.y[0], t.x[1], t.y[1]);
+
+		// Depth is linear in screen space: z = za * x + zb * y + zc
+		float area = e2.a * t.x[2] + e2.b * t.y[2] + e2.c;
+		float d1 = (t.z[1] - t.z[0]) / area;
+		float d2 = (t.z[2] - t.z[0]) / area;
+		float za = e1.a * d1 + e2.a * d2;
+		float zb = e1.b * d1 + e2.b * d2;
+		float zc = t.z[0] + e1.c * d1 + e2.c * d2;
+
+		int ys = std::max(y0, t.miny), ye = std::min(y1 - 1, t.maxy);
+		int xs = std::max(x0, t.minx) & ~3, xe = std::min(x1 - 1, t.maxx);
+		for (int y = ys; y <= ye; ++y) {
+			float cy = static_cast<float>(y) + 0.5f;
+			float *depth = &m_depth[static_cast<size_t>(y) * static_cast<size_t>(m_stride)];
+			uint8_t *row = color + static_cast<size_t>(y) * static_cast<size_t>(m_width) * 3;
+
+#ifdef __SSE2__
+			// Four pixels at a time
+			const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.f);
+			const __m128 r0 = _mm_set1_ps(e0.b * cy + e0.c), a0 = _mm_set1_ps(e0.a);
+			const __m128 r1 = _mm_set1_ps(e1.b * cy + e1.c), a1 = _mm_set1_ps(e1.a);
+			const __m128 r2 = _mm_set1_ps(e2.b * cy + e2.c), a2 = _mm_set1_ps(e2.a);
+			const __m128 rz = _mm_set1_ps(zb * cy + zc), az = _mm_set1_ps(za);
+			const __m128 tl0 = _mm_castsi128_ps(_mm_set1_epi32(e0.tl ? -1 : 0));
+			const __m128 tl1 = _mm_castsi128_ps(_mm_set1_epi32(e1.tl ? -1 : 0));
+			const __m128 tl2 = _mm_castsi128_ps(_mm_set1_epi32(e2.tl ? -1 : 0));
+			for (int x = xs; x <= xe; x += 4) {
+				__m128 cx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lane);
+				__m128 w0 = _mm_add_ps(_mm_mul_ps(a0, cx), r0);
+				__m128 w1 = _mm_add_ps(_mm_mul_ps(a1, cx), r1);
+				__m128 w2 = _mm_add_ps(_mm_mul_ps(a2, cx), r2);
+
+				// Inside if E > 0, or E == 0 on a top-left edge
+				__m128 in = _mm_or_ps(_mm_cmpgt_ps(w0, zero), _mm_and_ps(_mm_cmpeq_ps(w0, zero), tl0));
+				in = _mm_and_ps(in, _mm_or_ps(_mm_cmpgt_ps(w1, zero), _mm_and_ps(_mm_cmpeq_ps(w1, zero), tl1)));
+				in = _mm_and_ps(in, _mm_or_ps(_mm_cmpgt_ps(w2, zero), _mm_and_ps(_mm_cmpeq_ps(w2, zero), tl2)));
+				if (!_mm_movemask_ps(in)) continue;
+
+				// Depth test (GL_LESS) & far/near clipping
+				__m128 z = _mm_add_ps(_mm_mul_ps(az, cx), rz);
+				__m128 old = _mm_loadu_ps(depth + x);
+				in = _mm_and_ps(in, _mm_cmplt_ps(z, old));
+				in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one)));
+
+				int mask = _mm_movemask_ps(in);
+				if (x + 4 > x1) mask &= (1 << (x1 - x)) - 1;
+				if (!mask) continue;
+
+				in = _mm_castsi128_ps(_mm_set_epi32(
+					-(mask >> 3 & 1), -(mask >> 2 & 1), -(mask >> 1 & 1), -(mask & 1)));
+				_mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(in, z), _mm_andnot_ps(in, old)));
+				for (int i = 0; i < 4; ++i) {
+					if (mask >> i & 1) memset(row + (x + i) * 3, t.shade, 3);
+				}
+			}
+#else
+			for (int x = xs; x <= xe && x < x1; ++x) {
+				float cx = static_cast<float>(x) + 0.5f;
+				float w0 = e0.a * cx + e0.b * cy + e0.c;
+				float w1 = e1.a * cx + e1.b * cy + e1.c;
+				float w2 = e2.a * cx + e2.b * cy + e2.c;
+				if (!(w0 > 0 || (w0 == 0 && e0.tl))) continue;
+				if (!(w1 > 0 || (w1 == 0 && e1.tl))) continue;
+				if (!(w2 > 0 || (w2 == 0 && e2.tl))) continue;
+
+				float z = za * cx + zb * cy + zc;
+				if (z < depth[x] && z >= 0 && z <= 1) {
+					depth[x] = z;
+					memset(row + x * 3, t.shade, 3);
+				}
+			}
+#endif
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef RASTERIZER_HPP
+#define RASTERIZER_HPP
+#include <vector>
+#include <cstdint>
+#include "solid.hpp"
+#include "camera.hpp"
+#include "image.hpp"
+
+class Rasterizer {
+public:
+	/** Create color & depth buffers of a given size.
+	 * @param w Width in pixels
+	 * @param h Height in pixels
+	*/
+	Rasterizer(int, int);
+
+	/** Render a solid the way Camera::render() does with OpenGL, using the
+	 * camera's projection, rotation and clipping planes. The screen is
+	 * split into tiles which are rasterized in parallel.
+	 * @param s The solid to be rendered, must be welded
+	 * @param c The camera
+	 * @param lit Light the solid like the default OpenGL light 0
+	*/
+	void render(const Solid&, const Camera&, bool);
+
+	/** Get the rendered colors.
+	 * @return Image with the rows in top to bottom order
+	*/
+	const Image& getImage() const;
+
+private:
+	/** A triangle after clipping, ready to be rasterized.
+	*/
+	struct Setup {
+		float x[3], y[3], z[3];	// Screen space, top to bottom
+		int minx, miny, maxx, maxy;	// Bounding box in pixels, inclusive
+		uint8_t shade;
+	};
+
+	/** Clip a triangle against the near plane and project it.
+	 * @param v Clip space vertices, 4 floats each
+	 * @param shade Gray level
+	 * @param out Where to append the resulting triangles
+	*/
+	void setup(const float *const *, uint8_t, std::vector<Setup>&) const;
+
+	/** Rasterize the triangles binned to a tile.
+	 * @param t Tile index
+	*/
+	void raster(size_t);
+
+	// Instance variables
+	int m_width;
+	int m_height;
+	int m_stride;		// Depth buffer row length, a multiple of 4
+	int m_tilesX;
+	int m_tilesY;
+	Image m_color;
+	std::vector<float> m_depth;
+	std::vector<Setup> m_tris;
+	std::vector<std::vector<uint32_t>> m_bins;
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <filesystem>
+#include <algorithm>
+#include <utility>
+#include "scene.hpp"
+#include "mat4.hpp"
+#define PI 3.1415926535
+#define ATTRIB 12	// First of the four attributes holding instance transforms
+
+namespace {
+
+// Transforms each vertex by its instance, then lights it like the fixed
+// function pipeline would with the default material and GL_LIGHT0. The
+// attributes are clear of the ones NVIDIA aliases to built-in arrays.
+const char *VERTEX_SHADER =
+	"#version 120\n"
+	"attribute vec4 model0;\n"
+	"attribute vec4 model1;\n"
+	"attribute vec4 model2;\n"
+	"attribute vec4 model3;\n"
+	"uniform bool lit;\n"
+	"void main()\n"
+	"{\n"
+	"	mat4 model = mat4(model0, model1, model2, model3);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * (model * gl_Vertex);\n"
+	"	if (!lit) {\n"
+	"		gl_FrontColor = gl_Color;\n"
+	"		return;\n"
+	"	}\n"
+	"	vec3 n = normalize(gl_NormalMatrix * (mat3(model) * gl_Normal));\n"
+	"	vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+	"	gl_FrontColor = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+	"		+ max(dot(n, l), 0.0) * gl_FrontLightProduct[0].diffuse;\n"
+	"}\n";
+
+} // namespace
+
+Scene::Scene()
+: m_meshes()
+, m_files()
+, m_index()
+, m_instances()
+, m_bvh()
+, m_program(0)
+, m_lit(-1)
+, m_buf(0)
+, m_support(-1)
+{}
+
+uint32_t Scene::add(std::string f, const double *t)
+{
+	// Files reached through different paths are still the same mesh
+	std::error_code err;
+	std::string key = std::filesystem::weakly_canonical(f, err).string();
+	if (err) key = f;
+
+	auto it = m_index.find(key);
+	if (it == m_index.end()) {
+		it = m_index.emplace(key, static_cast<uint32_t>(m_meshes.size())).first;
+		m_meshes.emplace_back();
+		m_files.push_back(f);
+		m_bvh.emplace_back();
+	}
+
+	Instance in;
+	in.mesh = it->second;
+	memset(in.transform, 0, sizeof in.transform);
+	for (int i = 0; i < 4; ++i) in.transform[i * 5] = 1;
+	if (t) memcpy(in.transform, t, sizeof in.transform);
+
+	// The inverse of s * R is R^T / s
+	const double *m = in.transform;
+	in.scale = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	double s2 = (in.scale > 0 ? in.scale * in.scale : 1);
+	double *inv = in.inverse;
+	memset(inv, 0, sizeof in.inverse);
+	for (int r = 0; r < 3; ++r) {
+		for (int c = 0; c < 3; ++c) inv[c * 4 + r] = m[r * 4 + c] / s2;
+	}
+	for (int r = 0; r < 3; ++r) {
+		inv[12 + r] = -(inv[r] * m[12] + inv[4 + r] * m[13] + inv[8 + r] * m[14]);
+	}
+	inv[15] = 1;
+
+	m_instances.push_back(in);
+	return static_cast<uint32_t>(m_instances.size() - 1);
+}
+
+bool Scene::readFile(std::string f)
+{
+	std::ifstream is(f);
+	if (!is) {
+		std::cerr << "Error opening scene file: " << f << std::endl;
+		return false;
+	}
+
+	std::filesystem::path dir = std::filesystem::path(f).parent_path();
+	std::string line;
+	for (int n = 1; std::getline(is, line); ++n) {
+		std::istringstream ss(line);
+		std::string file;
+		if (!(ss >> file) || file[0] == '#') continue;
+
+		// Missing values keep their defaults, anything else is an error
+		double v[7] = { 0, 0, 0, 0, 0, 0, 1 };
+		int k = 0;
+		while (k < 7 && ss >> v[k]) ++k;
+		std::string rest;
+		bool bad = (k < 7 ? !ss.eof() : static_cast<bool>(ss >> rest));
+		if (bad || k == 1 || k == 2 || k == 4 || k == 5) {
+			std::cerr << "Error reading scene file: " << f << ":" << n << std::endl;
+			return false;
+		}
+
+		// Rotate about x, then y, then z
+		double c[3], s[3];
+		for (int a = 0; a < 3; ++a) {
+			c[a] = std::cos(v[3 + a] * PI / 180.0);
+			s[a] = std::sin(v[3 + a] * PI / 180.0);
+		}
+		double m[16] = {
+			c[1] * c[2], c[1] * s[2], -s[1], 0,
+			s[0] * s[1] * c[2] - c[0] * s[2], s[0] * s[1] * s[2] + c[0] * c[2], s[0] * c[1], 0,
+			c[0] * s[1] * c[2] + s[0] * s[2], c[0] * s[1] * s[2] - s[0] * c[2], c[0] * c[1], 0,
+			v[0], v[1], v[2], 1
+		};
+		for (int i = 0; i < 12; ++i) m[i] *= v[6];
+
+		std::filesystem::path p(file);
+		add((p.is_relative() ? dir / p : p).string(), m);
+	}
+	return true;
+}
+
+bool Scene::isScene(const std::string& f)
+{
+	return std::filesystem::path(f).extension() == ".scene";
+}
+
+uint32_t Scene::meshCount() const
+{
+	return static_cast<uint32_t>(m_meshes.size());
+}
+
+Solid& Scene::getMesh(uint32_t i)
+{
+	return m_meshes[i];
+}
+
+const Solid& Scene::getMesh(uint32_t i) const
+{
+	return m_meshes[i];
+}
+
+const std::string& Scene::getFile(uint32_t i) const
+{
+	return m_files[i];
+}
+
+const std::vector<Scene::Instance>& Scene::getInstances() const
+{
+	return m_instances;
+}
+
+bool Scene::bounds(Vector3& lower, Vector3& upper) const
+{
+	double inf = std::numeric_limits<double>::infinity();
+	lower = Vector3(inf, inf, inf);
+	upper = -lower;
+	bool any = false;
+	for (const Instance& in : m_instances) {
+		const Solid& s = m_meshes[in.mesh];
+		if (!s.size()) continue;
+		Vector3 c = Mat4(in.transform).apply(s.getCenter());
+		double r = s.getRadius() * in.scale;
+		lower = Vector3(std::min(lower.x, c.x - r), std::min(lower.y, c.y - r), std::min(lower.z, c.z - r));
+		upper = Vector3(std::max(upper.x, c.x + r), std::max(upper.y, c.y + r), std::max(upper.z, c.z + r));
+		any = true;
+	}
+	return any;
+}
+
+Vector3 Scene::getCenter() const
+{
+	Vector3 lower, upper;
+	if (!bounds(lower, upper)) return Vector3();
+	return (upper + lower) / 2.0;
+}
+
+double Scene::getRadius() const
+{
+	// Farthest reach of any instance's sphere from the center
+	Vector3 c = getCenter();
+	double r = 0;
+	for (const Instance& in : m_instances) {
+		const Solid& s = m_meshes[in.mesh];
+		if (!s.size()) continue;
+		r = std::max(r, (Mat4(in.transform).apply(s.getCenter()) - c).mag() + s.getRadius() * in.scale);
+	}
+	return r;
+}
+
+uint64_t Scene::size() const
+{
+	uint64_t n = 0;
+	for (const Instance& in : m_instances) n += m_meshes[in.mesh].size();
+	return n;
+}
+
+void Scene::toggleLight()
+{
+	// Meshes replaced since the last toggle follow the first one
+	if (m_meshes.empty()) return;
+	bool on = !m_meshes.front().getLight();
+	for (Solid& s : m_meshes) {
+		if (s.getLight() != on) s.toggleLight();
+	}
+}
+
+void Scene::toggleSmooth()
+{
+	if (m_meshes.empty()) return;
+	bool on = !m_meshes.front().getSmooth();
+	for (Solid& s : m_meshes) {
+		if (s.getSmooth() != on) s.toggleSmooth();
+	}
+}
+
+size_t Scene::buildBvh(uint32_t i)
+{
+	m_bvh[i].build(m_meshes[i]);
+	return m_bvh[i].nodeCount();
+}
+
+void Scene::setBvh(uint32_t i, Bvh&& b)
+{
+	m_bvh[i] = std::move(b);
+}
+
+bool Scene::intersect(const Bvh::Ray& r, Bvh::Hit& h, uint32_t& inst) const
+{
+	// Rays keep their parameter when moved into a mesh's coordinates, so
+	// hits in different instances compare directly
+	bool found = false;
+	for (uint32_t i = 0; i < m_instances.size(); ++i) {
+		const Instance& in = m_instances[i];
+		if (!m_bvh[in.mesh].nodeCount()) continue;
+
+		const double *m = in.inverse;
+		Bvh::Ray local;
+		for (int a = 0; a < 3; ++a) {
+			local.origin[a] = static_cast<float>(m[a] * r.origin[0] + m[4 + a] * r.origin[1]
+				+ m[8 + a] * r.origin[2] + m[12 + a]);
+			local.dir[a] = static_cast<float>(m[a] * r.dir[0] + m[4 + a] * r.dir[1] + m[8 + a] * r.dir[2]);
+		}
+
+		Bvh::Hit hit;
+		if (m_bvh[in.mesh].intersect(local, hit) && (!found || hit.t < h.t)) {
+			h = hit;
+			inst = i;
+			found = true;
+		}
+	}
+	return found;
+}
+
+bool Scene::canInstance() const
+{
+	if (m_support < 0) {
+		m_support = GLEW_VERSION_2_0 && GLEW_ARB_draw_instanced && GLEW_ARB_instanced_arrays && compile();
+	}
+	return m_support > 0;
+}
+
+bool Scene::compile() const
+{
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, &VERTEX_SHADER, nullptr);
+	glCompileShader(vs);
+
+	GLint ok = GL_FALSE;
+	glGetShaderiv(vs, GL_COMPILE_STATUS, &ok);
+	if (ok) {
+		m_program = glCreateProgram();
+		glAttachShader(m_program, vs);
+		const char *names[] = { "model0", "model1", "model2", "model3" };
+		for (GLuint i = 0; i < 4; ++i) glBindAttribLocation(m_program, ATTRIB + i, names[i]);
+		glLinkProgram(m_program);
+		glGetProgramiv(m_program, GL_LINK_STATUS, &ok);
+	}
+	glDeleteShader(vs);
+
+	if (!ok) {
+		std::cerr << "Warning: Instanced drawing unavailable, drawing instances one by one" << std::endl;
+		if (m_program) glDeleteProgram(m_program);
+		m_program = 0;
+		return false;
+	}
+	m_lit = glGetUniformLocation(m_program, "lit");
+	glGenBuffers(1, &m_buf);
+	return true;
+}
+
+void Scene::drawInstanced(const Solid& s, const float *m, uint32_t n) const
+{
+	if (!n || !canInstance()) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_buf);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(n) * 16 * sizeof(float), m, GL_STREAM_DRAW);
+	for (GLuint i = 0; i < 4; ++i) {
+		glEnableVertexAttribArray(ATTRIB + i);
+		glVertexAttribPointer(ATTRIB + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+			reinterpret_cast<const void *>(i * 4 * sizeof(float)));
+		glVertexAttribDivisorARB(ATTRIB + i, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(m_program);
+	glUniform1i(m_lit, s.getLight());
+	s.drawInstanced(static_cast<GLsizei>(n));
+	glUseProgram(0);
+
+	for (GLuint i = 0; i < 4; ++i) {
+		glVertexAttribDivisorARB(ATTRIB + i, 0);
+		glDisableVertexAttribArray(ATTRIB + i);
+	}
+}
+
+void Scene::release()
+{
+	if (m_program) glDeleteProgram(m_program);
+	if (m_buf) glDeleteBuffers(1, &m_buf);
+	m_program = m_buf = 0;
+	m_support = -1;
+	for (Solid& s : m_meshes) s.release();
+}
@@ -0,0 +1,165 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <GL/glew.h>
+#include "solid.hpp"
+#include "bvh.hpp"
+#include "vector3.hpp"
+
+class Scene {
+public:
+	/** A placement of one of the scene's meshes.
+	*/
+	struct Instance {
+		uint32_t mesh;
+		double transform[16];	// Column-major, rotation & uniform scale then translation
+		double inverse[16];
+		double scale;
+	};
+
+	Scene();
+
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	/** Place a model in the scene. Files already in the scene share
+	 * their mesh, so they are only read once.
+	 * @param f Filename
+	 * @param t Column-major 4x4 transform without shear, nullptr for none
+	 * @return Index of the new instance
+	*/
+	uint32_t add(std::string, const double * = nullptr);
+
+	/** Add the models listed in a scene file, one per line as
+	 * `<file> [x y z [rx ry rz [scale]]]`. Rotations are in degrees about
+	 * the x, y then z axes, and relative paths start at the scene file.
+	 * Lines starting with `#` are skipped.
+	 * @param f Filename
+	 * @return True on success, false otherwise
+	*/
+	bool readFile(std::string);
+
+	/** Check if a file is a scene file rather than a model.
+	 * @param f Filename
+	 * @return True if it ends in `.scene`
+	*/
+	static bool isScene(const std::string&);
+
+	/** Get the number of distinct meshes.
+	 * @return Mesh count
+	*/
+	uint32_t meshCount() const;
+
+	/** Get a mesh, e.g. to load it.
+	 * @param i Mesh index
+	 * @return The mesh
+	*/
+	Solid& getMesh(uint32_t);
+	const Solid& getMesh(uint32_t) const;
+
+	/** Get the file a mesh is read from.
+	 * @param i Mesh index
+	 * @return Filename as it was added
+	*/
+	const std::string& getFile(uint32_t) const;
+
+	/** Get the placements of all meshes.
+	 * @return Instances in the order they were added
+	*/
+	const std::vector<Instance>& getInstances() const;
+
+	/** Get the radius of a sphere that bounds every instance. Empty
+	 * meshes, e.g. ones still loading, are left out.
+	 * @return Radius
+	*/
+	double getRadius() const;
+
+	/** Get the center of the bounding sphere.
+	 * @return Center in scene coordinates
+	*/
+	Vector3 getCenter() const;
+
+	/** Get the total number of triangles drawn.
+	 * @return Sum over instances of their mesh's triangle count
+	*/
+	uint64_t size() const;
+
+	/** Toggle lighting of every mesh.
+	*/
+	void toggleLight();
+
+	/** Toggle smooth shading of every mesh.
+	*/
+	void toggleSmooth();
+
+	/** Build the picking hierarchy of a mesh once it's loaded.
+	 * @param i Mesh index
+	 * @return Number of nodes
+	*/
+	size_t buildBvh(uint32_t);
+
+	/** Hand over the picking hierarchy of a mesh built elsewhere, e.g.
+	 * by the importer on the thread pool.
+	 * @param i Mesh index
+	 * @param b Hierarchy built over the mesh
+	*/
+	void setBvh(uint32_t, Bvh&&);
+
+	/** Find the closest triangle a ray hits in any instance.
+	 * @param r The ray in scene coordinates
+	 * @param h Where to store the hit, triangle indices are the mesh's
+	 * @param inst Set to the instance hit
+	 * @return True if a triangle was hit
+	*/
+	bool intersect(const Bvh::Ray&, Bvh::Hit&, uint32_t&) const;
+
+	/** Check if meshes can be drawn with one call for all instances,
+	 * which needs a vertex shader and instanced arrays. Must be called
+	 * with an OpenGL context.
+	 * @return True if drawInstanced() can be used
+	*/
+	bool canInstance() const;
+
+	/** Draw a mesh once per transform with a single draw call, in the
+	 * current model-view matrix.
+	 * @param s The mesh or one of its levels of detail
+	 * @param m 16 floats per instance, column-major
+	 * @param n Number of instances
+	*/
+	void drawInstanced(const Solid&, const float *, uint32_t) const;
+
+	/** Delete the instancing program & buffer and the buffers of every
+	 * mesh. Must be called while the context is still current, e.g. when
+	 * the window closes, as nothing is deleted on destruction.
+	*/
+	void release();
+
+private:
+	/** Compile & link the instancing program.
+	 * @return True on success, false otherwise
+	*/
+	bool compile() const;
+
+	/** Get the box that bounds every instance's sphere.
+	 * @param lower Set to the minimum corner
+	 * @param upper Set to the maximum corner
+	 * @return False if there's nothing loaded yet
+	*/
+	bool bounds(Vector3&, Vector3&) const;
+
+	// Instance variables
+	std::vector<Solid> m_meshes;
+	std::vector<std::string> m_files;
+	std::map<std::string, uint32_t> m_index;	// Mesh of each canonical path
+	std::vector<Instance> m_instances;
+	std::vector<Bvh> m_bvh;		// Picking hierarchy of each mesh
+	mutable GLuint m_program;	// Instancing program, built on first use
+	mutable GLint m_lit;		// Location of its lighting switch
+	mutable GLuint m_buf;		// Per-instance transforms
+	mutable int m_support;		// 1 if instancing works, 0 if not, -1 unknown
+};
+
+#endif
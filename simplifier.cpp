@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <unordered_map>
+#include "simplifier.hpp"
+
+namespace {
+
+/** Cross product of (b - a) and (c - a).
+*/
+inline void normal(const float *a, const float *b, const float *c, double *n)
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	n[0] = u[1] * v[2] - u[2] * v[1];
+	n[1] = u[2] * v[0] - u[0] * v[2];
+	n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/** Squared distance of a point to the planes a quadric was built from.
+*/
+inline double error(const std::array<double, 10>& q, const float *p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+		+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+		+ q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+} // namespace
+
+Simplifier::Simplifier(const float *pos, uint32_t n)
+{
+	// Merge bitwise identical positions, with -0 folded into 0
+	struct Key {
+		uint32_t b[3];
+		bool operator==(const Key& o) const { return !memcmp(b, o.b, sizeof b); }
+	};
+	struct Hash {
+		size_t operator()(const Key& k) const {
+			return (k.b[0] * 73856093u) ^ (k.b[1] * 19349663u) ^ (k.b[2] * 83492791u);
+		}
+	};
+
+	std::unordered_map<Key, uint32_t, Hash> ids;
+	ids.reserve(static_cast<size_t>(n) / 2 + 1);
+	m_tri.reserve(static_cast<size_t>(n) * 3);
+	for (size_t i = 0; i < n; ++i) {
+		uint32_t t[3];
+		for (int k = 0; k < 3; ++k) {
+			const float *p = pos + i * 9 + k * 3;
+			Key key;
+			for (int a = 0; a < 3; ++a) {
+				float f = p[a] + 0.f;
+				memcpy(&key.b[a], &f, sizeof f);
+			}
+			auto it = ids.emplace(key, static_cast<uint32_t>(m_vert.size() / 3));
+			if (it.second) m_vert.insert(m_vert.end(), p, p + 3);
+			t[k] = it.first->second;
+		}
+		if (t[0] == t[1] || t[1] == t[2] || t[2] == t[0]) continue;
+		m_tri.insert(m_tri.end(), t, t + 3);
+	}
+
+	// Quadrics of the planes around each vertex, weighted by area
+	size_t nv = m_vert.size() / 3;
+	m_quad.assign(nv, Quadric());
+	for (size_t i = 0; i < m_tri.size(); i += 3) {
+		const float *a = &m_vert[m_tri[i] * 3];
+		double nrm[3];
+		normal(a, &m_vert[m_tri[i + 1] * 3], &m_vert[m_tri[i + 2] * 3], nrm);
+		double len = std::sqrt(nrm[0] * nrm[0] + nrm[1] * nrm[1] + nrm[2] * nrm[2]);
+		if (len == 0) continue;
+
+		double x = nrm[0] / len, y = nrm[1] / len, z = nrm[2] / len;
+		double d = -(x * a[0] + y * a[1] + z * a[2]);
+		double w = len / 2;
+		Quadric q = { x * x, x * y, x * z, x * d, y * y, y * z, y * d, z * z, z * d, d * d };
+		for (int k = 0; k < 3; ++k) {
+			Quadric& v = m_quad[m_tri[i + k]];
+			for (int j = 0; j < 10; ++j) v[j] += q[j] * w;
+		}
+	}
+
+	// Lock vertices on edges that aren't shared by exactly two triangles
+	std::vector<uint64_t> edges;
+	edges.reserve(m_tri.size());
+	for (size_t i = 0; i < m_tri.size(); i += 3) {
+		for (int k = 0; k < 3; ++k) {
+			uint64_t a = m_tri[i + k], b = m_tri[i + (k + 1) % 3];
+			edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	m_lock.assign(nv, false);
+	for (size_t i = 0, j; i < edges.size(); i = j) {
+		for (j = i + 1; j < edges.size() && edges[j] == edges[i]; ++j);
+		if (j - i != 2) {
+			m_lock[edges[i] >> 32] = true;
+			m_lock[edges[i] & 0xffffffff] = true;
+		}
+	}
+}
+
+uint32_t Simplifier::simplify(uint32_t target)
+{
+	while (size() > target && pass(target));
+	return size();
+}
+
+uint32_t Simplifier::size() const
+{
+	return static_cast<uint32_t>(m_tri.size() / 3);
+}
+
+bool Simplifier::pass(uint32_t target)
+{
+	size_t nv = m_vert.size() / 3;
+	size_t nt = m_tri.size() / 3;
+
+	// Unique edges
+	std::vector<uint64_t> edges;
+	edges.reserve(m_tri.size());
+	for (size_t i = 0; i < m_tri.size(); i += 3) {
+		for (int k = 0; k < 3; ++k) {
+			uint64_t a = m_tri[i + k], b = m_tri[i + (k + 1) % 3];
+			edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+	// Cheapest direction of each edge, moving one end onto the other
+	struct Collapse {
+		double cost;
+		uint32_t from;
+		uint32_t to;
+	};
+	std::vector<Collapse> cand;
+	cand.reserve(edges.size());
+	for (uint64_t e : edges) {
+		uint32_t a = static_cast<uint32_t>(e >> 32), b = static_cast<uint32_t>(e);
+		if (m_lock[a] && m_lock[b]) continue;
+
+		Quadric q;
+		for (int j = 0; j < 10; ++j) q[j] = m_quad[a][j] + m_quad[b][j];
+		double ca = (m_lock[a] ? std::numeric_limits<double>::infinity() : error(q, &m_vert[b * 3]));
+		double cb = (m_lock[b] ? std::numeric_limits<double>::infinity() : error(q, &m_vert[a * 3]));
+		if (ca <= cb) cand.push_back({ ca, a, b });
+		else cand.push_back({ cb, b, a });
+	}
+	std::sort(cand.begin(), cand.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+	// Triangles around each vertex
+	std::vector<uint32_t> start(nv + 1, 0), adj(m_tri.size());
+	for (uint32_t v : m_tri) ++start[v + 1];
+	std::partial_sum(start.begin(), start.end(), start.begin());
+	std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < m_tri.size(); ++i) adj[fill[m_tri[i]]++] = static_cast<uint32_t>(i / 3);
+
+	// Collapse edges whose neighbourhoods don't overlap
+	std::vector<uint32_t> remap(nv);
+	std::iota(remap.begin(), remap.end(), 0);
+	std::vector<bool> touched(nv, false);
+	size_t removed = 0, want = nt - target;
+	bool changed = false;
+	std::vector<uint32_t> ring, shared;
+	for (const Collapse& c : cand) {
+		if (touched[c.from] || touched[c.to]) continue;
+
+		// Link condition: the ends may only share the neighbours opposite
+		// the edge, otherwise the collapse pinches the surface into a
+		// non-manifold edge or vertex
+		ring.clear();
+		shared.clear();
+		size_t faces = 0;
+		for (uint32_t k = start[c.from]; k < start[c.from + 1]; ++k) {
+			const uint32_t *t = &m_tri[adj[k] * 3];
+			bool edge = (t[0] == c.to || t[1] == c.to || t[2] == c.to);
+			faces += edge;
+			for (int j = 0; j < 3; ++j) {
+				if (t[j] != c.from && t[j] != c.to) ring.push_back(t[j]);
+			}
+		}
+		for (uint32_t k = start[c.to]; k < start[c.to + 1]; ++k) {
+			const uint32_t *t = &m_tri[adj[k] * 3];
+			for (int j = 0; j < 3; ++j) {
+				if (t[j] != c.from && t[j] != c.to && std::find(ring.begin(), ring.end(), t[j]) != ring.end()) {
+					shared.push_back(t[j]);
+				}
+			}
+		}
+		std::sort(shared.begin(), shared.end());
+		if (static_cast<size_t>(std::unique(shared.begin(), shared.end()) - shared.begin()) != faces) continue;
+
+		// Reject collapses that would flip a triangle or turn it by more
+		// than about 70 degrees
+		bool ok = true;
+		size_t gone = 0;
+		for (uint32_t k = start[c.from]; k < start[c.from + 1] && ok; ++k) {
+			const uint32_t *t = &m_tri[adj[k] * 3];
+			if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+				++gone;
+				continue;
+			}
+
+			const float *p[3];
+			for (int j = 0; j < 3; ++j) p[j] = &m_vert[t[j] * 3];
+			double before[3], after[3];
+			normal(p[0], p[1], p[2], before);
+			for (int j = 0; j < 3; ++j) {
+				if (t[j] == c.from) p[j] = &m_vert[c.to * 3];
+			}
+			normal(p[0], p[1], p[2], after);
+			double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+			double len = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+				* (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+			ok = dot > 0 && dot * dot > 0.1 * len;
+		}
+		if (!ok) continue;
+
+		remap[c.from] = c.to;
+		for (int j = 0; j < 10; ++j) m_quad[c.to][j] += m_quad[c.from][j];
+		for (uint32_t k = start[c.from]; k < start[c.from + 1]; ++k) {
+			const uint32_t *t = &m_tri[adj[k] * 3];
+			touched[t[0]] = touched[t[1]] = touched[t[2]] = true;
+		}
+		changed = true;
+
+		removed += gone;
+		if (removed >= want) break;
+	}
+	if (!changed) return false;
+
+	// Apply the collapses, dropping triangles that became degenerate
+	size_t out = 0;
+	for (size_t i = 0; i < m_tri.size(); i += 3) {
+		uint32_t a = remap[m_tri[i]], b = remap[m_tri[i + 1]], c = remap[m_tri[i + 2]];
+		if (a == b || b == c || c == a) continue;
+		m_tri[out++] = a;
+		m_tri[out++] = b;
+		m_tri[out++] = c;
+	}
+	m_tri.resize(out);
+	return true;
+}
+
+void Simplifier::getFacets(std::vector<float>& out) const
+{
+	out.resize(m_tri.size() * 4);
+	float *f = out.data();
+	for (size_t i = 0; i < m_tri.size(); i += 3, f += 12) {
+		const float *p[3] = { &m_vert[m_tri[i] * 3], &m_vert[m_tri[i + 1] * 3], &m_vert[m_tri[i + 2] * 3] };
+		double n[3];
+		normal(p[0], p[1], p[2], n);
+		double len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int a = 0; a < 3; ++a) {
+			f[a] = static_cast<float>(len > 0 ? n[a] / len : 0);
+			f[3 + a] = p[0][a];
+			f[6 + a] = p[1][a];
+			f[9 + a] = p[2][a];
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef SIMPLIFIER_HPP
+#define SIMPLIFIER_HPP
+#include <vector>
+#include <array>
+#include <cstdint>
+
+class Simplifier {
+public:
+	/** Index a list of triangles, merging identical positions.
+	 * @param pos 9 floats per triangle (v0, v1, v2)
+	 * @param n Number of triangles
+	*/
+	Simplifier(const float *, uint32_t);
+
+	/** Collapse edges in order of their quadric error until at most a
+	 * given number of triangles is left. Vertices on open or non-manifold
+	 * edges are kept in place. Can be called repeatedly with decreasing
+	 * targets to build a chain of levels.
+	 * @param target Number of triangles to keep
+	 * @return Number of triangles left, more than target if no edge
+	 * could be collapsed without folding the surface over
+	*/
+	uint32_t simplify(uint32_t);
+
+	/** Get the number of triangles.
+	 * @return Triangle count
+	*/
+	uint32_t size() const;
+
+	/** Get the remaining triangles as `.stl` records.
+	 * @param out Overwritten with 12 floats per triangle: normal, v0, v1, v2
+	*/
+	void getFacets(std::vector<float>&) const;
+
+private:
+	/** Error quadric, the upper half of a symmetric 4x4 matrix.
+	*/
+	typedef std::array<double, 10> Quadric;
+
+	/** Collapse as many independent edges as possible, cheapest first.
+	 * @param target Number of triangles to keep
+	 * @return False if nothing could be collapsed
+	*/
+	bool pass(uint32_t);
+
+	// Instance variables
+	std::vector<float> m_vert;	// Positions, 3 per vertex
+	std::vector<uint32_t> m_tri;	// Vertex indices, 3 per triangle
+	std::vector<Quadric> m_quad;	// Accumulated error per vertex
+	std::vector<bool> m_lock;	// Vertices that may not move
+};
+
+#endif
@@ -2,73 +2,186 @@
 #include <fstream>
 #include <iomanip>
 #include <cstring>
+#include <cstddef>
 #include <utility>
 #include <cstdio>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include <limits>
+#include <vector>
+#include <cctype>
+#include <filesystem>
+#include <system_error>
+#include <unordered_map>
+#include <numeric>
+#include <type_traits>
 #include "solid.hpp"
+#include "threadpool.hpp"
+#include "simplifier.hpp"
+#include "normals.hpp"
+#include "profiler.hpp"
+#include "bounds.hpp"
+#define LOD_MIN 10000	// Smallest useful level of detail
+#define CLUSTER 1024	// Triangles per cluster
+#define BUDGET (256u << 20)	// Default chunked loader memory budget
+#define TOLERANCE 1.0	// Degrees a file normal may be off
+#define CREASE 30.0	// Default crease angle in degrees
+#define PI 3.1415926535
+#define CELL_LIMIT 4.6e18	// Largest weld grid cell index, about 2^62
+
+Solid::Options::Options()
+: eps(0)
+, crease(CREASE)
+, budget(BUDGET)
+, cache(true)
+, fix(false)
+{}
 
 // Default constructor
 Solid::Solid()
-: m_arr(nullptr)
+: m_pos(nullptr)
+, m_fnorm(nullptr)
 , m_max(0)
 , m_len(0)
 , m_light(false)
-, m_upper()
-, m_lower()
-, m_index(0)
+, m_bounds()
+, m_buf()
 , m_vertex(nullptr)
 , m_norm(nullptr)
+, m_elem(nullptr)
+, m_nvert(0)
+, m_eps(0)
+, m_lods()
+, m_clusters()
+, m_chunks()
+, m_budget(BUDGET)
+, m_cache(true)
+, m_fix(false)
+, m_smooth(nullptr)
+, m_selem(nullptr)
+, m_nsmooth(0)
+, m_sbuf()
+, m_crease(CREASE)
+, m_shade(false)
+, m_entry()
 {}
 
 // Destructor
 Solid::~Solid()
 {
-	delete[] m_arr;
-	delete[] m_vertex;
-	delete[] m_norm;
+	release();
+	freeArrays();
 }
 
 // Copy constructor
 Solid::Solid(const Solid& o)
+: m_pos(nullptr)
+, m_fnorm(nullptr)
+, m_max(o.m_max)
+, m_len(o.m_len)
+, m_light(o.m_light)
+, m_bounds(o.m_bounds)
+, m_buf()
+, m_vertex(nullptr)
+, m_norm(nullptr)
+, m_elem(nullptr)
+, m_nvert(o.m_nvert)
+, m_eps(o.m_eps)
+, m_lods(o.m_lods)
+, m_clusters(o.m_clusters)
+, m_chunks()
+, m_budget(o.m_budget)
+, m_cache(o.m_cache)
+, m_fix(o.m_fix)
+, m_smooth(nullptr)
+, m_selem(nullptr)
+, m_nsmooth(o.m_nsmooth)
+, m_sbuf()
+, m_crease(o.m_crease)
+, m_shade(o.m_shade)
+, m_entry()
 {
-	m_max = o.m_max;
-	m_len = o.m_len;
-	m_light = o.m_light;
-	m_index = o.m_index;
+	if (o.m_pos) {
+		m_pos = new float[m_max * 9];
+		memcpy(m_pos, o.m_pos, sizeof(float) * m_max * 9);
+	}
 
-	if (o.m_arr) {
-		m_arr = new Triangle[m_max];
-		memcpy(m_arr, o.m_arr, sizeof(Triangle) * m_max);
+	if (o.m_fnorm) {
+		m_fnorm = new float[m_max * 3];
+		memcpy(m_fnorm, o.m_fnorm, sizeof(float) * m_max * 3);
 	}
 
 	if (o.m_vertex) {
-		m_vertex = new GLdouble[m_max * 9];
-		memcpy(m_vertex, o.m_vertex, sizeof(GLdouble) * m_max * 9);
+		m_vertex = new GLfloat[m_nvert * 3];
+		memcpy(m_vertex, o.m_vertex, sizeof(GLfloat) * m_nvert * 3);
 	}
 
 	if (o.m_norm) {
-		m_norm = new GLdouble[m_max * 3];
-		memcpy(m_norm, o.m_norm, sizeof(GLdouble) * m_max * 3);
+		m_norm = new GLfloat[m_nvert * 3];
+		memcpy(m_norm, o.m_norm, sizeof(GLfloat) * m_nvert * 3);
+	}
+
+	if (o.m_elem) {
+		m_elem = new GLuint[m_max * 3];
+		memcpy(m_elem, o.m_elem, sizeof(GLuint) * m_max * 3);
+	}
+
+	if (o.m_smooth) {
+		m_smooth = new GLfloat[m_nsmooth * 6];
+		memcpy(m_smooth, o.m_smooth, sizeof(GLfloat) * m_nsmooth * 6);
+	}
+
+	if (o.m_selem) {
+		m_selem = new GLuint[m_max * 3];
+		memcpy(m_selem, o.m_selem, sizeof(GLuint) * m_max * 3);
 	}
 }
 
 // Move constructor
 Solid::Solid(Solid&& o) noexcept
-: m_arr(std::move(o.m_arr))
+: m_pos(std::move(o.m_pos))
+, m_fnorm(std::move(o.m_fnorm))
 , m_max(o.m_max)
 , m_len(o.m_len)
 , m_light(o.m_light)
-, m_index(o.m_index)
+, m_bounds(o.m_bounds)
+, m_buf()
 , m_vertex(std::move(o.m_vertex))
 , m_norm(std::move(o.m_norm))
+, m_elem(std::move(o.m_elem))
+, m_nvert(o.m_nvert)
+, m_eps(o.m_eps)
+, m_lods(std::move(o.m_lods))
+, m_clusters(std::move(o.m_clusters))
+, m_chunks()
+, m_budget(o.m_budget)
+, m_cache(o.m_cache)
+, m_fix(o.m_fix)
+, m_smooth(std::move(o.m_smooth))
+, m_selem(std::move(o.m_selem))
+, m_nsmooth(o.m_nsmooth)
+, m_sbuf()
+, m_crease(o.m_crease)
+, m_shade(o.m_shade)
+, m_entry(std::move(o.m_entry))
 {
-	o.m_arr = nullptr;
+	o.m_pos = nullptr;
+	o.m_fnorm = nullptr;
 	o.m_max = 0;
 	o.m_len = 0;
 	o.m_light = false;
-	o.m_index = 0;
+	std::swap(m_buf, o.m_buf);
+	std::swap(m_sbuf, o.m_sbuf);
+	std::swap(m_chunks, o.m_chunks);
 	o.m_vertex = nullptr;
 	o.m_norm = nullptr;
+	o.m_elem = nullptr;
+	o.m_nvert = 0;
+	o.m_smooth = nullptr;
+	o.m_selem = nullptr;
+	o.m_nsmooth = 0;
 }
 
 // Copy assignment
@@ -80,17 +193,233 @@ Solid& Solid::operator=(const Solid& o)
 // Move assignment
 Solid& Solid::operator=(Solid&& o) noexcept
 {
-	m_arr = std::exchange(o.m_arr, nullptr);
+	std::swap(m_pos, o.m_pos);
+	std::swap(m_fnorm, o.m_fnorm);
+	std::swap(m_vertex, o.m_vertex);
+	std::swap(m_norm, o.m_norm);
+	std::swap(m_elem, o.m_elem);
 	m_max = std::exchange(o.m_max, 0);
 	m_len = std::exchange(o.m_len, 0);
 	m_light = std::exchange(o.m_light, false);
-	m_index = std::exchange(o.m_index, 0);
-	m_vertex = std::exchange(o.m_vertex, nullptr);
-	m_norm = std::exchange(o.m_norm, nullptr);
+	m_bounds = o.m_bounds;
+	std::swap(m_buf, o.m_buf);
+	m_nvert = std::exchange(o.m_nvert, 0);
+	m_eps = o.m_eps;
+	std::swap(m_lods, o.m_lods);
+	std::swap(m_clusters, o.m_clusters);
+	std::swap(m_chunks, o.m_chunks);
+	m_budget = o.m_budget;
+	m_cache = o.m_cache;
+	m_fix = o.m_fix;
+	std::swap(m_smooth, o.m_smooth);
+	std::swap(m_selem, o.m_selem);
+	std::swap(m_nsmooth, o.m_nsmooth);
+	std::swap(m_sbuf, o.m_sbuf);
+	m_crease = o.m_crease;
+	m_shade = o.m_shade;
+	std::swap(m_entry, o.m_entry);
 	return *this;
 }
 
-bool Solid::readFile(std::string f)
+bool Solid::readFile(std::string f, Loader l)
+{
+	if (l == Loader::CHUNKED) {
+		Profiler::Scope p("stream", "load");
+		return readChunked(f);
+	}
+	if (!load(f, l)) return false;
+
+	Profiler::Scope p("upload", "load");
+	upload();
+	return true;
+}
+
+bool Solid::load(std::string f, Loader l)
+{
+	// Report throughput so loaders can be compared
+	auto begin = std::chrono::steady_clock::now();
+	auto report = [&](const char *how) {
+		std::error_code ec;
+		uintmax_t bytes = std::filesystem::file_size(f, ec);
+		std::chrono::duration<double> sec = std::chrono::steady_clock::now() - begin;
+		double mbs = static_cast<double>(ec ? 0 : bytes) / (1024.0 * 1024.0) / std::max(sec.count(), 1e-9);
+		std::cout << "File " << how << " OK (" << m_max << " polygons, " << m_nvert << " vertices, "
+			<< std::round(mbs * 10.0) / 10.0 << " MB/s)" << std::endl;
+	};
+
+	auto cache = std::make_shared<Cache>(f, std::vector<double> { m_eps, static_cast<double>(m_fix), m_crease });
+	if (m_cache && cache->open()) {
+		Profiler::Scope p("cache read", "load");
+		if (readCache(cache)) {
+			report("read from cache");
+			return true;
+		}
+		std::cerr << "Ignoring damaged cache " << std::quoted(cache->getPath()) << std::endl;
+		clear();
+	}
+
+	{
+		Profiler::Scope p("parse", "load");
+		if (!parseFile(f, l)) return false;
+	}
+	weld();
+	report("read");
+
+	begin = std::chrono::steady_clock::now();
+	{
+		Profiler::Scope p("simplify", "load");
+		simplify();
+	}
+	if (!m_lods.empty()) {
+		std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - begin;
+		std::cout << "Levels of detail:";
+		for (const Solid& l : m_lods) std::cout << " " << l.m_max;
+		std::cout << " polygons (" << std::round(ms.count()) << " ms)" << std::endl;
+	}
+
+	if (m_cache) {
+		Profiler::Scope p("cache write", "load");
+		writeCache(*cache);
+	}
+	return true;
+}
+
+bool Solid::isCached(std::string f) const
+{
+	Cache c(f, { m_eps, static_cast<double>(m_fix), m_crease });
+	return m_cache && c.open();
+}
+
+bool Solid::readCache(const std::shared_ptr<const Cache>& c)
+{
+	const char *p = c->data();
+	size_t size = c->size();
+
+	// Number of levels, the bounds they share, their sizes, then each
+	// level's arrays
+	uint64_t n = 0;
+	if (size < sizeof n + sizeof(Bounds)) return false;
+	memcpy(&n, p, sizeof n);
+	if (n == 0 || n > 64 || size < sizeof n + sizeof(Bounds) + n * sizeof(Level)) return false;
+
+	Bounds bounds;
+	memcpy(static_cast<void *>(&bounds), p + sizeof n, sizeof bounds);
+	if (bounds.empty()) return false;
+	std::vector<Level> head(n);
+	memcpy(head.data(), p + sizeof n + sizeof bounds, n * sizeof(Level));
+	uint64_t total = sizeof n + sizeof bounds + n * sizeof(Level);
+	for (const Level& h : head) {
+		if (h.flat && h.flat != h.tris) return false;
+		total += static_cast<uint64_t>(h.flat) * 12 * sizeof(float)
+			+ static_cast<uint64_t>(h.verts) * 6 * sizeof(GLfloat) + static_cast<uint64_t>(h.tris) * 3 * sizeof(GLuint)
+			+ static_cast<uint64_t>(h.clusters) * sizeof(Cluster)
+			+ static_cast<uint64_t>(h.smooth) * 6 * sizeof(GLfloat) + (h.smooth ? static_cast<uint64_t>(h.tris) * 3 * sizeof(GLuint) : 0);
+	}
+	if (total != size) return false;
+
+	// The arrays point straight into the mapping, which is never written
+	// and stays open while any level uses it
+	clear();
+	m_lods.resize(n - 1);
+	p += sizeof n + sizeof bounds + n * sizeof(Level);
+	auto take = [&p](auto *&a, size_t k) {
+		using T = std::remove_reference_t<decltype(*a)>;
+		a = (k ? const_cast<T *>(reinterpret_cast<const T *>(p)) : nullptr);
+		p += k * sizeof(T);
+	};
+	for (size_t i = 0; i < n; ++i) {
+		Solid& s = (i == 0 ? *this : m_lods[i - 1]);
+		const Level& h = head[i];
+		s.m_entry = c;
+		s.m_max = s.m_len = h.tris;
+		s.m_nvert = h.verts;
+		s.m_nsmooth = h.smooth;
+		s.m_light = m_light;
+		s.m_shade = m_shade;
+		s.m_bounds = bounds;
+
+		size_t v = static_cast<size_t>(h.verts) * 3, e = static_cast<size_t>(h.tris) * 3;
+		take(s.m_pos, static_cast<size_t>(h.flat) * 9);
+		take(s.m_fnorm, static_cast<size_t>(h.flat) * 3);
+		take(s.m_vertex, v);
+		take(s.m_norm, v);
+		take(s.m_elem, e);
+		s.m_clusters.resize(h.clusters);
+		memcpy(s.m_clusters.data(), p, h.clusters * sizeof(Cluster));
+		p += h.clusters * sizeof(Cluster);
+		take(s.m_smooth, static_cast<size_t>(h.smooth) * 6);
+		take(s.m_selem, h.smooth ? e : 0);
+
+		// Indices are trusted by glDrawElements, so check them
+		for (size_t k = 0; k < e; ++k) {
+			if (s.m_elem[k] >= h.verts) return false;
+		}
+		for (size_t k = 0; s.m_selem && k < e; ++k) {
+			if (s.m_selem[k] >= h.smooth) return false;
+		}
+		for (const Cluster& k : s.m_clusters) {
+			if (static_cast<uint64_t>(k.first) + k.count > h.tris) return false;
+		}
+	}
+	return true;
+}
+
+bool Solid::writeCache(const Cache& c) const
+{
+	if (!m_elem) return false;
+
+	std::vector<const Solid *> lv = { this };
+	for (const Solid& l : m_lods) lv.push_back(&l);
+
+	// Only the solid itself keeps its triangles in file order, for picking
+	uint64_t n = lv.size();
+	std::vector<Level> head(n);
+	std::vector<Cache::Part> parts = { { &n, sizeof n }, { &m_bounds, sizeof m_bounds }, { head.data(), n * sizeof(Level) } };
+	for (size_t i = 0; i < n; ++i) {
+		const Solid& s = *lv[i];
+		uint32_t flat = (i == 0 && s.m_pos ? s.m_max : 0);
+		head[i] = Level { s.m_max, s.m_nvert, static_cast<uint32_t>(s.m_clusters.size()), s.m_nsmooth, flat };
+		parts.push_back({ s.m_pos, sizeof(float) * flat * 9 });
+		parts.push_back({ s.m_fnorm, sizeof(float) * flat * 3 });
+		parts.push_back({ s.m_vertex, sizeof(GLfloat) * s.m_nvert * 3 });
+		parts.push_back({ s.m_norm, sizeof(GLfloat) * s.m_nvert * 3 });
+		parts.push_back({ s.m_elem, sizeof(GLuint) * s.m_max * 3 });
+		parts.push_back({ s.m_clusters.data(), sizeof(Cluster) * s.m_clusters.size() });
+		parts.push_back({ s.m_smooth, sizeof(GLfloat) * s.m_nsmooth * 6 });
+		parts.push_back({ s.m_selem, (s.m_selem ? sizeof(GLuint) * s.m_max * 3 : 0) });
+	}
+	return c.write(parts);
+}
+
+void Solid::clear()
+{
+	release();
+	freeArrays();
+	m_max = m_len = m_nvert = 0;
+	m_lods.clear();
+	m_clusters.clear();
+	m_bounds = Bounds();
+}
+
+void Solid::freeArrays()
+{
+	// Arrays read from the cache belong to its mapping
+	if (!m_entry) {
+		delete[] m_pos;
+		delete[] m_fnorm;
+		delete[] m_vertex;
+		delete[] m_norm;
+		delete[] m_elem;
+		delete[] m_smooth;
+		delete[] m_selem;
+	}
+	m_entry.reset();
+	m_pos = m_fnorm = m_vertex = m_norm = m_smooth = nullptr;
+	m_elem = m_selem = nullptr;
+	m_nsmooth = 0;
+}
+
+bool Solid::parseFile(std::string f, Loader l)
 {
 	std::string ext = f.substr(f.find_last_of('.') + 1);
 	if (ext.compare("stl") && ext.compare("STL")) {
@@ -98,39 +427,96 @@ bool Solid::readFile(std::string f)
 		return false;
 	}
 
-	std::ifstream is (f, std::ifstream::binary);
-	if (!is) {
+	// Start over, the arrays may point into a cache entry read before
+	clear();
+
+	if (l == Loader::STREAM) {
+		std::ifstream is (f, std::ifstream::binary);
+		if (!is) {
+			std::cerr << "Couldn't open " << std::quoted(f) << std::endl;
+			return false;
+		}
+
+		// Peek at the header to tell text from binary files
+		char head[84] = {};
+		is.seekg(0, is.end);
+		size_t size = static_cast<size_t>(is.tellg());
+		is.seekg(0, is.beg);
+		is.read(head, 84);
+		is.clear();
+
+		// Text files are always parsed from a mapping
+		if (!isAscii(head, static_cast<size_t>(is.gcount()), size)) {
+			if (!readStream(is)) return false;
+			m_bounds.compute(m_pos, static_cast<size_t>(m_len) * 3);
+			checkNormals();
+			return true;
+		}
+	}
+
+	MappedFile mf;
+	if (!mf.open(f)) {
 		std::cerr << "Couldn't open " << std::quoted(f) << std::endl;
 		return false;
 	}
 
+	bool ok = (isAscii(mf.data(), mf.size(), mf.size()) ? readAscii(mf) : readMapped(mf, l == Loader::PARALLEL));
+	if (!ok) return false;
+	m_bounds.compute(m_pos, static_cast<size_t>(m_len) * 3);
+	checkNormals();
+	return true;
+}
+
+void Solid::checkNormals()
+{
+	// Fixed-size batches, so chunks of the pool write disjoint normals
+	Profiler::Scope p("normals", "load");
+	Normals check(TOLERANCE);
+	ThreadPool& pool = ThreadPool::shared();
+	std::vector<Normals::Stats> part(pool.chunks(m_max, 1 << 16));
+	pool.parallelFor(m_max, [&](size_t b, size_t e, size_t k) {
+		part[k] = check.check(m_pos + b * 9, m_fnorm + b * 3, static_cast<uint32_t>(e - b), m_fix);
+	}, 1 << 16);
+
+	Normals::Stats s = { 0, 0, 0, 0 };
+	for (const Normals::Stats& p : part) {
+		s.bad += p.bad;
+		s.missing += p.missing;
+		s.degenerate += p.degenerate;
+		s.replaced += p.replaced;
+	}
+	if (s.bad) std::cerr << "Warning: File may be corrupt (" << s.bad << " bad normals"
+		<< (m_fix ? ", replaced" : "") << ")" << std::endl;
+	if (s.missing || s.degenerate) std::cout << "Normals: " << s.missing << " missing, "
+		<< s.degenerate << " degenerate polygons" << std::endl;
+}
+
+bool Solid::readStream(std::ifstream& is)
+{
+	is.seekg(0, is.end);
+	uint64_t size = static_cast<uint64_t>(is.tellg());
+
 	// Skip file header
 	is.seekg(80, is.beg);
 
-	// Get machine endianness
-	bool le = endian();
-
 	// Read number of triangles
-	is.read((char *) &m_max, 4);
-	if (!le) swapEndian<uint32_t>(&m_max);
+	uint32_t n = 0;
+	is.read((char *) &n, 4);
+	if (!endian()) swapEndian<uint32_t>(&n);
 
-	// Re-initialize variables
-	m_len = 0;
-	delete[] m_arr;
-	m_arr = new Triangle[m_max];
-
-	if (m_arr == nullptr) {
-		std::cerr << "Not enough memory" << std::endl;
+	// Don't trust the count with an allocation before checking the size
+	if (84 + static_cast<uint64_t>(n) * 50 > size) {
+		std::cerr << "Read error (" << n << " polygons don't fit in "
+			<< size << " bytes)" << std::endl;
 		return false;
 	}
+	if (!reserve(n)) return false;
 
 	// Read all triangles
-	bool warn = false;
+	bool le = endian();
 	while(is.good() && m_len < m_max) {
-		Vector3 v[4]; // In order: norm, v0, v1, v2
+		float v[12]; // In order: norm, v0, v1, v2
 		for (int i = 0; i < 4; ++i) { // 4 vectors per triangle
-			float x, y, z; // 3 floats per vector
-
 			char buf[12];
 			is.read(buf, 12);
 
@@ -139,81 +525,606 @@ bool Solid::readFile(std::string f)
 				return false;
 			}
 
-			x = *((float *) buf);
-			y = *((float *) (buf + 4));
-			z = *((float *) (buf + 8));
+			memcpy(v + i * 3, buf, 12); // 3 floats per vector
+		}
+
+		// Do endianness swaps if necessary
+		if (!le) {
+			for (int i = 0; i < 12; ++i) swapEndian<float>(v + i);
+		}
+
+		if (!addFacet(v)) return false;
+
+		// Skip attribute bytes
+		is.seekg(2, is.cur);
+	}
+
+	if (m_len < m_max) {
+		std::cerr << "Read error" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Solid::readMapped(const MappedFile& mf, bool parallel)
+{
+	const char *p = mf.data();
+	size_t size = mf.size();
+
+	// Header (80 bytes) + triangle count (4 bytes)
+	if (size < 84) {
+		std::cerr << "Read error (file too small)" << std::endl;
+		return false;
+	}
+
+	uint32_t n;
+	memcpy(&n, p + 80, 4);
+	if (!endian()) swapEndian<uint32_t>(&n);
 
-			// Do endianness swaps if necessary
+	// Each record is 50 bytes: 12 floats + 2 attribute bytes
+	if (84 + static_cast<uint64_t>(n) * 50 > size) {
+		std::cerr << "Read error (" << n << " polygons don't fit in "
+			<< size << " bytes)" << std::endl;
+		return false;
+	}
+
+	if (!reserve(n)) return false;
+
+	// Decode records [b, e) into their slots
+	bool le = endian();
+	const char *rec = p + 84;
+	auto range = [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i) {
+			float v[12];
+			memcpy(v, rec + i * 50, 48);
 			if (!le) {
-				swapEndian<float>(&x);
-				swapEndian<float>(&y);
-				swapEndian<float>(&z);
+				for (int j = 0; j < 12; ++j) swapEndian<float>(v + j);
 			}
+			decode(v, static_cast<uint32_t>(i));
+		}
+	};
+
+	if (parallel) {
+		// Records are fixed-size, so each chunk decodes into its own slice
+		ThreadPool::shared().parallelFor(n, [&](size_t b, size_t e, size_t) { range(b, e); });
+	} else {
+		range(0, n);
+	}
+	m_len = n;
+	return true;
+}
+
+bool Solid::readHeader(std::istream& is, uint32_t& n) const
+{
+	char head[84] = {};
+	is.seekg(0, is.end);
+	uint64_t size = static_cast<uint64_t>(is.tellg());
+	is.seekg(0, is.beg);
+	is.read(head, 84);
+	if (!is || isAscii(head, 84, static_cast<size_t>(size))) return false;
+
+	memcpy(&n, head + 80, 4);
+	if (!endian()) swapEndian<uint32_t>(&n);
+	return 84 + static_cast<uint64_t>(n) * 50 <= size;
+}
+
+namespace {
+
+/** Check if text starts with a lowercase word, ignoring case, as text
+ * files may be written in either.
+ * @param p Text
+ * @param len Bytes available at p
+ * @param k Word in lowercase
+ * @return True if the first strlen(k) bytes match
+*/
+bool startsWith(const char *p, size_t len, const char *k)
+{
+	for (; *k; ++k, ++p, --len) {
+		if (!len || (*p | 0x20) != *k) return false;
+	}
+	return true;
+}
 
-			v[i] = Vector3(x, y, z);
+} // namespace
+
+bool Solid::isAscii(const char *p, size_t len, size_t size) const
+{
+	// Text files start with "solid", but so do some binary headers
+	size_t i = 0;
+	while (i < len && std::isspace(static_cast<unsigned char>(p[i]))) ++i;
+	if (!startsWith(p + i, len - i, "solid")) return false;
 
-			// Update upper & lower bounds
-			if (i > 0) {
-				m_upper.x = (m_upper.x < x ? x : m_upper.x);
-				m_upper.y = (m_upper.y < y ? y : m_upper.y);
-				m_upper.z = (m_upper.z < z ? z : m_upper.z);
+	// A binary file whose size matches its triangle count wins
+	if (len >= 84) {
+		uint32_t n;
+		memcpy(&n, p + 80, 4);
+		if (!endian()) swapEndian<uint32_t>(&n);
+		if (84 + static_cast<uint64_t>(n) * 50 == size) return false;
+	}
+	return true;
+}
 
-				m_lower.x = (m_lower.x > x ? x : m_lower.x);
-				m_lower.y = (m_lower.y > y ? y : m_lower.y);
-				m_lower.z = (m_lower.z > z ? z : m_lower.z);
+namespace {
+
+// Powers of ten that are exact as doubles
+const double kPow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c)
+{
+	return static_cast<unsigned>(c - '0') < 10;
+}
+
+inline void skipSpace(const char *&p, const char *end)
+{
+	while (p < end && isSpace(*p)) ++p;
+}
+
+/** Consume a case-insensitive keyword followed by whitespace or the end.
+ * @return True if the keyword was found
+*/
+bool keyword(const char *&p, const char *end, const char *k)
+{
+	skipSpace(p, end);
+	size_t n = strlen(k);
+	if (!startsWith(p, static_cast<size_t>(end - p), k)) return false;
+	const char *s = p + n;
+	if (s != end && !isSpace(*s)) return false;
+	p = s;
+	return true;
+}
+
+/** Scan a decimal floating point number without allocating.
+ * Up to 19 significant digits are kept, which is plenty for floats.
+ * @return True if a number was found
+*/
+bool scanFloat(const char *&p, const char *end, float& f)
+{
+	skipSpace(p, end);
+	const char *s = p;
+
+	bool neg = false;
+	if (s < end && (*s == '-' || *s == '+')) neg = (*s++ == '-');
+
+	uint64_t mant = 0;
+	int digits = 0;	// Significant digits in mant
+	int exp = 0;	// Decimal exponent applied to mant
+	bool any = false;
+
+	for (; s < end && isDigit(*s); ++s, any = true) {
+		if (digits < 19) {
+			mant = mant * 10 + static_cast<uint64_t>(*s - '0');
+			if (mant) ++digits;
+		} else {
+			++exp;
+		}
+	}
+
+	if (s < end && *s == '.') {
+		for (++s; s < end && isDigit(*s); ++s, any = true) {
+			if (digits < 19) {
+				mant = mant * 10 + static_cast<uint64_t>(*s - '0');
+				if (mant) ++digits;
+				--exp;
 			}
 		}
+	}
+	if (!any) return false;
 
-		// Check if normal vector and m_max are valid
-		Triangle t(v[1], v[2], v[3], v[0]);
-		if (!t.valid()) warn = true;
-		if (!append(t)) {
-			std::cerr << "Internal failure" << std::endl;
-			return false;
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		++s;
+		bool eneg = false;
+		if (s < end && (*s == '-' || *s == '+')) eneg = (*s++ == '-');
+		if (s == end || !isDigit(*s)) return false;
+
+		int e = 0;
+		for (; s < end && isDigit(*s); ++s) {
+			if (e < 10000) e = e * 10 + (*s - '0');
 		}
+		exp += (eneg ? -e : e);
+	}
+	if (s != end && !isSpace(*s)) return false;
 
-		// Skip attribute bytes
-		is.seekg(2, is.cur);
+	double v = static_cast<double>(mant);
+	if (mant != 0) {
+		if (exp < 0) v = (exp >= -22 ? v / kPow10[-exp] : v * std::pow(10.0, exp));
+		else if (exp > 0) v = (exp <= 22 ? v * kPow10[exp] : v * std::pow(10.0, exp));
 	}
 
-	if (warn) std::cerr << "Warning: File may be corrupt (bad normals)" << std::endl;
-	std::cout << "File read OK (" << m_max << " polygons)" << std::endl;
-	is.close();
+	f = static_cast<float>(neg ? -v : v);
+	p = s;
+	return true;
+}
+
+} // namespace
+
+bool Solid::readAscii(const MappedFile& mf)
+{
+	const char *begin = mf.data();
+	const char *end = begin + mf.size();
+
+	// Count facets up front so storage is allocated once, matching the
+	// keyword the way the parser does
+	uint64_t n = 0;
+	for (const char *s = begin; s + 8 <= end; ++s) {
+		if ((*s | 0x20) == 'e' && startsWith(s, static_cast<size_t>(end - s), "endfacet")) {
+			++n;
+			s += 7;
+		}
+	}
+	if (n > UINT32_MAX) {
+		std::cerr << "Read error (too many polygons)" << std::endl;
+		return false;
+	}
+	if (!reserve(static_cast<uint32_t>(n))) return false;
+
+	const char *p = begin;
+	bool ok = true;
+	while (ok) {
+		// A file may contain several solids, each with an optional name
+		if (!keyword(p, end, "solid")) break;
+		while (p < end && *p != '\n') ++p;
+
+		while (ok && !keyword(p, end, "endsolid")) {
+			float v[12]; // In order: norm, v0, v1, v2
+			ok = keyword(p, end, "facet") && keyword(p, end, "normal")
+				&& scanFloat(p, end, v[0]) && scanFloat(p, end, v[1]) && scanFloat(p, end, v[2])
+				&& keyword(p, end, "outer") && keyword(p, end, "loop");
+			for (int i = 1; ok && i < 4; ++i) {
+				ok = keyword(p, end, "vertex") && scanFloat(p, end, v[i * 3])
+					&& scanFloat(p, end, v[i * 3 + 1]) && scanFloat(p, end, v[i * 3 + 2]);
+			}
+			ok = ok && keyword(p, end, "endloop") && keyword(p, end, "endfacet") && m_len < m_max;
+			if (ok) decode(v, m_len++);
+		}
+
+		// Skip the name after "endsolid"
+		while (ok && p < end && *p != '\n') ++p;
+	}
 
-	genDisplayList();
+	skipSpace(p, end);
+	if (!ok || p != end) {
+		long line = 1 + std::count(begin, p, '\n');
+		std::cerr << "Parse error at line " << line << std::endl;
+		return false;
+	}
+	m_max = m_len; // In case a name contained "endfacet"
 	return true;
 }
 
+bool Solid::reserve(uint32_t n)
+{
+	// Re-initialize variables, without freeing arrays of a cache entry
+	freeArrays();
+	m_max = n;
+	m_len = 0;
+	m_pos = new (std::nothrow) float[static_cast<size_t>(m_max) * 9];
+	m_fnorm = new (std::nothrow) float[static_cast<size_t>(m_max) * 3];
+
+	if (m_pos == nullptr || m_fnorm == nullptr) {
+		std::cerr << "Not enough memory" << std::endl;
+		delete[] m_pos;
+		delete[] m_fnorm;
+		m_pos = m_fnorm = nullptr;
+		m_max = 0;
+		return false;
+	}
+	return true;
+}
+
+bool Solid::addFacet(const float *f)
+{
+	if (m_len >= m_max) {
+		std::cerr << "Internal failure" << std::endl;
+		return false;
+	}
+	decode(f, m_len++);
+	return true;
+}
+
+void Solid::decode(const float *f, uint32_t i)
+{
+	// Positions and normals go to separate streams
+	memcpy(m_fnorm + static_cast<size_t>(i) * 3, f, 3 * sizeof(float));
+	memcpy(m_pos + static_cast<size_t>(i) * 9, f + 3, 9 * sizeof(float));
+}
+
+void Solid::simplify()
+{
+	m_lods.clear();
+	if (m_max < LOD_MIN * 4) return;
+
+	// Each level continues collapsing where the previous one stopped
+	Simplifier simp(m_pos, m_max);
+	std::vector<float> facets;
+	for (uint32_t target = m_max / 4; target >= LOD_MIN; target /= 4) {
+		uint32_t prev = (m_lods.empty() ? m_max : m_lods.back().m_max);
+		if (simp.simplify(target) > prev - prev / 4) break; // Not worth a level
+
+		Solid lod;
+		simp.getFacets(facets);
+		if (!lod.reserve(simp.size())) break;
+		bool ok = true;
+		for (size_t i = 0; i < facets.size() && ok; i += 12) ok = lod.addFacet(&facets[i]);
+		if (!ok) break;
+		lod.m_bounds = m_bounds;
+		lod.m_light = m_light;
+		lod.m_crease = m_crease;
+		lod.m_shade = m_shade;
+		lod.weld();
+		m_lods.push_back(std::move(lod));
+	}
+}
+
+const Solid& Solid::getLod(uint32_t n) const
+{
+	if (m_max <= n || m_lods.empty()) return *this;
+	for (const Solid& l : m_lods) {
+		if (l.m_max <= n) return l;
+	}
+	return m_lods.back();
+}
+
+void Solid::setOptions(const Options& o)
+{
+	setWeldEpsilon(o.eps);
+	setCreaseAngle(o.crease);
+	setMemoryBudget(o.budget);
+	setCache(o.cache);
+	setFixNormals(o.fix);
+}
+
+void Solid::setWeldEpsilon(double e)
+{
+	m_eps = (e >= 0 ? e : 0);
+}
+
+void Solid::setCache(bool b)
+{
+	m_cache = b;
+}
+
+void Solid::setFixNormals(bool b)
+{
+	m_fix = b;
+}
+
+void Solid::setMemoryBudget(size_t b)
+{
+	m_budget = b;
+}
+
+size_t Solid::getMemoryBudget() const
+{
+	return m_budget;
+}
+
 void Solid::toggleLight()
 {
 	m_light = !m_light;
+	for (Solid& l : m_lods) l.m_light = m_light;
 	if (m_light) glEnable(GL_LIGHTING);
 	else glDisable(GL_LIGHTING);
-	genDisplayList();
 }
 
-GLuint Solid::getList() const
+void Solid::draw() const
+{
+	if (!m_buf[2] && m_chunks.empty()) return;
+
+	bind();
+	if (m_chunks.empty()) {
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_max * 3), GL_UNSIGNED_INT, nullptr);
+	}
+	for (const Chunk& ch : m_chunks) {
+		bind(ch);
+		glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(ch.count * 3));
+	}
+	unbind();
+}
+
+void Solid::draw(const std::vector<uint32_t>& c) const
 {
-	return m_index;
+	if ((!m_buf[2] && m_chunks.empty()) || c.empty()) return;
+
+	if (!m_chunks.empty()) {
+		// Clusters don't straddle chunks, so draw each chunk's share
+		bind();
+		size_t i = 0;
+		std::vector<GLint> first;
+		std::vector<GLsizei> count;
+		for (const Chunk& ch : m_chunks) {
+			first.clear();
+			count.clear();
+			for (; i < c.size() && m_clusters[c[i]].first < ch.first + ch.count; ++i) {
+				const Cluster& k = m_clusters[c[i]];
+				GLint f = static_cast<GLint>((k.first - ch.first) * 3);
+				GLsizei n = static_cast<GLsizei>(k.count * 3);
+				if (!first.empty() && first.back() + count.back() == f) count.back() += n;
+				else {
+					first.push_back(f);
+					count.push_back(n);
+				}
+			}
+			if (first.empty()) continue;
+			bind(ch);
+			glMultiDrawArrays(GL_TRIANGLES, first.data(), count.data(), static_cast<GLsizei>(first.size()));
+		}
+		unbind();
+		return;
+	}
+
+	// Neighbouring clusters are drawn as one range
+	std::vector<GLsizei> count;
+	std::vector<const void *> offset;
+	for (size_t i = 0; i < c.size(); ++i) {
+		const Cluster& k = m_clusters[c[i]];
+		GLsizei n = static_cast<GLsizei>(k.count * 3);
+		if (i > 0 && c[i - 1] + 1 == c[i]) {
+			count.back() += n;
+		} else {
+			count.push_back(n);
+			offset.push_back(reinterpret_cast<const void *>(sizeof(GLuint) * k.first * 3));
+		}
+	}
+
+	bind();
+	glMultiDrawElements(GL_TRIANGLES, count.data(), GL_UNSIGNED_INT, offset.data(), static_cast<GLsizei>(count.size()));
+	unbind();
+}
+
+void Solid::drawInstanced(GLsizei n) const
+{
+	if ((!m_buf[2] && m_chunks.empty()) || n <= 0) return;
+
+	bind();
+	if (m_chunks.empty()) {
+		glDrawElementsInstancedARB(GL_TRIANGLES, static_cast<GLsizei>(m_max * 3), GL_UNSIGNED_INT, nullptr, n);
+	}
+	for (const Chunk& ch : m_chunks) {
+		bind(ch);
+		glDrawArraysInstancedARB(GL_TRIANGLES, 0, static_cast<GLsizei>(ch.count * 3), n);
+	}
+	unbind();
+}
+
+const std::vector<Solid::Cluster>& Solid::getClusters() const
+{
+	return m_clusters;
+}
+
+void Solid::bind() const
+{
+	glColor3f(1.f, 1.f, 1.f); // TODO: Add option to change default color
+
+	// Normals only need to be sourced while lighting is on
+	glEnableClientState(GL_VERTEX_ARRAY);
+	if (m_light) glEnableClientState(GL_NORMAL_ARRAY);
+	if (!m_chunks.empty()) return;
+
+	// Without lighting both sets of buffers look the same
+	if (m_light && m_shade && m_sbuf[0]) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_sbuf[0]);
+		glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), nullptr);
+		glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), reinterpret_cast<const void *>(3 * sizeof(GLfloat)));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_sbuf[1]);
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_buf[0]);
+	glVertexPointer(3, GL_FLOAT, 0, nullptr);
+	if (m_light) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_buf[1]);
+		glNormalPointer(GL_FLOAT, 0, nullptr);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buf[2]);
+}
+
+void Solid::bind(const Chunk& c) const
+{
+	glBindBuffer(GL_ARRAY_BUFFER, c.buf);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), nullptr);
+	if (m_light) glNormalPointer(GL_BYTE, sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, norm)));
+}
+
+void Solid::unbind() const
+{
+	glDisableClientState(GL_VERTEX_ARRAY);
+	if (m_light) glDisableClientState(GL_NORMAL_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 double Solid::getRadius() const
 {
-	return (getCenter() - m_lower).mag();
+	return m_bounds.getRadius();
 }
 
 Vector3 Solid::getCenter() const
 {
-	return (m_upper + m_lower) / 2.0;
+	return m_bounds.getCenter();
 }
 
-bool Solid::append(const Triangle& t)
+const Bounds& Solid::getBounds() const
 {
-	if (m_len < m_max && m_arr) {
-		m_arr[m_len++] = t;
-		return true;
-	}
-	return false;
+	return m_bounds;
+}
+
+void Solid::toggleSmooth()
+{
+	m_shade = !m_shade;
+	for (Solid& l : m_lods) l.m_shade = m_shade;
+	glShadeModel(m_shade ? GL_SMOOTH : GL_FLAT);
+}
+
+bool Solid::getSmooth() const
+{
+	return m_shade;
+}
+
+void Solid::setCreaseAngle(double a)
+{
+	m_crease = std::clamp(a, 0.0, 180.0);
+}
+
+bool Solid::getLight() const
+{
+	return m_light;
+}
+
+uint32_t Solid::size() const
+{
+	return m_max;
+}
+
+const float *Solid::getPositions() const
+{
+	return m_pos;
+}
+
+const float *Solid::getNormals() const
+{
+	return m_fnorm;
+}
+
+const float *Solid::getVertices() const
+{
+	return m_vertex;
+}
+
+const float *Solid::getVertexNormals() const
+{
+	return m_norm;
+}
+
+uint32_t Solid::vertexCount() const
+{
+	return m_nvert;
+}
+
+const uint32_t *Solid::getIndices() const
+{
+	return m_elem;
+}
+
+Triangle Solid::getTriangle(uint32_t i) const
+{
+	if (i >= m_max || !m_pos) return Triangle();
+	const float *p = m_pos + static_cast<size_t>(i) * 9;
+	const float *n = m_fnorm + static_cast<size_t>(i) * 3;
+	return Triangle(
+		Vector3(p[0], p[1], p[2]),
+		Vector3(p[3], p[4], p[5]),
+		Vector3(p[6], p[7], p[8]),
+		Vector3(n[0], n[1], n[2])
+	);
 }
 
 bool Solid::endian() const
@@ -235,64 +1146,549 @@ void Solid::swapEndian(T *p) const
 	memcpy(p, &temp, sizeof(T));
 }
 
-void Solid::genDisplayList()
+void Solid::weld()
 {
-	// Don't create new arrays if no triangles in solid
-	if (m_max <= 0) {
-		glDeleteLists(m_index, 1);
-		m_index = 0;
-		return;
+	Profiler::Scope p("weld", "load");
+	if (m_entry) return; // Read from the cache, welded already
+	delete[] m_vertex;
+	delete[] m_norm;
+	delete[] m_elem;
+	m_vertex = m_norm = nullptr;
+	m_elem = nullptr;
+	m_nvert = 0;
+	if (m_max == 0) return;
+
+	// Vertices are chained per hash grid cell
+	std::vector<GLfloat> vert;
+	std::vector<uint32_t> next;
+	std::unordered_map<uint64_t, uint32_t> head;
+	vert.reserve(static_cast<size_t>(m_max) * 3);
+	next.reserve(m_max);
+	head.reserve(m_max);
+
+	auto mix = [](uint64_t x, uint64_t y, uint64_t z) {
+		uint64_t h = x * 0x9E3779B97F4A7C15ull ^ y * 0xC2B2AE3D27D4EB4Full ^ z * 0x165667B19E3779F9ull;
+		return h ^ (h >> 29);
+	};
+	auto chain = [&](uint64_t key) {
+		auto it = head.find(key);
+		return (it == head.end() ? UINT32_MAX : it->second);
+	};
+
+	// Cell indices are 64-bit integers, so a tiny distance far from the
+	// origin would overflow them; only exact matches are merged then
+	double eps = m_eps;
+	if (eps > 0) {
+		float far = 0;
+		for (size_t k = 0; k < static_cast<size_t>(m_max) * 9; ++k) far = std::max(far, std::abs(m_pos[k]));
+		if (!(far / eps < CELL_LIMIT)) {
+			std::cerr << "Weld distance " << eps << " is too small for coordinates up to " << far
+				<< ", merging identical vertices only" << std::endl;
+			eps = 0;
+		}
 	}
+	const double eps2 = eps * eps;
+	auto cell = [eps](float f) {
+		// Infinite & NaN coordinates all go to one cell, they match nothing
+		double c = std::floor(f / eps);
+		if (!(std::abs(c) < CELL_LIMIT)) c = 0;
+		return static_cast<uint64_t>(static_cast<int64_t>(c));
+	};
 
-	// Construct new vertex array
-	glEnableClientState(GL_VERTEX_ARRAY);
-	m_vertex = new GLdouble[m_max * 9];
+	std::vector<GLuint> elem(static_cast<size_t>(m_max) * 3);
 	for (uint32_t i = 0; i < m_max; ++i) { // Each triangle
-		Triangle &t = m_arr[i];
 		for (uint32_t j = 0; j < 3; ++j) { // Each vertex
-			Vector3 v = t.getVertex(j);
-			uint32_t p = i * 9 + j * 3;
-			m_vertex[p] = v.x;
-			m_vertex[p + 1] = v.y;
-			m_vertex[p + 2] = v.z;
+			const float *v = m_pos + (static_cast<size_t>(i) * 3 + j) * 3;
+			float p[3] = { v[0] + 0.f, v[1] + 0.f, v[2] + 0.f }; // Also turns -0 into +0
+
+			uint32_t found = UINT32_MAX;
+			uint64_t key;
+			if (eps <= 0) {
+				// Only bitwise identical positions are merged
+				uint32_t b[3];
+				memcpy(b, p, sizeof b);
+				key = mix(b[0], b[1], b[2]);
+				for (uint32_t k = chain(key); k != UINT32_MAX && found == UINT32_MAX; k = next[k]) {
+					if (!memcmp(&vert[k * 3], p, sizeof p)) found = k;
+				}
+			} else {
+				// Anything within eps lies in one of the 27 surrounding cells
+				uint64_t c[3] = { cell(p[0]), cell(p[1]), cell(p[2]) };
+				key = mix(c[0], c[1], c[2]);
+				for (int n = 0; n < 27 && found == UINT32_MAX; ++n) {
+					uint64_t nk = mix(c[0] + static_cast<uint64_t>(n % 3 - 1),
+						c[1] + static_cast<uint64_t>(n / 3 % 3 - 1),
+						c[2] + static_cast<uint64_t>(n / 9 - 1));
+					for (uint32_t k = chain(nk); k != UINT32_MAX && found == UINT32_MAX; k = next[k]) {
+						double dx = vert[k * 3] - p[0];
+						double dy = vert[k * 3 + 1] - p[1];
+						double dz = vert[k * 3 + 2] - p[2];
+						if (dx * dx + dy * dy + dz * dz <= eps2) found = k;
+					}
+				}
+			}
+
+			if (found == UINT32_MAX) {
+				found = static_cast<uint32_t>(next.size());
+				vert.insert(vert.end(), p, p + 3);
+				next.push_back(chain(key));
+				head[key] = found;
+			}
+			elem[i * 3 + j] = found;
 		}
 	}
-	glVertexPointer(3, GL_DOUBLE, 0, m_vertex);
 
-	// Construct new normal array
-	if (m_light) {
-		glEnableClientState(GL_NORMAL_ARRAY);
-		m_norm = new GLdouble[m_max * 9];
-		for (uint32_t i = 0; i < m_max; ++i) { // Each triangle
-			Vector3 v = m_arr[i].getNormal();
-			for (uint32_t j = 0; j < 3; ++j) { // Each vertex
-				uint32_t p = i * 9 + j * 3;
-				m_norm[p] = v.x;
-				m_norm[p + 1] = v.y;
-				m_norm[p + 2] = v.z;
+	// With flat shading the last vertex of a triangle provides its normal,
+	// so give each triangle a last vertex it doesn't share with another
+	// triangle, duplicating a vertex only when all three are taken
+	uint32_t welded = static_cast<uint32_t>(next.size());
+	std::vector<char> owned(welded, 0);
+	std::vector<GLfloat> norm(vert.size(), 0.f);
+	std::vector<uint32_t> base(welded); // Welded vertex each vertex is a copy of
+	std::iota(base.begin(), base.end(), 0);
+	for (uint32_t i = 0; i < m_max; ++i) {
+		GLuint *e = &elem[i * 3];
+		if (owned[e[2]]) {
+			if (!owned[e[0]]) std::rotate(e, e + 1, e + 3);
+			else if (!owned[e[1]]) std::rotate(e, e + 2, e + 3);
+			else {
+				GLuint d = static_cast<GLuint>(owned.size());
+				vert.insert(vert.end(), { vert[e[2] * 3], vert[e[2] * 3 + 1], vert[e[2] * 3 + 2] });
+				norm.insert(norm.end(), 3, 0.f);
+				owned.push_back(0);
+				base.push_back(base[e[2]]);
+				e[2] = d;
 			}
 		}
-		glNormalPointer(GL_DOUBLE, 0, m_norm);
-	} else {
-		glDisableClientState(GL_NORMAL_ARRAY);
+
+		owned[e[2]] = 1;
+		memcpy(&norm[e[2] * 3], m_fnorm + static_cast<size_t>(i) * 3, 3 * sizeof(GLfloat));
 	}
 
-	// Delete old list if exists
-	glDeleteLists(m_index, 1);
+	m_nvert = static_cast<uint32_t>(owned.size());
+	m_vertex = new GLfloat[vert.size()];
+	m_norm = new GLfloat[norm.size()];
+	m_elem = new GLuint[elem.size()];
+	std::copy(vert.begin(), vert.end(), m_vertex);
+	std::copy(norm.begin(), norm.end(), m_norm);
+	std::copy(elem.begin(), elem.end(), m_elem);
+	cluster();
 
-	// Create new list
-	m_index = glGenLists(1);
-	glNewList(m_index, GL_COMPILE);
-		glColor3f(1.f, 1.f, 1.f); // TODO: Add option to change default color
-		glDrawArrays(GL_TRIANGLES, 0, m_max * 3);
-	glEndList();
+	Profiler::Scope q("smooth", "load");
+	smooth(base, welded);
+}
 
-	// Disable & clear arrays
-	glDisableClientState(GL_VERTEX_ARRAY);
-	if (m_light) glDisableClientState(GL_NORMAL_ARRAY);
+void Solid::smooth(const std::vector<uint32_t>& base, uint32_t welded)
+{
+	delete[] m_smooth;
+	delete[] m_selem;
+	m_smooth = nullptr;
+	m_selem = nullptr;
+	m_nsmooth = 0;
+	if (!m_elem || m_max == 0) return;
+	ThreadPool& pool = ThreadPool::shared();
 
-	delete[] m_vertex; // OpenGL stores vertex data, we can freely delete these
-	delete[] m_norm;
-	m_vertex = m_norm  = nullptr;
+	// Area-weighted face normals, i.e. cross products
+	std::vector<float> face(static_cast<size_t>(m_max) * 3);
+	pool.parallelFor(m_max, [&](size_t b, size_t e, size_t) {
+		for (size_t i = b; i < e; ++i) {
+			const GLfloat *p[3];
+			for (int k = 0; k < 3; ++k) p[k] = m_vertex + m_elem[i * 3 + k] * 3;
+			float u[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+			float v[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+			face[i * 3] = u[1] * v[2] - u[2] * v[1];
+			face[i * 3 + 1] = u[2] * v[0] - u[0] * v[2];
+			face[i * 3 + 2] = u[0] * v[1] - u[1] * v[0];
+		}
+	});
+
+	// Corners around each welded vertex
+	std::vector<uint32_t> start(static_cast<size_t>(welded) + 1, 0), adj(static_cast<size_t>(m_max) * 3);
+	for (size_t c = 0; c < adj.size(); ++c) ++start[base[m_elem[c]] + 1];
+	std::partial_sum(start.begin(), start.end(), start.begin());
+	std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+	for (size_t c = 0; c < adj.size(); ++c) adj[fill[base[m_elem[c]]]++] = static_cast<uint32_t>(c);
+
+	// Group each vertex's triangles by the first one of the group they're
+	// within the crease angle of, then sum each group's normals
+	const double limit = std::cos(m_crease * PI / 180.0);
+	std::vector<uint32_t> group(adj.size()), count(welded);
+	auto groups = [&](uint32_t v, bool sum, GLfloat *out) {
+		std::vector<uint32_t> seed;
+		for (uint32_t k = start[v]; k < start[v + 1]; ++k) {
+			const float *n = &face[adj[k] / 3 * 3];
+			double len = std::sqrt(static_cast<double>(n[0]) * n[0] + static_cast<double>(n[1]) * n[1] + static_cast<double>(n[2]) * n[2]);
+			uint32_t g = 0;
+			for (; g < seed.size() && len > 0; ++g) {
+				const float *m = &face[seed[g] / 3 * 3];
+				double ml = std::sqrt(static_cast<double>(m[0]) * m[0] + static_cast<double>(m[1]) * m[1] + static_cast<double>(m[2]) * m[2]);
+				if (ml > 0 && (static_cast<double>(n[0]) * m[0] + static_cast<double>(n[1]) * m[1] + static_cast<double>(n[2]) * m[2]) >= limit * len * ml) break;
+			}
+			if (g == seed.size() && (len > 0 || seed.empty())) seed.push_back(adj[k]);
+			if (g == seed.size()) g = 0; // Slivers join the first group
+			group[k] = g;
+			if (!sum) continue;
+
+			GLfloat *o = out + g * 6;
+			for (int a = 0; a < 3; ++a) o[3 + a] += n[a];
+		}
+		if (!sum) count[v] = static_cast<uint32_t>(seed.size());
+	};
+
+	pool.parallelFor(welded, [&](size_t b, size_t e, size_t) {
+		for (size_t v = b; v < e; ++v) groups(static_cast<uint32_t>(v), false, nullptr);
+	});
+	std::vector<uint32_t> first(static_cast<size_t>(welded) + 1, 0);
+	std::partial_sum(count.begin(), count.end(), first.begin() + 1);
+
+	m_nsmooth = first.back();
+	m_smooth = new GLfloat[static_cast<size_t>(m_nsmooth) * 6]();
+	m_selem = new GLuint[adj.size()];
+	pool.parallelFor(welded, [&](size_t b, size_t e, size_t) {
+		for (size_t v = b; v < e; ++v) {
+			if (start[v] == start[v + 1]) continue;
+			GLfloat *out = &m_smooth[first[v] * 6];
+			groups(static_cast<uint32_t>(v), true, out);
+
+			const GLfloat *p = m_vertex + m_elem[adj[start[v]]] * 3;
+			for (uint32_t g = 0; g < count[v]; ++g) {
+				GLfloat *o = out + g * 6;
+				double len = std::sqrt(static_cast<double>(o[3]) * o[3] + static_cast<double>(o[4]) * o[4] + static_cast<double>(o[5]) * o[5]);
+				for (int a = 0; a < 3; ++a) {
+					o[a] = p[a];
+					o[3 + a] = (len > 0 ? static_cast<GLfloat>(o[3 + a] / len) : 0.f);
+				}
+			}
+			for (uint32_t k = start[v]; k < start[v + 1]; ++k) m_selem[adj[k]] = first[v] + group[k];
+		}
+	});
+}
+
+namespace {
+
+/** Spread the low 10 bits of a number out to every third bit.
+*/
+inline uint32_t spread(uint32_t x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x30000ff;
+	x = (x | (x << 8)) & 0x300f00f;
+	x = (x | (x << 4)) & 0x30c30c3;
+	x = (x | (x << 2)) & 0x9249249;
+	return x;
+}
+
+/** Get the Morton code of a point within a box.
+ * @param p The point
+ * @param lo Lower corner of the box
+ * @param hi Upper corner of the box
+ * @return 10 bits per axis, interleaved
+*/
+inline uint32_t morton(const float *p, const float *lo, const float *hi)
+{
+	uint32_t code = 0;
+	for (int a = 0; a < 3; ++a) {
+		float t = (hi[a] > lo[a] ? (p[a] - lo[a]) / (hi[a] - lo[a]) : 0.f);
+		code |= spread(static_cast<uint32_t>(std::clamp(t, 0.f, 1.f) * 1023.f)) << a;
+	}
+	return code;
 }
 
+/** Compute the bounds & normal cone of a run of triangles.
+ * @param first First triangle
+ * @param count Number of triangles
+ * @param get Called with an index in [0, count) and 3 vertices to fill in
+ * @return The cluster
+*/
+template<typename F>
+Solid::Cluster bound(uint32_t first, uint32_t count, F get)
+{
+	Solid::Cluster c;
+	c.first = first;
+	c.count = count;
+	std::fill(c.min, c.min + 3, std::numeric_limits<float>::max());
+	std::fill(c.max, c.max + 3, std::numeric_limits<float>::lowest());
+
+	std::vector<Vector3> n(count);
+	Vector3 sum;
+	for (uint32_t i = 0; i < count; ++i) {
+		Vector3 v[3];
+		get(i, v);
+		for (const Vector3& p : v) {
+			float f[3] = { static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z) };
+			for (int a = 0; a < 3; ++a) {
+				c.min[a] = std::min(c.min[a], f[a]);
+				c.max[a] = std::max(c.max[a], f[a]);
+			}
+		}
+
+		// Facing comes from the winding, file normals may be wrong
+		n[i] = (v[1] - v[0]).cross(v[2] - v[0]);
+		if (n[i].mag() > 0) n[i] = n[i].norm();
+		sum = sum + n[i];
+	}
+
+	// Widest angle between a normal and the average one
+	double cos = 1;
+	if (sum.mag() > 0) {
+		sum = sum.norm();
+		for (const Vector3& v : n) {
+			if (v.mag() > 0) cos = std::min(cos, v.dot(sum));
+		}
+	}
+	c.axis[0] = static_cast<float>(sum.x);
+	c.axis[1] = static_cast<float>(sum.y);
+	c.axis[2] = static_cast<float>(sum.z);
+	c.cutoff = (cos > 0 && sum.mag() > 0 ? static_cast<float>(std::sqrt(1 - cos * cos)) : 2.f);
+	return c;
+}
+
+} // namespace
+
+void Solid::cluster()
+{
+	m_clusters.clear();
+	if (!m_elem || m_max == 0) return;
+
+	// Bounds of the welded vertices
+	float lo[3] = { m_vertex[0], m_vertex[1], m_vertex[2] }, hi[3] = { lo[0], lo[1], lo[2] };
+	for (size_t i = 0; i < static_cast<size_t>(m_nvert) * 3; i += 3) {
+		for (int a = 0; a < 3; ++a) {
+			lo[a] = std::min(lo[a], m_vertex[i + a]);
+			hi[a] = std::max(hi[a], m_vertex[i + a]);
+		}
+	}
+
+	// Order triangles along a Morton curve through their centroids
+	std::vector<uint64_t> key(m_max);
+	for (uint32_t i = 0; i < m_max; ++i) {
+		float c[3];
+		for (int a = 0; a < 3; ++a) {
+			c[a] = (m_vertex[m_elem[i * 3] * 3 + a] + m_vertex[m_elem[i * 3 + 1] * 3 + a]
+				+ m_vertex[m_elem[i * 3 + 2] * 3 + a]) / 3.f;
+		}
+		key[i] = static_cast<uint64_t>(morton(c, lo, hi)) << 32 | i;
+	}
+	std::sort(key.begin(), key.end());
+
+	std::vector<GLuint> elem(m_elem, m_elem + static_cast<size_t>(m_max) * 3);
+	for (uint32_t i = 0; i < m_max; ++i) {
+		memcpy(m_elem + i * 3, &elem[(key[i] & 0xffffffff) * 3], 3 * sizeof(GLuint));
+	}
+
+	// Bounds & normal cone of each run of triangles
+	for (uint32_t first = 0; first < m_max; first += CLUSTER) {
+		uint32_t count = std::min<uint32_t>(CLUSTER, m_max - first);
+		m_clusters.push_back(bound(first, count, [&](uint32_t i, Vector3 *v) {
+			const GLuint *e = m_elem + static_cast<size_t>(first + i) * 3;
+			for (int k = 0; k < 3; ++k) {
+				const GLfloat *p = m_vertex + e[k] * 3;
+				v[k] = Vector3(p[0], p[1], p[2]);
+			}
+		}));
+	}
+}
+
+bool Solid::readChunked(std::string f)
+{
+	std::string ext = f.substr(f.find_last_of('.') + 1);
+	if (ext.compare("stl") && ext.compare("STL")) {
+		std::cerr << "Invalid file type " << std::quoted(ext) << std::endl;
+		return false;
+	}
+
+	std::ifstream is(f, std::ifstream::binary);
+	if (!is) {
+		std::cerr << "Couldn't open " << std::quoted(f) << std::endl;
+		return false;
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	char head[84] = {};
+	is.seekg(0, is.end);
+	uint64_t size = static_cast<uint64_t>(is.tellg());
+	is.seekg(0, is.beg);
+	is.read(head, 84);
+	if (isAscii(head, static_cast<size_t>(is.gcount()), static_cast<size_t>(size))) {
+		std::cerr << "Text files can't be streamed, reading it whole" << std::endl;
+		return readFile(f, Loader::MMAP);
+	}
+
+	uint32_t n = 0;
+	memcpy(&n, head + 80, 4);
+	if (!endian()) swapEndian<uint32_t>(&n);
+	if (is.gcount() != 84 || 84 + static_cast<uint64_t>(n) * 50 > size) {
+		std::cerr << "Read error (" << n << " polygons don't fit in "
+			<< size << " bytes)" << std::endl;
+		return false;
+	}
+
+	// Start over without any CPU copy
+	clear();
+
+	// Records per chunk, each needs 50 bytes read, 48 decoded, a sort key & 3 vertices
+	size_t per = m_budget / (50 + 48 + sizeof(uint64_t) + 3 * sizeof(Vertex)) / CLUSTER * CLUSTER;
+	per = std::min<size_t>(std::max<size_t>(per, CLUSTER), n);
+	std::vector<char> raw(per * 50);
+
+	bool warn = false;
+	for (uint32_t done = 0; done < n;) {
+		uint32_t k = static_cast<uint32_t>(std::min<size_t>(per, n - done));
+		is.read(raw.data(), static_cast<std::streamsize>(k) * 50);
+		if (is.gcount() != static_cast<std::streamsize>(k) * 50) {
+			std::cerr << "Read error" << std::endl;
+			clear();
+			return false;
+		}
+		if (!append(raw.data(), k)) warn = true;
+		done += k;
+	}
+
+	std::chrono::duration<double> sec = std::chrono::steady_clock::now() - begin;
+	double mb = static_cast<double>(size) / (1024.0 * 1024.0);
+	std::cout << "File streamed OK (" << n << " polygons in " << m_chunks.size() << " chunks of "
+		<< std::round(static_cast<double>(per * (50 + 48 + sizeof(uint64_t) + 3 * sizeof(Vertex))) / (1024.0 * 1024.0) * 10.0) / 10.0
+		<< " MB, " << std::round(mb / std::max(sec.count(), 1e-9) * 10.0) / 10.0 << " MB/s)" << std::endl;
+	if (warn) std::cerr << "Warning: File may be corrupt (bad normals)" << std::endl;
+	return true;
+}
+
+bool Solid::append(const char *r, uint32_t k)
+{
+	Prepared c;
+	prepare(r, k, c);
+	return append(c);
+}
+
+void Solid::prepare(const char *r, uint32_t k, Prepared& out) const
+{
+	out.vert.clear();
+	out.clusters.clear();
+	out.bounds = Bounds();
+	out.ok = true;
+	if (k == 0) return;
+
+	// Split the records into positions & normals, and check those
+	bool le = endian();
+	std::vector<float> pos(static_cast<size_t>(k) * 9), nrm(static_cast<size_t>(k) * 3);
+	for (uint32_t i = 0; i < k; ++i) {
+		float v[12]; // In order: norm, v0, v1, v2
+		memcpy(v, r + static_cast<size_t>(i) * 50, 48);
+		if (!le) {
+			for (int j = 0; j < 12; ++j) swapEndian<float>(v + j);
+		}
+		memcpy(&nrm[i * 3], v, 3 * sizeof(float));
+		memcpy(&pos[i * 9], v + 3, 9 * sizeof(float));
+	}
+	out.ok = Normals(TOLERANCE).check(pos.data(), nrm.data(), k, m_fix).bad == 0;
+
+	// Box of the chunk, the oriented box & sphere are left for the full solid
+	out.bounds.computeBox(pos.data(), static_cast<size_t>(k) * 3);
+	Vector3 l = out.bounds.getLower(), h = out.bounds.getUpper();
+	const float lo[3] = { static_cast<float>(l.x), static_cast<float>(l.y), static_cast<float>(l.z) };
+	const float hi[3] = { static_cast<float>(h.x), static_cast<float>(h.y), static_cast<float>(h.z) };
+
+	// Convert records along a Morton curve so clusters are compact
+	std::vector<uint64_t> key(k);
+	for (uint32_t i = 0; i < k; ++i) {
+		const float *p = &pos[i * 9];
+		float c[3];
+		for (int a = 0; a < 3; ++a) c[a] = (p[a] + p[3 + a] + p[6 + a]) / 3.f;
+		key[i] = static_cast<uint64_t>(morton(c, lo, hi)) << 32 | i;
+	}
+	std::sort(key.begin(), key.end());
+
+	std::vector<Vertex>& vert = out.vert;
+	vert.resize(static_cast<size_t>(k) * 3);
+	for (uint32_t i = 0; i < k; ++i) {
+		uint32_t o = static_cast<uint32_t>(key[i] & 0xffffffff);
+		const float *n = &nrm[o * 3];
+		GLbyte b[4] = {
+			static_cast<GLbyte>(std::lround(std::clamp(n[0], -1.f, 1.f) * 127)),
+			static_cast<GLbyte>(std::lround(std::clamp(n[1], -1.f, 1.f) * 127)),
+			static_cast<GLbyte>(std::lround(std::clamp(n[2], -1.f, 1.f) * 127)),
+			0
+		};
+		for (int j = 0; j < 3; ++j) {
+			Vertex& v = vert[i * 3 + j];
+			memcpy(v.pos, &pos[o * 9 + j * 3], 3 * sizeof(GLfloat));
+			memcpy(v.norm, b, sizeof b);
+		}
+	}
+
+	// Runs of sorted triangles make the clusters
+	for (uint32_t c = 0; c < k; c += CLUSTER) {
+		out.clusters.push_back(bound(c, std::min<uint32_t>(CLUSTER, k - c), [&](uint32_t i, Vector3 *p) {
+			for (int j = 0; j < 3; ++j) {
+				const GLfloat *q = vert[(c + i) * 3 + j].pos;
+				p[j] = Vector3(q[0], q[1], q[2]);
+			}
+		}));
+	}
+}
+
+bool Solid::append(Prepared& c)
+{
+	if (m_elem) clear();
+	uint32_t k = static_cast<uint32_t>(c.vert.size() / 3);
+	if (k == 0) return c.ok;
+
+	m_bounds.merge(c.bounds);
+	for (Cluster cl : c.clusters) {
+		cl.first += m_max;
+		m_clusters.push_back(cl);
+	}
+
+	Chunk ch { 0, m_max, k };
+	glGenBuffers(1, &ch.buf);
+	glBindBuffer(GL_ARRAY_BUFFER, ch.buf);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(Vertex) * k * 3), c.vert.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	std::vector<Vertex>().swap(c.vert);
+	m_chunks.push_back(ch);
+	m_max = m_len = m_max + k;
+	return c.ok;
+}
+
+void Solid::upload()
+{
+	if (!m_chunks.empty()) return; // Uploaded while reading
+	release();
+	for (Solid& l : m_lods) l.upload();
+	if (m_max <= 0 || !m_elem) return;
+
+	// Buffers are written once and drawn many times
+	glGenBuffers(3, m_buf);
+	glBindBuffer(GL_ARRAY_BUFFER, m_buf[0]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLfloat) * m_nvert * 3), m_vertex, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, m_buf[1]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLfloat) * m_nvert * 3), m_norm, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_buf[2]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLuint) * m_max * 3), m_elem, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	if (!m_smooth) return;
+
+	// Smooth shading has its own vertices, split at creases
+	glGenBuffers(2, m_sbuf);
+	glBindBuffer(GL_ARRAY_BUFFER, m_sbuf[0]);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLfloat) * m_nsmooth * 6), m_smooth, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_sbuf[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(GLuint) * m_max * 3), m_selem, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void Solid::release()
+{
+	// Nothing to do if never uploaded, e.g. without a context
+	if (m_buf[0]) glDeleteBuffers(3, m_buf);
+	m_buf[0] = m_buf[1] = m_buf[2] = 0;
+	if (m_sbuf[0]) glDeleteBuffers(2, m_sbuf);
+	m_sbuf[0] = m_sbuf[1] = 0;
+
+	for (const Chunk& c : m_chunks) glDeleteBuffers(1, &c.buf);
+	m_chunks.clear();
+	for (Solid& l : m_lods) l.release();
+}
@@ -2,11 +2,67 @@
 #define SOLID_HPP
 #include <string>
 #include <cstdint>
+#include <fstream>
+#include <vector>
+#include <memory>
 #include <GL/glew.h>
 #include "triangle.hpp"
+#include "mappedfile.hpp"
+#include "cache.hpp"
+#include "bounds.hpp"
 
 class Solid {
 public:
+	/** Strategy used to read binary `.stl` files.
+	*/
+	enum class Loader {
+		STREAM,	// Buffered std::ifstream reads
+		MMAP,	// Decode records directly out of a memory mapping
+		PARALLEL,	// Decode mapped records on the shared thread pool
+		CHUNKED	// Upload bounded chunks as they're read, keeping no copy
+	};
+
+	/** A spatially coherent run of triangles in the index buffer, which
+	 * is drawn or skipped as a whole.
+	*/
+	struct Cluster {
+		float min[3];		// Bounding box
+		float max[3];
+		float axis[3];		// Average facing direction
+		float cutoff;		// Sine of the normals' spread around axis, > 1 if too wide
+		uint32_t first;		// First triangle
+		uint32_t count;		// Number of triangles
+	};
+
+	/** Options a file is read with, e.g. the same for every mesh of a
+	 * scene. The defaults are those of a new solid.
+	*/
+	struct Options {
+		double eps;		// Welding distance
+		double crease;		// Crease angle in degrees
+		size_t budget;		// Chunked loader memory budget
+		bool cache;		// Use the cache in readFile()
+		bool fix;		// Replace bad file normals
+
+		Options();
+	};
+
+	/** A vertex as uploaded by the chunked loader.
+	*/
+	struct Vertex {
+		GLfloat pos[3];
+		GLbyte norm[4];		// Normalized, the last byte is padding
+	};
+
+	/** Binary `.stl` records converted by prepare(), ready for append().
+	*/
+	struct Prepared {
+		std::vector<Vertex> vert;	// 3 per triangle, along a Morton curve
+		std::vector<Cluster> clusters;	// Triangle numbers start at the chunk
+		Bounds bounds;			// Box of the chunk
+		bool ok;			// Every normal matches its vertices
+	};
+
 	Solid();				// Default constructor
 	~Solid();				// Destructor
 	Solid(const Solid&);			// Copy constructor
@@ -15,39 +71,345 @@ public:
 	Solid& operator=(const Solid&);		// Copy assignment
 	Solid& operator=(Solid&&) noexcept;	// Move assignment
 
-	/** Construct a new solid from a given `.stl` file.
+	/** Construct a new solid from a given `.stl` file and upload it to
+	 * OpenGL. Both binary and text files are accepted. The welded solid
+	 * is cached, so opening the file again skips parsing. With the
+	 * chunked loader only the buffers and clusters are kept, so there are
+	 * no positions, levels of detail or copies of the solid.
+	 * @param Filename
+	 * @param l Loader used to read binary files
+	 * @return True on success, false otherwise
+	*/
+	bool readFile(std::string, Loader = Loader::STREAM);
+
+	/** Do everything readFile() does except uploading, so it can run on
+	 * any thread. Not for the chunked loader.
+	 * @param Filename
+	 * @param l Loader used to read binary files
+	 * @return True on success, false otherwise
+	*/
+	bool load(std::string, Loader = Loader::STREAM);
+
+	/** Check if readFile() would read a file from the cache.
+	 * @param Filename
+	 * @return True if there's an up to date cache entry
+	*/
+	bool isCached(std::string) const;
+
+	/** Read the header of a binary `.stl` file.
+	 * @param is Stream at the start of the file, left at the first record
+	 * @param n Set to the number of records
+	 * @return False if it's a text file or the count doesn't fit the size
+	*/
+	bool readHeader(std::istream&, uint32_t&) const;
+
+	/** Upload binary `.stl` records as a new chunk, e.g. while the rest of
+	 * the file is still being read. Welded triangles are dropped first.
+	 * @param r Records, 50 bytes each as stored in the file
+	 * @param n Number of records
+	 * @return False if some normal doesn't match its vertices
+	*/
+	bool append(const char *, uint32_t);
+
+	/** Do everything append() does except uploading, so it can run on
+	 * any thread. Normals are checked and fixed as set for this solid.
+	 * @param r Records, 50 bytes each as stored in the file
+	 * @param n Number of records
+	 * @param out Set to the converted chunk
+	*/
+	void prepare(const char *, uint32_t, Prepared&) const;
+
+	/** Upload a chunk converted by prepare(). Must be called on the
+	 * thread owning the OpenGL context.
+	 * @param c Converted chunk, its vertices are released
+	 * @return False if some normal doesn't match its vertices
+	*/
+	bool append(Prepared&);
+
+	/** Read a `.stl` file without touching OpenGL, e.g. when there is
+	 * no context yet. Text files are always parsed from a mapping, and
+	 * so are binary files with the chunked loader. Whatever was read
+	 * before is dropped, so buffers must have been released already.
 	 * @param Filename
+	 * @param l Loader used to read binary files
 	 * @return True on success, false otherwise
 	*/
-	bool readFile(std::string);
+	bool parseFile(std::string, Loader = Loader::STREAM);
+
+	/** Merge shared vertices into an indexed mesh using a hash grid.
+	 * Flat normals are stored on each triangle's last (provoking) vertex.
+	 * This is called by readFile(), after parseFile() it must be called
+	 * before upload().
+	*/
+	void weld();
+
+	/** Build a chain of simplified copies for drawing while the view is
+	 * moving, each with about a quarter of the previous one's triangles.
+	 * This is called by readFile(), after parseFile() it must be called
+	 * before upload().
+	*/
+	void simplify();
+
+	/** Get the most detailed level of detail within a triangle budget.
+	 * @param n Maximum number of triangles
+	 * @return This solid if it fits or has no simpler levels, otherwise
+	 * the largest level that fits, or the smallest level
+	*/
+	const Solid& getLod(uint32_t) const;
+
+	/** Apply read options, before the file is read.
+	 * @param o Options, see the setter of each
+	*/
+	void setOptions(const Options&);
+
+	/** Set how close vertices must be to be merged when a file is read.
+	 * @param e Distance, 0 to merge only identical vertices
+	*/
+	void setWeldEpsilon(double);
+
+	/** Choose whether readFile() uses and updates the cache.
+	 * @param b True to use the cache, the default
+	*/
+	void setCache(bool);
+
+	/** Choose whether file normals that don't match their triangle are
+	 * replaced by computed ones. Missing normals are always computed.
+	 * @param b True to replace bad normals, off by default
+	*/
+	void setFixNormals(bool);
+
+	/** Set how much memory the chunked loader may use for reading and
+	 * converting a chunk.
+	 * @param b Size in bytes
+	*/
+	void setMemoryBudget(size_t);
+
+	/** Get the memory budget of the chunked loader.
+	 * @return Bytes
+	*/
+	size_t getMemoryBudget() const;
 
 	/** Toggle lighting on and off. This determines wether or not
-	 * normal vectors are included in the display list.
-	 * After a call to this method, getList() must follow.
+	 * normal vectors are sourced when drawing.
 	*/
 	void toggleLight();
 
-	/** Get the display list index.
-	 * @return GLuint display list index
+	/** Toggle between flat and smooth shading. Smooth shading uses the
+	 * vertex normals computed when the solid was welded, so switching is
+	 * instantaneous. Solids from the chunked loader are always flat.
+	*/
+	void toggleSmooth();
+
+	/** Check if smooth shading is on.
+	 * @return True if vertex normals are used when lit
+	*/
+	bool getSmooth() const;
+
+	/** Set the largest angle between two triangles that smooth shading
+	 * blends across, sharper edges stay creased. Must be set before the
+	 * file is read.
+	 * @param a Angle in degrees, 30 by default
+	*/
+	void setCreaseAngle(double);
+
+	/** Check if lighting is on.
+	 * @return True if normals are sourced when drawing
+	*/
+	bool getLight() const;
+
+	/** Delete the buffers and chunks, including those of the levels of
+	 * detail. Must be called while the OpenGL context they were created
+	 * in is current, or not at all.
+	*/
+	void release();
+
+	/** Create the vertex, normal and index buffers, including those of
+	 * the levels of detail. This is called when a file is read, or by
+	 * hand for copies which don't share buffers.
+	*/
+	void upload();
+
+	/** Draw the solid from its buffers.
+	*/
+	void draw() const;
+
+	/** Draw some of the solid's clusters.
+	 * @param c Cluster indices in increasing order
+	*/
+	void draw(const std::vector<uint32_t>&) const;
+
+	/** Draw the whole solid several times with one call, for a vertex
+	 * shader that places each instance.
+	 * @param n Number of instances
+	*/
+	void drawInstanced(GLsizei) const;
+
+	/** Get the clusters the triangles are grouped in.
+	 * @return Clusters in index buffer order, empty before weld()
 	*/
-	GLuint getList() const;
+	const std::vector<Cluster>& getClusters() const;
 
-	/** Get the radius of a rough spehere that bounds the solid.
-	 * @return Distance between minimum and maximum points
+	/** Get the radius of a sphere that bounds the solid, close to the
+	 * smallest one.
+	 * @return Radius, 0 if empty
 	*/
 	double getRadius() const;
 
-	/** Get the rough center of the solid.
+	/** Get the center of the bounding sphere, which the solid is
+	 * rotated around.
 	 * @return Center of the bounding sphere
 	*/
 	Vector3 getCenter() const;
 
+	/** Get the solid's bounding box, oriented box and sphere, computed
+	 * when it is read.
+	 * @return Bounds
+	*/
+	const Bounds& getBounds() const;
+
+	/** Get the number of triangles.
+	 * @return Triangle count
+	*/
+	uint32_t size() const;
+
+	/** Get the triangle vertex positions.
+	 * @return 9 floats per triangle (v0, v1, v2), nullptr if empty
+	*/
+	const float *getPositions() const;
+
+	/** Get the normals read from the file.
+	 * @return 3 floats per triangle, nullptr if empty
+	*/
+	const float *getNormals() const;
+
+	/** Get the welded vertex positions.
+	 * @return 3 floats per vertex, nullptr before weld()
+	*/
+	const float *getVertices() const;
+
+	/** Get the welded vertex normals. Each triangle's normal is stored
+	 * on its last vertex.
+	 * @return 3 floats per vertex, nullptr before weld()
+	*/
+	const float *getVertexNormals() const;
+
+	/** Get the number of welded vertices.
+	 * @return Vertex count
+	*/
+	uint32_t vertexCount() const;
+
+	/** Get the welded vertex indices.
+	 * @return 3 indices per triangle, nullptr before weld()
+	*/
+	const uint32_t *getIndices() const;
+
+	/** Get a single triangle.
+	 * @param i Triangle index
+	 * @return The triangle, a default constructed one on invalid index
+	*/
+	Triangle getTriangle(uint32_t) const;
+
 private:
-	/** Append a triangle to the solid.
-	 * @param Triangle to append
-	 * @bool True on success, false otherwise
+	/** A buffer of triangles uploaded by the chunked loader.
+	*/
+	struct Chunk {
+		GLuint buf;
+		uint32_t first;		// First triangle
+		uint32_t count;		// Number of triangles
+	};
+
+	/** Sizes of one level of detail in a cache entry. The levels share
+	 * the bounds, which are stored once before them.
+	*/
+	struct Level {
+		uint32_t tris;
+		uint32_t verts;
+		uint32_t clusters;
+		uint32_t smooth;	// Smooth shaded vertices
+		uint32_t flat;		// Triangles stored in file order, 0 or tris
+	};
+
+	/** Load the welded solid and its levels of detail from a cache entry.
+	 * Nothing is copied, the arrays point into the entry's mapping.
+	 * @param c Open cache entry, kept open by the solid
+	 * @return True on success, false if the entry is damaged
+	*/
+	bool readCache(const std::shared_ptr<const Cache>&);
+
+	/** Store the welded solid and its levels of detail in a cache entry.
+	 * @param c Cache entry to write
+	 * @return True on success, false otherwise
+	*/
+	bool writeCache(const Cache&) const;
+
+	/** Drop all triangles, buffers and levels of detail.
+	*/
+	void clear();
+
+	/** Free the triangle & vertex arrays, or let go of the cache entry
+	 * they point into.
 	*/
-	bool append(const Triangle&);
+	void freeArrays();
+
+	/** Read a binary file in chunks, uploading each one and only keeping
+	 * the bounds and clusters. Falls back to reading text files whole.
+	 * @param f Filename
+	 * @return True on success, false otherwise
+	*/
+	bool readChunked(std::string);
+
+	/** Read triangles from an open file stream.
+	 * @param is Stream positioned at the start of the file
+	 * @return True on success, false otherwise
+	*/
+	bool readStream(std::ifstream&);
+
+	/** Read triangles from a memory mapped file. The header and triangle
+	 * count are checked against the file size before anything is allocated.
+	 * @param f Mapped file
+	 * @param p Split the records across the shared thread pool
+	 * @return True on success, false otherwise
+	*/
+	bool readMapped(const MappedFile&, bool);
+
+	/** Read triangles from a memory mapped text (ASCII) file.
+	 * @param f Mapped file
+	 * @return True on success, false otherwise
+	*/
+	bool readAscii(const MappedFile&);
+
+	/** Check if a file is in the text format.
+	 * @param p Start of the file
+	 * @param len Number of bytes available at p
+	 * @param size Total size of the file
+	 * @return True for text files, false for binary files
+	*/
+	bool isAscii(const char *, size_t, size_t) const;
+
+	/** Allocate storage for a given number of triangles.
+	 * @param n Number of triangles
+	 * @return True on success, false otherwise
+	*/
+	bool reserve(uint32_t);
+
+	/** Add a facet decoded from a record, bounds are left to the caller.
+	 * @param f 12 floats in order: normal, v0, v1, v2
+	 * @return False if every reserved slot is already used
+	*/
+	bool addFacet(const float *);
+
+	/** Store a decoded record in a triangle slot. Distinct slots may be
+	 * written concurrently.
+	 * @param f 12 floats in order: normal, v0, v1, v2
+	 * @param i Triangle index
+	*/
+	void decode(const float *, uint32_t);
+
+	/** Check the file normals of all triangles in one batch and report
+	 * what was found. Missing normals are computed from the vertices, and
+	 * so are bad ones if setFixNormals() was called. Called by parseFile().
+	*/
+	void checkNormals();
 
 	/** Get machine endianness.
 	 * @return True if little-endian, false if big-endian
@@ -60,21 +422,58 @@ private:
 	template<typename T>
 	void swapEndian(T *) const;
 
-	/** Create a display list using the current parameters.
-	 * This is called when a file is read or when lighting is toggled.
+	/** Sort the welded triangles along a space filling curve and group
+	 * them into clusters. Called by weld().
+	*/
+	void cluster();
+
+	/** Compute area-weighted vertex normals on the thread pool, splitting
+	 * vertices where triangles meet at more than the crease angle. Called
+	 * by weld(), after cluster() so both index buffers share one order.
+	 * @param base Welded vertex each vertex of the index buffer copies
+	 * @param welded Number of welded vertices
+	*/
+	void smooth(const std::vector<uint32_t>&, uint32_t);
+
+	/** Bind the buffers and enable the arrays needed to draw.
+	*/
+	void bind() const;
+
+	/** Point the arrays at a chunk's buffer.
+	 * @param c The chunk
+	*/
+	void bind(const Chunk&) const;
+
+	/** Undo bind().
 	*/
-	void genDisplayList();
+	void unbind() const;
 
 	// Instance variables
-	Triangle *m_arr;
+	float *m_pos;		// Vertex positions, 9 per triangle
+	float *m_fnorm;		// File normals, 3 per triangle
 	uint32_t m_max;
 	uint32_t m_len;
 	bool m_light;
-	Vector3 m_upper;
-	Vector3 m_lower;
-	GLuint m_index;
-	GLdouble *m_vertex;
-	GLdouble *m_norm;
+	Bounds m_bounds;
+	GLuint m_buf[3];	// Position, normal and index buffers
+	GLfloat *m_vertex;	// Welded positions, 3 per vertex
+	GLfloat *m_norm;	// Flat normals, 3 per vertex
+	GLuint *m_elem;		// Vertex indices, 3 per triangle
+	uint32_t m_nvert;	// Number of welded vertices
+	double m_eps;		// Welding distance
+	std::vector<Solid> m_lods;	// Simplified copies, most detailed first
+	std::vector<Cluster> m_clusters;
+	std::vector<Chunk> m_chunks;	// Buffers from the chunked loader
+	size_t m_budget;	// Chunked loader memory budget
+	bool m_cache;		// Use the cache in readFile()
+	bool m_fix;		// Replace bad file normals
+	GLfloat *m_smooth;	// Positions & vertex normals, 6 per vertex
+	GLuint *m_selem;	// Their indices, 3 per triangle
+	uint32_t m_nsmooth;	// Number of smooth shaded vertices
+	GLuint m_sbuf[2];	// Smooth vertex and index buffers
+	double m_crease;	// Crease angle in degrees
+	bool m_shade;		// Draw with smooth normals
+	std::shared_ptr<const Cache> m_entry;	// Cache entry the arrays point into, if read from one
 };
 
 #endif
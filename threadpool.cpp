@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <exception>
+#include "threadpool.hpp"
+
+namespace {
+
+// Pool & worker index of the calling thread, if it's a worker
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned n)
+: m_pending(0)
+, m_stop(false)
+{
+	if (n == 0) n = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < n; ++i) m_workers.push_back(std::make_unique<Worker>());
+	for (unsigned i = 0; i < n; ++i) {
+		m_threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (std::thread& t : m_threads) t.join();
+}
+
+unsigned ThreadPool::size() const
+{
+	return static_cast<unsigned>(m_threads.size());
+}
+
+size_t ThreadPool::chunks(size_t n, size_t g) const
+{
+	// A few chunks per thread evens out uneven progress
+	size_t c = (m_threads.size() + 1) * 4;
+	size_t fit = (n + std::max<size_t>(g, 1) - 1) / std::max<size_t>(g, 1);
+	return std::max<size_t>(1, std::min(c, fit));
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t, size_t, size_t)>& f, size_t g)
+{
+	size_t c = chunks(n, g);
+	if (c == 1) {
+		f(0, n, 0);
+		return;
+	}
+
+	// Chunks are claimed in order from this call's own range, by the
+	// caller and by helpers queued on the pool. The caller only ever runs
+	// its own chunks, so it can't get stuck behind unrelated tasks; once
+	// they're all claimed it waits. Every chunk is counted even if f
+	// throws, and the chunks after a failure are skipped. Helpers may
+	// start after the call returns and find nothing left to claim, which
+	// is why the range is reference counted
+	struct Range {
+		const std::function<void(size_t, size_t, size_t)> *f;
+		size_t n, c;
+		std::atomic<size_t> next;
+		std::atomic<bool> failed;
+		size_t left;		// Chunks not finished, guarded by m_mutex
+		std::exception_ptr error;
+	};
+	auto r = std::make_shared<Range>();
+	r->f = &f;
+	r->n = n;
+	r->c = r->left = c;
+	r->next = 0;
+	r->failed = false;
+
+	auto run = [this, r] {
+		for (size_t i; (i = r->next++) < r->c;) {
+			std::exception_ptr err;
+			if (!r->failed) {
+				try {
+					(*r->f)(r->n * i / r->c, r->n * (i + 1) / r->c, i);
+				} catch (...) {
+					err = std::current_exception();
+					r->failed = true;
+				}
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (err && !r->error) r->error = err;
+			if (--r->left == 0) m_cv.notify_all();
+		}
+	};
+	size_t helpers = std::min<size_t>(c - 1, m_threads.size());
+	for (size_t i = 0; i < helpers; ++i) push(run);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_cv.notify_all();
+
+	run();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [&r] { return r->left == 0; });
+
+	// The first exception is thrown on the calling thread
+	std::exception_ptr error = std::move(r->error);
+	lock.unlock();
+	if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::submit(std::function<void()> f)
+{
+	push(std::move(f));
+
+	// Taking the lock orders the push before any waiter's check
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+	}
+	m_cv.notify_one();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::work(size_t i)
+{
+	t_pool = this;
+	t_index = i;
+	while (true) {
+		if (runOne()) continue;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this] { return m_stop || m_pending > 0; });
+		if (m_stop && m_pending == 0) return;
+	}
+}
+
+bool ThreadPool::runOne()
+{
+	std::function<void()> task;
+	if (!take(task)) return false;
+	task();
+	return true;
+}
+
+bool ThreadPool::take(std::function<void()>& f)
+{
+	Worker *own = self();
+	if (own) {
+		std::lock_guard<std::mutex> lock(own->mutex);
+		if (!own->tasks.empty()) {
+			f = std::move(own->tasks.back());
+			own->tasks.pop_back();
+			--m_pending;
+			return true;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_queue.empty()) {
+			f = std::move(m_queue.front());
+			m_queue.pop_front();
+			--m_pending;
+			return true;
+		}
+	}
+
+	// Steal, starting with the next worker so victims are spread out
+	size_t n = m_workers.size();
+	size_t first = (own ? t_index + 1 : 0);
+	for (size_t k = 0; k < n; ++k) {
+		Worker& w = *m_workers[(first + k) % n];
+		if (&w == own) continue;
+		std::lock_guard<std::mutex> lock(w.mutex);
+		if (!w.tasks.empty()) {
+			f = std::move(w.tasks.front());
+			w.tasks.pop_front();
+			--m_pending;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::push(std::function<void()> f)
+{
+	Worker *own = self();
+	if (own) {
+		std::lock_guard<std::mutex> lock(own->mutex);
+		own->tasks.push_back(std::move(f));
+		++m_pending;
+	} else {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(f));
+		++m_pending;
+	}
+}
+
+ThreadPool::Worker *ThreadPool::self() const
+{
+	return (t_pool == this ? m_workers[t_index].get() : nullptr);
+}
@@ -0,0 +1,106 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+class ThreadPool {
+public:
+	/** Start a pool of worker threads, each with its own queue. Workers
+	 * run their own newest task first and steal the oldest tasks of busy
+	 * ones when idle, so nested work stays local until someone is free.
+	 * @param n Number of workers, 0 to use one per hardware thread
+	*/
+	explicit ThreadPool(unsigned = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/** Get the number of worker threads.
+	 * @return Worker count
+	*/
+	unsigned size() const;
+
+	/** Split the range [0, n) into contiguous chunks and process them on
+	 * the pool. The calling thread works on the chunks too, but never on
+	 * other tasks, then waits until every chunk is done. If f
+	 * throws, the chunks not started yet are skipped and the first
+	 * exception is thrown again here once the others have finished.
+	 * @param n Number of items
+	 * @param f Called as f(begin, end, chunk) with chunk in [0, chunks(n))
+	 * @param g Minimum number of items per chunk
+	*/
+	void parallelFor(size_t, const std::function<void(size_t, size_t, size_t)>&, size_t = 1024);
+
+	/** Queue a task to run on a worker thread. From a worker it goes on
+	 * that worker's own queue.
+	 * @param f Task
+	*/
+	void submit(std::function<void()>);
+
+	/** Get the number of chunks parallelFor() splits a range into, so
+	 * callers can allocate one partial result per chunk.
+	 * @param n Number of items
+	 * @param g Minimum number of items per chunk
+	 * @return Chunk count, at least 1
+	*/
+	size_t chunks(size_t, size_t = 1024) const;
+
+	/** Get the pool shared by the whole program.
+	 * @return Shared pool
+	*/
+	static ThreadPool& shared();
+
+private:
+	/** A worker's own tasks.
+	*/
+	struct Worker {
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+	};
+
+	/** Worker thread main loop.
+	 * @param i Worker index
+	*/
+	void work(size_t);
+
+	/** Run one queued task if there is one.
+	 * @return True if a task was run
+	*/
+	bool runOne();
+
+	/** Take the calling worker's newest task, or else the oldest task
+	 * from outside the pool, or else steal another worker's oldest.
+	 * @param f Set to the task
+	 * @return False if every queue is empty
+	*/
+	bool take(std::function<void()>&);
+
+	/** Queue a task without waking anyone.
+	 * @param f Task
+	*/
+	void push(std::function<void()>);
+
+	/** Get the calling thread's worker.
+	 * @return The worker, nullptr if not one of this pool's threads
+	*/
+	Worker *self() const;
+
+	// Instance variables
+	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::deque<std::function<void()>> m_queue;	// Tasks from outside the pool
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::atomic<size_t> m_pending;	// Tasks in all queues
+	bool m_stop;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef VEC3F_HPP
+#define VEC3F_HPP
+#include <cmath>
+
+class Vec3f {
+public:
+	// Constructors
+	constexpr Vec3f() : x(0), y(0), z(0) {}
+	constexpr Vec3f(float x, float y, float z) : x(x), y(y), z(z) {}
+
+	/** Read a vector from an array, e.g. of vertex positions.
+	 * @param p Three coordinates
+	 * @return Vector
+	*/
+	static constexpr Vec3f load(const float *p)
+	{
+		return Vec3f(p[0], p[1], p[2]);
+	}
+
+	/** Write the vector to an array.
+	 * @param p Where to write three coordinates
+	*/
+	constexpr void store(float *p) const
+	{
+		p[0] = x;
+		p[1] = y;
+		p[2] = z;
+	}
+
+	// Operators
+	constexpr Vec3f operator+(const Vec3f& o) const { return Vec3f(x + o.x, y + o.y, z + o.z); }
+	constexpr Vec3f operator-(const Vec3f& o) const { return Vec3f(x - o.x, y - o.y, z - o.z); }
+	constexpr Vec3f operator-() const { return Vec3f(-x, -y, -z); }
+	constexpr Vec3f operator*(float f) const { return Vec3f(x * f, y * f, z * f); }
+	constexpr Vec3f operator/(float f) const { return Vec3f(x / f, y / f, z / f); }
+	constexpr Vec3f& operator+=(const Vec3f& o) { x += o.x; y += o.y; z += o.z; return *this; }
+	constexpr Vec3f& operator-=(const Vec3f& o) { x -= o.x; y -= o.y; z -= o.z; return *this; }
+	constexpr Vec3f& operator*=(float f) { x *= f; y *= f; z *= f; return *this; }
+	constexpr bool operator==(const Vec3f& o) const { return x == o.x && y == o.y && z == o.z; }
+	constexpr bool operator!=(const Vec3f& o) const { return !(*this == o); }
+
+	/** Calculate the dot product of two vectors.
+	 * @param o Other vector
+	 * @return Dot product
+	*/
+	constexpr float dot(const Vec3f& o) const
+	{
+		return x * o.x + y * o.y + z * o.z;
+	}
+
+	/** Calculate the cross product of two vectors.
+	 * @param o Other vector
+	 * @return This x o
+	*/
+	constexpr Vec3f cross(const Vec3f& o) const
+	{
+		return Vec3f(y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x);
+	}
+
+	/** Calculate the squared magnitude, which needs no square root.
+	 * @return |v|^2
+	*/
+	constexpr float mag2() const
+	{
+		return dot(*this);
+	}
+
+	/** Calculate the magnitude of the vector.
+	 * @return |v|
+	*/
+	float mag() const
+	{
+		return std::sqrt(mag2());
+	}
+
+	/** Calculate the normalized version of the vector.
+	 * @return Unit vector, NaN if the vector is zero
+	*/
+	Vec3f norm() const
+	{
+		return *this / mag();
+	}
+
+	// Instance variables
+	float x, y, z;
+};
+
+#endif
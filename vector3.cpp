@@ -99,7 +99,7 @@ Vector3 Vector3::norm() const
 
 double Vector3::mag() const
 {
-	return std::sqrt(std::pow(x, 2) + std::pow(y, 2) + std::pow(z, 2));
+	return std::sqrt(x * x + y * y + z * z);
 }
 
 Vector3 Vector3::rotate(double x, double y, double z) const
@@ -107,27 +107,34 @@ Vector3 Vector3::rotate(double x, double y, double z) const
 	Vector3 v = *this;
 	double c;
 	double s;
+	double t;
 
 	// x-axis rotation
-	c = std::cos(x);
-	s = std::sin(x);
-	v.x = v.x;
-	v.y = v.y * c + v.z * -s;
-	v.z = v.y * s + v.z * c;
+	if (x != 0) {
+		c = std::cos(x);
+		s = std::sin(x);
+		t = v.y * c - v.z * s;
+		v.z = v.y * s + v.z * c;
+		v.y = t;
+	}
 
 	// y-axis rotation
-	c = std::cos(y);
-	s = std::sin(y);
-	v.x = v.x * c + v.z * s;
-	v.y = v.y;
-	v.z = v.x * -s + v.z * c;
+	if (y != 0) {
+		c = std::cos(y);
+		s = std::sin(y);
+		t = v.x * c + v.z * s;
+		v.z = -v.x * s + v.z * c;
+		v.x = t;
+	}
 
 	// z-axis rotation
-	c = std::cos(z);
-	s = std::sin(z);
-	v.x = v.x * c + v.y * -s;
-	v.y = v.x * s + v.y * c;
-	v.z = v.z;
+	if (z != 0) {
+		c = std::cos(z);
+		s = std::sin(z);
+		t = v.x * c - v.y * s;
+		v.y = v.x * s + v.y * c;
+		v.x = t;
+	}
 
 	return v;
 }